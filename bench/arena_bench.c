@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_IMPLEMENTATION
+#include <common/arena.h>
+#define TTIME_IMPLEMENTATION
+#include <common/ttime.h>
+
+// allocation pattern close to the assembler: lots of small, short-lived objects
+#define BENCH_ROUNDS 64
+#define BENCH_ALLOCS 100000
+#define BENCH_MAX_SIZE 96
+
+static volatile uint8_t sink;
+
+static size_t bench_size(size_t i) {
+    return 8 + (i * 2654435761u) % BENCH_MAX_SIZE;
+}
+
+static uint64_t bench_malloc() {
+    void** ptrs = malloc(sizeof(void*) * BENCH_ALLOCS);
+    uint64_t start = ttime_now_ns();
+    for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+        for (size_t i = 0; i < BENCH_ALLOCS; i++) {
+            ptrs[i] = malloc(bench_size(i));
+            ((uint8_t*)ptrs[i])[0] = (uint8_t)i;
+        }
+        for (size_t i = 0; i < BENCH_ALLOCS; i++) {
+            sink = ((uint8_t*)ptrs[i])[0];
+            free(ptrs[i]);
+        }
+    }
+    uint64_t elapsed = ttime_now_ns() - start;
+    free(ptrs);
+    return elapsed;
+}
+
+static uint64_t bench_arena(arena_stats_t* stats) {
+    arena_t* arena = arena_init(4096);
+    arena_mark_t mark = arena_save(arena);
+    uint64_t start = ttime_now_ns();
+    for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+        for (size_t i = 0; i < BENCH_ALLOCS; i++) {
+            uint8_t* ptr = arena_alloc(&arena, bench_size(i));
+            ptr[0] = (uint8_t)i;
+            sink = ptr[0];
+        }
+        if (r == 0)
+            *stats = arena_stats(arena);
+        arena_restore(&arena, mark);
+    }
+    uint64_t elapsed = ttime_now_ns() - start;
+    arena_destroy(arena);
+    return elapsed;
+}
+
+static uint64_t bench_arena_realloc() {
+    arena_t* arena = arena_init(4096);
+    uint64_t start = ttime_now_ns();
+    for (size_t r = 0; r < BENCH_ROUNDS; r++) {
+        // growing buffer, the common "append until done" pattern
+        size_t size = 16;
+        uint8_t* buf = arena_alloc(&arena, size);
+        for (size_t i = 0; i < BENCH_ALLOCS / 16; i++) {
+            buf = arena_realloc(&arena, buf, size, size + 16);
+            size += 16;
+            buf[size - 1] = (uint8_t)i;
+        }
+        sink = buf[size - 1];
+        arena_reset(&arena);
+    }
+    uint64_t elapsed = ttime_now_ns() - start;
+    arena_destroy(arena);
+    return elapsed;
+}
+
+int main() {
+    const double total = (double)BENCH_ROUNDS * BENCH_ALLOCS;
+    arena_stats_t stats = {0};
+
+    uint64_t malloc_ns = bench_malloc();
+    uint64_t arena_ns = bench_arena(&stats);
+    uint64_t realloc_ns = bench_arena_realloc();
+
+    printf("%-16s %10.2f ns/alloc\n", "malloc/free", malloc_ns / total);
+    printf("%-16s %10.2f ns/alloc (%.1fx)\n", "arena", arena_ns / total, (double)malloc_ns / arena_ns);
+    printf("%-16s %10.2f ns/grow\n", "arena realloc", realloc_ns / ((double)BENCH_ROUNDS * (BENCH_ALLOCS / 16)));
+    printf("arena: %zu chunks, %zu/%zu bytes used, %zu allocs per round\n",
+        stats.chunk_count, stats.used, stats.capacity, stats.alloc_count);
+    return 0;
+}
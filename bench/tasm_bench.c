@@ -0,0 +1,207 @@
+#define TTIME_IMPLEMENTATION
+#include <common/ttime.h>
+#include <tasm/tasm.h>
+#include <common/cmd_colors.h>
+
+/*
+    tasm_bench times the assembler one phase at a time on the same source:
+    lex (a token only pass), parse (lexes again, the parser pulls tokens on demand),
+    resolve (branch fusion, proc and label tables), translate and write.
+    Every phase keeps its fastest run, allocations are counted on the first one.
+*/
+
+typedef enum {
+    BENCH_PHASE_LEX,
+    BENCH_PHASE_PARSE,
+    BENCH_PHASE_RESOLVE,
+    BENCH_PHASE_TRANSLATE,
+    BENCH_PHASE_WRITE,
+    BENCH_PHASE_COUNT,
+} bench_phase_t;
+
+static const char* bench_phase_names[BENCH_PHASE_COUNT] = {
+    "lex", "parse", "resolve", "translate", "write",
+};
+
+typedef struct {
+    uint64_t best_ns;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+} bench_phase_result_t;
+
+static uint64_t bench_allocs;
+static uint64_t bench_alloc_bytes;
+
+#ifdef TASM_BENCH_WRAP_MALLOC
+// linked with --wrap, every malloc, calloc and realloc of the assembler lands here first
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    bench_allocs++;
+    bench_alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    bench_allocs++;
+    bench_alloc_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    bench_allocs++;
+    bench_alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+// the lexer stops on an EOF char and measures the source with strlen
+static char* bench_read_source(const char* file_name, size_t* size) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    char* content = malloc(file_size + 2);
+    *size = fread(content, 1, file_size, file);
+    fclose(file);
+    content[*size] = (char)EOF;
+    content[*size + 1] = '\0';
+    return content;
+}
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t start_allocs;
+    uint64_t start_bytes;
+} bench_clock_t;
+
+static bench_clock_t bench_begin() {
+    return (bench_clock_t) {
+        .start_allocs = bench_allocs,
+        .start_bytes = bench_alloc_bytes,
+        .start_ns = ttime_now_ns(),
+    };
+}
+
+static void bench_end(bench_clock_t clock, bench_phase_result_t* phase, bool first) {
+    uint64_t elapsed = ttime_now_ns() - clock.start_ns;
+    if (elapsed < phase->best_ns)
+        phase->best_ns = elapsed;
+    if (first) {
+        phase->allocs = bench_allocs - clock.start_allocs;
+        phase->alloc_bytes = bench_alloc_bytes - clock.start_bytes;
+    }
+}
+
+// one pass through every phase, false when the source does not assemble
+static bool bench_assemble(const char* file_name, const char* source, const char* output_name,
+                           bench_phase_result_t* phases, bool first, size_t* token_count, size_t* code_size) {
+    bench_clock_t clock = bench_begin();
+    tasm_lexer_t lexer = tasm_lexer_init(source, file_name);
+    size_t tokens = 0;
+    while (tasm_lexer_get_next_token(&lexer).type != TOKEN_EOF)
+        tokens++;
+    tasm_lexer_destroy(&lexer);
+    bench_end(clock, &phases[BENCH_PHASE_LEX], first);
+    *token_count = tokens;
+
+    clock = bench_begin();
+    ast_arena = arena_init(1024);
+    lexer = tasm_lexer_init(source, file_name);
+    tasm_parser_t parser = tasm_parser_init(&lexer);
+    tasm_ast_t* ast = tasm_parse_file(&parser);
+    bench_end(clock, &phases[BENCH_PHASE_PARSE], first);
+    bool ok = !tasm_parser_is_err(&parser);
+
+    tasm_translator_t translator = tasm_translator_init();
+    if (ok) {
+        clock = bench_begin();
+        tasm_fuse_branches(ast);
+        tasm_resolve_procs(&translator, ast);
+        tasm_resolve_labels(&translator, ast, NULL);
+        bench_end(clock, &phases[BENCH_PHASE_RESOLVE], first);
+        ok = !tasm_translator_is_err(&translator);
+    }
+    if (ok) {
+        clock = bench_begin();
+        tasm_translate_unit(&translator, ast);
+        bench_end(clock, &phases[BENCH_PHASE_TRANSLATE], first);
+        ok = !tasm_translator_is_err(&translator);
+        *code_size = translator.program.size;
+    }
+    if (ok) {
+        cli_parsed_args_t args = {
+            .file_name = (char*)file_name,
+            .output_name = (char*)output_name,
+        };
+        clock = bench_begin();
+        tasm_translator_generate_bin(&translator, args);
+        bench_end(clock, &phases[BENCH_PHASE_WRITE], first);
+    }
+
+    tasm_translator_destroy(&translator);
+    tasm_parser_destroy(&parser);
+    tasm_ast_destroy(ast);
+    arena_destroy(ast_arena);
+    return ok;
+}
+
+static void bench_report(const char* file_name, size_t source_size, size_t tokens, size_t code_size, bench_phase_result_t* phases) {
+    double mb = source_size / (1024.0 * 1024.0);
+    uint64_t total_ns = 0;
+    fprintf(stdout, "%s: %.2f MB, %zu tokens, %zu instructions\n", file_name, mb, tokens, code_size);
+    fprintf(stdout, "  %-10s %10s %10s %10s %10s\n", "phase", "ms", "MB/s", "allocs", "alloc KB");
+    for (int i = 0; i < BENCH_PHASE_COUNT; i++) {
+        bench_phase_result_t* phase = &phases[i];
+        total_ns += phase->best_ns;
+        fprintf(stdout, "  %-10s %10.3f %10.1f", bench_phase_names[i], phase->best_ns / 1e6, phase->best_ns ? mb / (phase->best_ns / 1e9) : 0.0);
+#ifdef TASM_BENCH_WRAP_MALLOC
+        fprintf(stdout, " %10llu %10llu\n", (unsigned long long)phase->allocs, (unsigned long long)(phase->alloc_bytes / 1024));
+#else
+        fprintf(stdout, " %10s %10s\n", "-", "-");
+#endif
+    }
+    // lex is left out of the total, parse does it again
+    total_ns -= phases[BENCH_PHASE_LEX].best_ns;
+    fprintf(stdout, "  %-10s %10.3f %10.1f\n", "total", total_ns / 1e6, total_ns ? mb / (total_ns / 1e9) : 0.0);
+}
+
+int main(int argc, char **argv) {
+    cli_tasm_bench_args_t args = {0};
+    if (!cli_tasm_bench_parse_command_line(&args, &argc, &argv))
+        return EXIT_FAILURE;
+
+    bool all_ok = true;
+    for (size_t f = 0; f < args.file_count; f++) {
+        const char* file_name = args.file_names[f];
+        size_t source_size;
+        char* source = bench_read_source(file_name, &source_size);
+        if (source == NULL) {
+            all_ok = false;
+            continue;
+        }
+
+        bench_phase_result_t phases[BENCH_PHASE_COUNT];
+        for (int i = 0; i < BENCH_PHASE_COUNT; i++)
+            phases[i] = (bench_phase_result_t) { .best_ns = UINT64_MAX };
+        size_t tokens = 0, code_size = 0;
+        bool ok = true;
+        for (int r = 0; r < args.repeat && ok; r++)
+            ok = bench_assemble(file_name, source, args.output_name, phases, r == 0, &tokens, &code_size);
+        free(source);
+
+        if (!ok) {
+            fprintf(stderr, CLR_RED"%s does not assemble"CLR_END"\n", file_name);
+            all_ok = false;
+            continue;
+        }
+        bench_report(file_name, source_size, tokens, code_size, phases);
+    }
+    return all_ok ? 0 : 1;
+}
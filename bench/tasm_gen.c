@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CLI_IMPLEMENTATION
+#include <common/cli.h>
+
+/*
+    tasm_gen writes a synthetic source for tasm_bench: procs full of local labels, branches,
+    calls to earlier procs, loadc/aloadc of @data entries and natives declared with @cfun.
+    The output assembles cleanly, it is not meant to run.
+*/
+
+static uint64_t gen_state;
+
+// xorshift64, the same seed gives the same file everywhere
+static uint32_t gen_next(uint32_t bound) {
+    gen_state ^= gen_state << 13;
+    gen_state ^= gen_state >> 7;
+    gen_state ^= gen_state << 17;
+    return bound ? (uint32_t)(gen_state % bound) : 0;
+}
+
+static void gen_proc(FILE* out, cli_gen_args_t* args, int proc) {
+    fprintf(out, "proc p%d\n", proc);
+    fprintf(out, "    store 0\n");
+    for (int label = 0; label < args->labels; label++) {
+        fprintf(out, "    l%d:\n", label);
+        fprintf(out, "        load 0\n");
+        fprintf(out, "        push %u\n", gen_next(1000));
+        switch (gen_next(6)) {
+        case 0:
+            fprintf(out, "        add\n        dup\n        store 1\n");
+            break;
+        case 1:
+            fprintf(out, "        push 3\n        mult\n        push 7\n        mod\n");
+            break;
+        case 2:
+            if (args->data > 0)
+                fprintf(out, "        loadc %u\n        add\n", gen_next(args->data) & ~1u); // even entries are numbers
+            else
+                fprintf(out, "        sub\n");
+            break;
+        case 3:
+            if (args->data > 1)
+                fprintf(out, "        aloadc %u\n        pop\n", gen_next(args->data) | 1u);
+            fprintf(out, "        band\n");
+            break;
+        case 4:
+            if (proc > 0)
+                fprintf(out, "        call p%u\n", gen_next(proc));
+            else
+                fprintf(out, "        pop\n");
+            break;
+        default:
+            if (args->cfuns > 0)
+                fprintf(out, "        native %u\n", gen_next(args->cfuns));
+            else
+                fprintf(out, "        bor\n");
+            break;
+        }
+        fprintf(out, "        store 0\n");
+        fprintf(out, "        load 0\n");
+        fprintf(out, "        push %u\n", gen_next(100));
+        fprintf(out, "        lt\n");
+        fprintf(out, "        jnz l%u\n", gen_next(args->labels));
+    }
+    fprintf(out, "    load 0\n");
+    fprintf(out, "    ret\n");
+    fprintf(out, "endp\n\n");
+}
+
+int main(int argc, char **argv) {
+    cli_gen_args_t args = {0};
+    if (!cli_gen_parse_command_line(&args, &argc, &argv))
+        return EXIT_FAILURE;
+
+    FILE* out = args.output_name ? fopen(args.output_name, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", args.output_name);
+        return EXIT_FAILURE;
+    }
+    gen_state = args.seed ? args.seed : 0x9e3779b97f4a7c15ull;
+
+    for (int i = 0; i < args.cfuns; i++)
+        fprintf(out, "@cfun i32 gen_native%d i32 i32\n", i);
+    fprintf(out, "jmp main\n\n");
+
+    for (int i = 0; i < args.procs; i++)
+        gen_proc(out, &args, i);
+
+    fprintf(out, "main:\n");
+    fprintf(out, "    push 1\n");
+    fprintf(out, "    call p%d\n", args.procs - 1);
+    fprintf(out, "    pop\n");
+    fprintf(out, "    hlt\n\n");
+
+    // numbers on even entries and strings on odd ones, all distinct so none are merged
+    for (int i = 0; i < args.data; i++) {
+        if (i % 2 == 0)
+            fprintf(out, "@data %d\n", i * 7919);
+        else
+            fprintf(out, "@data \"generated string %d of the stress corpus\"\n", i);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
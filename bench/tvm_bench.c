@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <tvm/tvm.h>
+#include <tvm/tci.h>
+#include <common/cmd_colors.h>
+
+#include <common/ttime.h>
+#define CLI_IMPLEMENTATION
+#include <common/cli.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/*
+    tvm_bench runs every workload once to warm up, then repeat more times on the same vm,
+    resetting it in between, and reports the fastest run, the one least disturbed by the rest
+    of the machine. ns/instr is the number compared against the baseline, it stays put when a
+    workload is made longer or shorter.
+*/
+
+#define BENCH_NAME_CAPACITY 64
+
+typedef struct {
+    char name[BENCH_NAME_CAPACITY];
+    uint64_t icount;
+    uint64_t best_ns;
+    size_t alloc_count;
+    size_t alloc_bytes;
+    long peak_rss_kb;
+    double ns_per_instr;
+    bool ok;
+} bench_result_t;
+
+typedef struct {
+    char name[BENCH_NAME_CAPACITY];
+    double ns_per_instr;
+} bench_baseline_t;
+
+// high water mark of the whole process, so it only grows from one workload to the next
+static long bench_peak_rss_kb() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// file name without directories and the .bin extension
+static void bench_name(const char* path, char* name) {
+    const char* base = path;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/' || *c == '\\')
+            base = c + 1;
+    }
+    snprintf(name, BENCH_NAME_CAPACITY, "%s", base);
+    char* dot = strrchr(name, '.');
+    if (dot != NULL && strcmp(dot, ".bin") == 0)
+        *dot = '\0';
+}
+
+static bool bench_run(const char* file_name, int repeat, bench_result_t* result) {
+    bench_name(file_name, result->name);
+    tci_t tci = tci_init();
+    tvm_t* vm = malloc(sizeof(tvm_t));
+    *vm = tvm_init();
+    if (!tvm_load_program_from_file(vm, file_name)) {
+        tvm_destroy(vm);
+        free(vm);
+        tci_destroy(&tci);
+        return false;
+    }
+    if (vm->program.metadata.module_count > 0) {
+        //FIXME: support for multiple modules
+        if (!tci_load_module(&tci, vm->program.metadata.modules[0].module_name)) {
+            tvm_destroy(vm);
+            free(vm);
+            tci_destroy(&tci);
+            return false;
+        }
+        tci_metaprogram_to_ffi(&tci, vm);
+        vm->tci = &tci;
+    }
+
+    result->ok = true;
+    result->best_ns = UINT64_MAX;
+    for (int i = -1; i < repeat && result->ok; i++) {
+        tvm_reset(vm);
+        uint64_t start = ttime_now_ns();
+        exception_t except = tvm_run(vm);
+        uint64_t elapsed = ttime_now_ns() - start;
+        if (except != EXCEPT_OK) {
+            fprintf(stderr, CLR_RED"%s failed: "CLR_END"%s at ip %u\n", result->name, exception_to_cstr(except), vm->except_ip);
+            result->ok = false;
+        }
+        if (i < 0)
+            continue; // warm up
+        if (elapsed < result->best_ns)
+            result->best_ns = elapsed;
+        result->icount = vm->icount;
+        result->alloc_count = vm->gc.alloc_count;
+        result->alloc_bytes = vm->gc.alloc_bytes;
+    }
+    if (result->ok)
+        result->ns_per_instr = result->icount ? (double)result->best_ns / (double)result->icount : 0.0;
+    result->peak_rss_kb = bench_peak_rss_kb();
+
+    tvm_destroy(vm);
+    free(vm);
+    tci_unload_all(&tci);
+    tci_destroy(&tci);
+    return result->ok;
+}
+
+// one "name ns_per_instr" pair per line, lines starting with # are comments
+static bench_baseline_t* bench_load_baseline(const char* file_name, size_t* count) {
+    FILE* file = fopen(file_name, "r");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return NULL;
+    }
+    size_t capacity = 16;
+    bench_baseline_t* baseline = malloc(sizeof(bench_baseline_t) * capacity);
+    *count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        bench_baseline_t entry;
+        if (line[0] == '#' || sscanf(line, "%63s %lf", entry.name, &entry.ns_per_instr) != 2)
+            continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            baseline = realloc(baseline, sizeof(bench_baseline_t) * capacity);
+        }
+        baseline[(*count)++] = entry;
+    }
+    fclose(file);
+    return baseline;
+}
+
+static bool bench_save_baseline(const char* file_name, bench_result_t* results, size_t count) {
+    FILE* file = fopen(file_name, "w");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return false;
+    }
+    fprintf(file, "# tvm_bench baseline, ns per instruction of the fastest run\n");
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].ok)
+            fprintf(file, "%s %.3f\n", results[i].name, results[i].ns_per_instr);
+    }
+    fclose(file);
+    return true;
+}
+
+static const bench_baseline_t* bench_find_baseline(const bench_baseline_t* baseline, size_t count, const char* name) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(baseline[i].name, name) == 0)
+            return &baseline[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    cli_bench_args_t args = {0};
+    if (!cli_bench_parse_command_line(&args, &argc, &argv))
+        return EXIT_FAILURE;
+
+    bench_baseline_t* baseline = NULL;
+    size_t baseline_count = 0;
+    if (args.baseline_name != NULL) {
+        baseline = bench_load_baseline(args.baseline_name, &baseline_count);
+        if (baseline == NULL)
+            return EXIT_FAILURE;
+    }
+
+    bench_result_t* results = calloc(args.file_count, sizeof(bench_result_t));
+    bool all_ok = true;
+    size_t regressions = 0;
+
+    fprintf(stdout, "%-12s %12s %10s %11s %10s %10s %12s %10s\n",
+        "workload", "instrs", "ns/instr", "M instr/s", "allocs", "alloc KB", "peak RSS KB", "baseline");
+    for (size_t i = 0; i < args.file_count; i++) {
+        bench_result_t* result = &results[i];
+        if (!bench_run(args.file_names[i], args.repeat, result)) {
+            all_ok = false;
+            continue;
+        }
+        fprintf(stdout, "%-12s %12llu %10.3f %11.1f %10zu %10zu %12ld",
+            result->name, (unsigned long long)result->icount, result->ns_per_instr,
+            result->best_ns ? result->icount * 1e3 / result->best_ns : 0.0,
+            result->alloc_count, result->alloc_bytes / 1024, result->peak_rss_kb);
+
+        const bench_baseline_t* base = bench_find_baseline(baseline, baseline_count, result->name);
+        if (base == NULL || base->ns_per_instr <= 0.0) {
+            fprintf(stdout, " %10s\n", "-");
+            continue;
+        }
+        double change = (result->ns_per_instr / base->ns_per_instr - 1.0) * 100.0;
+        if (change > args.tolerance) {
+            fprintf(stdout, " "CLR_RED"%+9.1f%%"CLR_END"\n", change);
+            regressions++;
+        } else {
+            fprintf(stdout, " %+9.1f%%\n", change);
+        }
+    }
+
+    if (regressions > 0)
+        fprintf(stderr, CLR_RED"%zu workloads regressed "CLR_END"more than %d%% against %s\n", regressions, args.tolerance, args.baseline_name);
+    if (args.save_name != NULL && !bench_save_baseline(args.save_name, results, args.file_count))
+        all_ok = false;
+
+    free(results);
+    free(baseline);
+    return all_ok && regressions == 0 ? 0 : 1;
+}
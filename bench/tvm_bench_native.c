@@ -0,0 +1,32 @@
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// called from bench/workloads/native.tasm, cheap on purpose so the call path is what gets measured
+int32_t tvm_bench_add(int32_t a, int32_t b) {
+    return a + b;
+}
+
+// "@cfun async" in tests/native_async.tasm, slow on purpose so the calling fiber stays parked for a while
+int32_t tvm_bench_sleep_inc(int32_t ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+    return ms + 1;
+}
+
+// tests/native_wide.tasm, wide arguments come from two slots and wide returns go back as two
+int64_t tvm_bench_neg64(int64_t a) {
+    return -a;
+}
+
+double tvm_bench_half(double x) {
+    return x / 2;
+}
@@ -11,25 +11,62 @@ typedef signed   char   int8_t;
 typedef signed   short  int16_t;
 typedef signed   int    int32_t;
 typedef signed   long   int64_t;
+#include <stddef.h>
+// unsigned long is 32 bits on LLP64 targets, size_t is as wide as a pointer everywhere we build
+typedef size_t          uintptr_t;
 
 #else
 #include <stdint.h>
 #include <stddef.h>
 #endif//ARENA_NO_STDINT
 
+// every pointer returned by arena_alloc is aligned to this (must be a power of two)
+#ifndef ARENA_DEFAULT_ALIGNMENT
+#define ARENA_DEFAULT_ALIGNMENT (2 * sizeof(void*))
+#endif
+// a new chunk is ARENA_GROWTH_FACTOR times bigger than the previous one...
+#ifndef ARENA_GROWTH_FACTOR
+#define ARENA_GROWTH_FACTOR 2
+#endif
+// ...until it hits this size, bigger requests still get a chunk of their own
+#ifndef ARENA_MAX_CHUNK_SIZE
+#define ARENA_MAX_CHUNK_SIZE (64 * 1024 * 1024)
+#endif
+
 typedef struct arena_struct {
     size_t size;
     size_t capacity;
     uint8_t* memory;
     struct arena_struct* prev;
     struct arena_struct* next;
+    size_t last;        // offset of the most recent allocation (for in-place realloc)
+    size_t alloc_count; // number of allocations served by this chunk
 } arena_t;
 
+// position in an arena, see arena_save and arena_restore
+typedef struct {
+    arena_t* chunk;
+    size_t size;
+    size_t last;
+    size_t alloc_count;
+} arena_mark_t;
+
+typedef struct {
+    size_t chunk_count;
+    size_t capacity;    // bytes reserved by all chunks
+    size_t used;        // bytes handed out, including alignment padding
+    size_t alloc_count;
+} arena_stats_t;
+
 arena_t* arena_init(size_t size);
 void* arena_alloc(arena_t** arena, size_t size);
-void* arena_realloc(arena_t* arena, void* ptr, size_t size);
-arena_t* arena_grow(arena_t* arena);
-void arena_reset(arena_t* arena);
+void* arena_alloc_aligned(arena_t** arena, size_t size, size_t alignment);
+void* arena_realloc(arena_t** arena, void* ptr, size_t old_size, size_t new_size);
+arena_t* arena_grow(arena_t* arena, size_t min_capacity);
+arena_mark_t arena_save(arena_t* arena);
+void arena_restore(arena_t** arena, arena_mark_t mark);
+void arena_reset(arena_t** arena);
+arena_stats_t arena_stats(arena_t* arena);
 void arena_destroy(arena_t* arena);
 
 
@@ -45,44 +82,131 @@ arena_t* arena_init(size_t size) {
         .next = NULL,
         .capacity = size,
         .size = 0,
-        .memory = (uint8_t*)malloc(size)
+        .memory = (uint8_t*)malloc(size),
+        .last = 0,
+        .alloc_count = 0,
     };
     arena_t* ptr = malloc(sizeof(arena_t));
     *ptr = arena;
     return ptr;
 }
 
+static size_t arena_align_offset(arena_t* arena, size_t alignment) {
+    uintptr_t top = (uintptr_t)arena->memory + arena->size;
+    uintptr_t aligned = (top + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+    return arena->size + (size_t)(aligned - top);
+}
+
 void* arena_alloc(arena_t** arena_ptr, size_t size) {
+    return arena_alloc_aligned(arena_ptr, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void* arena_alloc_aligned(arena_t** arena_ptr, size_t size, size_t alignment) {
     if (size == 0 || arena_ptr == NULL || *arena_ptr == NULL)
         return NULL;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
     arena_t* arena = *arena_ptr;
-    if (arena->size + size > arena->capacity) {
-        arena = arena_grow(arena);
+    size_t offset = arena_align_offset(arena, alignment);
+    if (offset + size > arena->capacity) {
+        // worst case padding is alignment - 1 bytes on the fresh chunk
+        arena = arena_grow(arena, size + alignment);
         *arena_ptr = arena;
+        offset = arena_align_offset(arena, alignment);
     }
     // Allocate memory and increment size
-    void* ptr = &arena->memory[arena->size];
-    arena->size += size;
+    void* ptr = &arena->memory[offset];
+    arena->last = offset;
+    arena->size = offset + size;
+    arena->alloc_count++;
     return ptr;
 }
 
-void* arena_realloc(arena_t* arena, void* ptr, size_t new_size) {
-    if (ptr == NULL) {
-        return arena_alloc(&arena, new_size);
+void* arena_realloc(arena_t** arena_ptr, void* ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL)
+        return arena_alloc(arena_ptr, new_size);
+    if (arena_ptr == NULL || *arena_ptr == NULL)
+        return NULL;
+    arena_t* arena = *arena_ptr;
+    // the last allocation of the current chunk can be resized in place
+    if ((uint8_t*)ptr == &arena->memory[arena->last]
+    && arena->last + new_size <= arena->capacity) {
+        arena->size = arena->last + new_size;
+        return ptr;
     }
-    // TODO: not implemented yet!
-    return NULL;
+    if (new_size <= old_size)
+        return ptr;
+    void* new_ptr = arena_alloc(arena_ptr, new_size);
+    if (new_ptr)
+        memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
 }
 
-arena_t* arena_grow(arena_t* arena) {
-    arena->next = arena_init(arena->capacity);
-    arena->next->prev = arena;
-    arena = arena->next;
-    return arena;
+arena_t* arena_grow(arena_t* arena, size_t min_capacity) {
+    // chunks released by arena_restore are kept around and reused first
+    if (arena->next != NULL && arena->next->size == 0 && arena->next->capacity >= min_capacity)
+        return arena->next;
+
+    size_t capacity = arena->capacity;
+    if (capacity < ARENA_MAX_CHUNK_SIZE / ARENA_GROWTH_FACTOR)
+        capacity *= ARENA_GROWTH_FACTOR;
+    else
+        capacity = ARENA_MAX_CHUNK_SIZE;
+    if (capacity < min_capacity)
+        capacity = min_capacity;
+
+    // splice the new chunk in, chunks after this one (if any) stay reachable for arena_destroy
+    arena_t* chunk = arena_init(capacity);
+    chunk->prev = arena;
+    chunk->next = arena->next;
+    if (arena->next)
+        arena->next->prev = chunk;
+    arena->next = chunk;
+    return chunk;
 }
 
-void arena_reset(arena_t* arena) {
-    arena->size = 0;
+arena_mark_t arena_save(arena_t* arena) {
+    return (arena_mark_t) {
+        .chunk = arena,
+        .size = arena->size,
+        .last = arena->last,
+        .alloc_count = arena->alloc_count,
+    };
+}
+
+void arena_restore(arena_t** arena_ptr, arena_mark_t mark) {
+    // chunks grown after the mark was taken are emptied but not freed
+    for (arena_t* chunk = mark.chunk->next; chunk != NULL; chunk = chunk->next) {
+        chunk->size = 0;
+        chunk->last = 0;
+        chunk->alloc_count = 0;
+    }
+    mark.chunk->size = mark.size;
+    mark.chunk->last = mark.last;
+    mark.chunk->alloc_count = mark.alloc_count;
+    *arena_ptr = mark.chunk;
+}
+
+void arena_reset(arena_t** arena_ptr) {
+    arena_t* head = *arena_ptr;
+    while (head->prev != NULL) {
+        head = head->prev;
+    }
+    arena_restore(arena_ptr, (arena_mark_t){ .chunk = head, .size = 0, .last = 0, .alloc_count = 0 });
+}
+
+arena_stats_t arena_stats(arena_t* arena) {
+    arena_stats_t stats = {0};
+    while (arena->prev != NULL) {
+        arena = arena->prev;
+    }
+    for (; arena != NULL; arena = arena->next) {
+        stats.chunk_count++;
+        stats.capacity += arena->capacity;
+        stats.used += arena->size;
+        stats.alloc_count += arena->alloc_count;
+    }
+    return stats;
 }
 
 void arena_destroy(arena_t* arena) {
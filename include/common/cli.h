@@ -2,7 +2,10 @@
 #define CLI_H
 
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <common/cmd_colors.h>
 
@@ -17,10 +20,68 @@ typedef struct {
 
     bool ast_show;
     bool compile; // that will run tasmc (tasm to nasm)
+    bool strip;   // tasm -s, no debug section
+    const char* profile_name; // tvm -p, folded stacks are written here
+    int profile_hz;           // tvm -hz
+    bool stats;               // tvm --stats, counters go to stderr as text
+    const char* stats_json_name; // tvm --stats-json, counters are written here as json
+    const char* trace_name;   // tvm -t, the binary trace is written here
+    bool native_stats;        // tvm --native-stats, per native latencies go to stderr at exit or on SIGUSR1
+    bool gc_stats;            // tvm --gc-stats, heap counters go to stderr at exit
+    int gc_stats_interval;    // tvm --gc-stats-interval, ms between two dumps while running
+    const char* snapshot_name; // tvm --snapshot, the vm is saved here on its first ckpt
+    bool restore;             // tvm --restore, the input is a snapshot instead of a program
 } cli_parsed_args_t;
 
+#define MAX_BATCH_FILE_COUNT 256
+
+typedef struct {
+    const char* file_names[MAX_BATCH_FILE_COUNT];
+    size_t file_count;
+    const char* input_name; // one input set per line
+    int workers;            // 0 means one per cpu
+    int repeat;
+    bool quiet;             // do not print failed jobs
+} cli_tbatch_args_t;
+
+typedef struct {
+    const char* file_names[MAX_BATCH_FILE_COUNT];
+    size_t file_count;
+    const char* baseline_name; // compare against it
+    const char* save_name;     // write the results as a new baseline
+    int repeat;                // runs per workload, the fastest is reported
+    int tolerance;             // percent ns/instr may grow over the baseline
+} cli_bench_args_t;
+
+typedef struct {
+    const char* file_names[MAX_BATCH_FILE_COUNT];
+    size_t file_count;
+    const char* output_name; // where the write phase puts the image
+    int repeat;              // runs per source, the fastest of every phase is reported
+} cli_tasm_bench_args_t;
+
+typedef struct {
+    const char* output_name; // stdout when NULL
+    int procs;
+    int labels; // per proc
+    int cfuns;
+    int data;   // @data entries
+    uint64_t seed;
+} cli_gen_args_t;
+
+typedef struct {
+    const char* file_name;    // the trace
+    const char* program_name; // ttrace -b, names addresses with its debug info
+    bool summary;             // ttrace -s, counts instead of one line per event
+} cli_ttrace_args_t;
+
 bool cli_tasm_parse_command_line(cli_parsed_args_t* args, int* argc, char*** argv);
 bool cli_tvm_parse_command_line(cli_parsed_args_t* args, int* argc, char*** argv);
+bool cli_tbatch_parse_command_line(cli_tbatch_args_t* args, int* argc, char*** argv);
+bool cli_bench_parse_command_line(cli_bench_args_t* args, int* argc, char*** argv);
+bool cli_tasm_bench_parse_command_line(cli_tasm_bench_args_t* args, int* argc, char*** argv);
+bool cli_gen_parse_command_line(cli_gen_args_t* args, int* argc, char*** argv);
+bool cli_ttrace_parse_command_line(cli_ttrace_args_t* args, int* argc, char*** argv);
 
 #ifdef CLI_IMPLEMENTATION
 
@@ -51,7 +112,43 @@ bool cli_tasm_usage(int argc) {
 bool cli_tvm_usage(int argc) {
     if (argc < 2) {
         fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" can not found input file.\n");
-        fprintf(stdout, "    tvm <input.bin>\n");
+        fprintf(stdout, "    tvm [-p profile.folded] [-hz samples_per_second] [--stats] [--stats-json stats.json] [-t trace.bin] [--native-stats] [--gc-stats] [--gc-stats-interval ms] [--snapshot snap.bin] [--restore] <input.bin>\n");
+        return false;
+    }
+    return true;
+}
+
+bool cli_tbatch_usage(int argc) {
+    if (argc < 2) {
+        fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" can not found input file.\n");
+        fprintf(stdout, "    tbatch [-j workers] [-i inputs.txt] [-r repeat] [-q] <input.bin>...\n");
+        return false;
+    }
+    return true;
+}
+
+bool cli_bench_usage(int argc) {
+    if (argc < 2) {
+        fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" can not found input file.\n");
+        fprintf(stdout, "    tvm_bench [-r repeat] [-b baseline.txt] [-w baseline.txt] [-t tolerance_percent] <workload.bin>...\n");
+        return false;
+    }
+    return true;
+}
+
+bool cli_tasm_bench_usage(int argc) {
+    if (argc < 2) {
+        fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" can not found input file.\n");
+        fprintf(stdout, "    tasm_bench [-r repeat] [-o out.bin] <file.tasm>...\n");
+        return false;
+    }
+    return true;
+}
+
+bool cli_ttrace_usage(int argc) {
+    if (argc < 2) {
+        fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" can not found input file.\n");
+        fprintf(stdout, "    ttrace [-s] [-b program.bin] <trace.bin>\n");
         return false;
     }
     return true;
@@ -79,6 +176,8 @@ bool cli_tasm_parse_command_line(cli_parsed_args_t* args, int* argc, char*** arg
             args->clib_names[args->clib_count++] = cli_shift(argc, argv);
         else if (compare(arg, "-ast"))
             args->ast_show = true;
+        else if (compare(arg, "-s"))
+            args->strip = true;
         else
             args->file_name = arg;
     }
@@ -99,7 +198,28 @@ bool cli_tvm_parse_command_line(cli_parsed_args_t* args, int* argc, char*** argv
     cli_shift(argc, argv); // ./tvm
     while (*argc > 0) {
         char* arg = cli_shift(argc, argv);
-        args->file_name = arg;
+        if (compare(arg, "-p"))
+            args->profile_name = cli_shift(argc, argv);
+        else if (compare(arg, "-hz"))
+            args->profile_hz = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "--stats"))
+            args->stats = true;
+        else if (compare(arg, "--stats-json"))
+            args->stats_json_name = cli_shift(argc, argv);
+        else if (compare(arg, "-t"))
+            args->trace_name = cli_shift(argc, argv);
+        else if (compare(arg, "--native-stats"))
+            args->native_stats = true;
+        else if (compare(arg, "--gc-stats"))
+            args->gc_stats = true;
+        else if (compare(arg, "--gc-stats-interval"))
+            args->gc_stats_interval = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "--snapshot"))
+            args->snapshot_name = cli_shift(argc, argv);
+        else if (compare(arg, "--restore"))
+            args->restore = true;
+        else
+            args->file_name = arg;
     }
     
     if (!(args->file_name))
@@ -107,6 +227,156 @@ bool cli_tvm_parse_command_line(cli_parsed_args_t* args, int* argc, char*** argv
     return true;
 }
 
+bool cli_tbatch_parse_command_line(cli_tbatch_args_t* args, int* argc, char*** argv) {
+    if (!cli_tbatch_usage(*argc))
+        return false;
+
+    cli_shift(argc, argv); // ./tbatch
+    while (*argc > 0) {
+        char* arg = cli_shift(argc, argv);
+        if (compare(arg, "-j"))
+            args->workers = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-i"))
+            args->input_name = cli_shift(argc, argv);
+        else if (compare(arg, "-r"))
+            args->repeat = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-q"))
+            args->quiet = true;
+        else if (args->file_count < MAX_BATCH_FILE_COUNT)
+            args->file_names[args->file_count++] = arg;
+        else {
+            fprintf(stderr, CLR_RED"Error: "CLR_END"more than %d input files\n", MAX_BATCH_FILE_COUNT);
+            return false;
+        }
+    }
+
+    if (args->file_count == 0)
+        return false;
+    if (args->repeat < 1)
+        args->repeat = 1;
+    return true;
+}
+
+bool cli_bench_parse_command_line(cli_bench_args_t* args, int* argc, char*** argv) {
+    if (!cli_bench_usage(*argc))
+        return false;
+
+    cli_shift(argc, argv); // ./tvm_bench
+    while (*argc > 0) {
+        char* arg = cli_shift(argc, argv);
+        if (compare(arg, "-r"))
+            args->repeat = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-b"))
+            args->baseline_name = cli_shift(argc, argv);
+        else if (compare(arg, "-w"))
+            args->save_name = cli_shift(argc, argv);
+        else if (compare(arg, "-t"))
+            args->tolerance = atoi(cli_shift(argc, argv));
+        else if (args->file_count < MAX_BATCH_FILE_COUNT)
+            args->file_names[args->file_count++] = arg;
+        else {
+            fprintf(stderr, CLR_RED"Error: "CLR_END"more than %d workloads\n", MAX_BATCH_FILE_COUNT);
+            return false;
+        }
+    }
+
+    if (args->file_count == 0)
+        return false;
+    if (args->repeat < 1)
+        args->repeat = 5;
+    if (args->tolerance <= 0)
+        args->tolerance = 10;
+    return true;
+}
+
+bool cli_tasm_bench_parse_command_line(cli_tasm_bench_args_t* args, int* argc, char*** argv) {
+    if (!cli_tasm_bench_usage(*argc))
+        return false;
+
+    cli_shift(argc, argv); // ./tasm_bench
+    while (*argc > 0) {
+        char* arg = cli_shift(argc, argv);
+        if (compare(arg, "-r"))
+            args->repeat = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-o"))
+            args->output_name = cli_shift(argc, argv);
+        else if (args->file_count < MAX_BATCH_FILE_COUNT)
+            args->file_names[args->file_count++] = arg;
+        else {
+            fprintf(stderr, CLR_RED"Error: "CLR_END"more than %d sources\n", MAX_BATCH_FILE_COUNT);
+            return false;
+        }
+    }
+
+    if (args->file_count == 0)
+        return false;
+    if (args->repeat < 1)
+        args->repeat = 5;
+    if (args->output_name == NULL)
+        args->output_name = "tasm_bench.bin";
+    return true;
+}
+
+// every flag is optional, the defaults give a source of a few MB
+bool cli_gen_parse_command_line(cli_gen_args_t* args, int* argc, char*** argv) {
+    args->procs = 2000;
+    args->labels = 8;
+    args->cfuns = 64;
+    args->data = 1000;
+
+    cli_shift(argc, argv); // ./tasm_gen
+    while (*argc > 0) {
+        char* arg = cli_shift(argc, argv);
+        if (compare(arg, "-o"))
+            args->output_name = cli_shift(argc, argv);
+        else if (compare(arg, "-p"))
+            args->procs = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-l"))
+            args->labels = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-f"))
+            args->cfuns = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-d"))
+            args->data = atoi(cli_shift(argc, argv));
+        else if (compare(arg, "-s"))
+            args->seed = strtoull(cli_shift(argc, argv), NULL, 0);
+        else {
+            fprintf(stdout, CLR_RED"Invalid usage!"CLR_END" unknown option %s\n", arg);
+            fprintf(stdout, "    tasm_gen [-o out.tasm] [-p procs] [-l labels_per_proc] [-f cfuns] [-d data] [-s seed]\n");
+            return false;
+        }
+    }
+
+    if (args->procs < 1)
+        args->procs = 1;
+    if (args->labels < 1)
+        args->labels = 1;
+    if (args->cfuns < 0)
+        args->cfuns = 0;
+    if (args->data < 0)
+        args->data = 0;
+    return true;
+}
+
+bool cli_ttrace_parse_command_line(cli_ttrace_args_t* args, int* argc, char*** argv) {
+    if (!cli_ttrace_usage(*argc))
+        return false;
+
+    cli_shift(argc, argv); // ./ttrace
+    while (*argc > 0) {
+        char* arg = cli_shift(argc, argv);
+        if (compare(arg, "-s"))
+            args->summary = true;
+        else if (compare(arg, "-b"))
+            args->program_name = cli_shift(argc, argv);
+        else
+            args->file_name = arg;
+    }
+
+    if (!(args->file_name))
+        return false;
+    return true;
+}
+
 #endif//CLI_IMPLEMENTATION
 
 #endif//CLI_H
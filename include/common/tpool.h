@@ -0,0 +1,156 @@
+#ifndef TPOOL_H_
+#define TPOOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef TPOOL_IMPLEMENTATION
+#define TTHREAD_IMPLEMENTATION
+#endif
+#include <common/tthread.h>
+
+// jobs are owned by the caller and must stay alive until they are done
+typedef struct tpool_job {
+    tthread_fn_t fn;
+    void* arg;
+    bool done;
+    struct tpool_job* next;
+} tpool_job_t;
+
+typedef struct tpool {
+    tthread_t* threads;
+    int thread_count;
+    tthread_mutex_t mutex;
+    tthread_cond_t work; // signalled on submit and shutdown
+    tthread_cond_t done; // broadcast whenever a job finishes
+    tpool_job_t* head;
+    tpool_job_t* tail;
+    uint64_t completed;
+    bool stopping;
+} tpool_t;
+
+bool tpool_init(tpool_t* pool, int thread_count);
+// queued jobs still run, then the workers are joined
+void tpool_destroy(tpool_t* pool);
+
+void tpool_submit(tpool_t* pool, tpool_job_t* job);
+bool tpool_job_done(tpool_t* pool, tpool_job_t* job);
+void tpool_wait(tpool_t* pool, tpool_job_t* job);
+
+// number of finished jobs, pair it with tpool_wait_completed to sleep until any job finishes
+uint64_t tpool_completed(tpool_t* pool);
+void tpool_wait_completed(tpool_t* pool, uint64_t seen);
+
+#ifdef TPOOL_IMPLEMENTATION
+#undef TPOOL_IMPLEMENTATION
+
+#include <stdlib.h>
+
+static void tpool_worker(void* arg) {
+    tpool_t* pool = (tpool_t*)arg;
+    tthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->head == NULL && !pool->stopping)
+            tthread_cond_wait(&pool->work, &pool->mutex);
+        if (pool->head == NULL)
+            break;
+        tpool_job_t* job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL)
+            pool->tail = NULL;
+
+        tthread_mutex_unlock(&pool->mutex);
+        job->fn(job->arg);
+        tthread_mutex_lock(&pool->mutex);
+
+        job->done = true;
+        pool->completed++;
+        tthread_cond_broadcast(&pool->done);
+    }
+    tthread_mutex_unlock(&pool->mutex);
+}
+
+bool tpool_init(tpool_t* pool, int thread_count) {
+    *pool = (tpool_t) {
+        .threads = malloc(sizeof(tthread_t) * (thread_count > 0 ? thread_count : 1)),
+        .thread_count = 0,
+        .head = NULL,
+        .tail = NULL,
+        .completed = 0,
+        .stopping = false,
+    };
+    tthread_mutex_init(&pool->mutex);
+    tthread_cond_init(&pool->work);
+    tthread_cond_init(&pool->done);
+    for (int i = 0; i < thread_count; i++) {
+        if (!tthread_create(&pool->threads[pool->thread_count], tpool_worker, pool))
+            break;
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        tpool_destroy(pool);
+        return false;
+    }
+    return true;
+}
+
+void tpool_destroy(tpool_t* pool) {
+    tthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    tthread_cond_broadcast(&pool->work);
+    tthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->thread_count; i++) {
+        tthread_join(pool->threads[i]);
+    }
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+    tthread_cond_destroy(&pool->done);
+    tthread_cond_destroy(&pool->work);
+    tthread_mutex_destroy(&pool->mutex);
+}
+
+void tpool_submit(tpool_t* pool, tpool_job_t* job) {
+    job->done = false;
+    job->next = NULL;
+    tthread_mutex_lock(&pool->mutex);
+    if (pool->tail)
+        pool->tail->next = job;
+    else
+        pool->head = job;
+    pool->tail = job;
+    tthread_cond_signal(&pool->work);
+    tthread_mutex_unlock(&pool->mutex);
+}
+
+bool tpool_job_done(tpool_t* pool, tpool_job_t* job) {
+    tthread_mutex_lock(&pool->mutex);
+    bool done = job->done;
+    tthread_mutex_unlock(&pool->mutex);
+    return done;
+}
+
+void tpool_wait(tpool_t* pool, tpool_job_t* job) {
+    tthread_mutex_lock(&pool->mutex);
+    while (!job->done)
+        tthread_cond_wait(&pool->done, &pool->mutex);
+    tthread_mutex_unlock(&pool->mutex);
+}
+
+uint64_t tpool_completed(tpool_t* pool) {
+    tthread_mutex_lock(&pool->mutex);
+    uint64_t completed = pool->completed;
+    tthread_mutex_unlock(&pool->mutex);
+    return completed;
+}
+
+void tpool_wait_completed(tpool_t* pool, uint64_t seen) {
+    tthread_mutex_lock(&pool->mutex);
+    while (pool->completed == seen)
+        tthread_cond_wait(&pool->done, &pool->mutex);
+    tthread_mutex_unlock(&pool->mutex);
+}
+
+#endif//TPOOL_IMPLEMENTATION
+
+#endif//TPOOL_H_
@@ -0,0 +1,199 @@
+#ifndef TTHREAD_H_
+#define TTHREAD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE tthread_t;
+typedef CRITICAL_SECTION tthread_mutex_t;
+typedef CONDITION_VARIABLE tthread_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t tthread_t;
+typedef pthread_mutex_t tthread_mutex_t;
+typedef pthread_cond_t tthread_cond_t;
+#endif
+
+typedef void (*tthread_fn_t)(void* arg);
+
+bool tthread_create(tthread_t* thread, tthread_fn_t fn, void* arg);
+void tthread_join(tthread_t thread);
+
+void tthread_mutex_init(tthread_mutex_t* mutex);
+void tthread_mutex_lock(tthread_mutex_t* mutex);
+void tthread_mutex_unlock(tthread_mutex_t* mutex);
+void tthread_mutex_destroy(tthread_mutex_t* mutex);
+
+void tthread_cond_init(tthread_cond_t* cond);
+void tthread_cond_wait(tthread_cond_t* cond, tthread_mutex_t* mutex);
+void tthread_cond_signal(tthread_cond_t* cond);
+void tthread_cond_broadcast(tthread_cond_t* cond);
+void tthread_cond_destroy(tthread_cond_t* cond);
+
+// number of online cpus, at least 1
+int tthread_cpu_count();
+void tthread_sleep_ms(int ms);
+
+// a word shared by one writer and one reader, the release store publishes everything written before it
+static inline size_t tthread_load_acquire(const volatile size_t* ptr) {
+#ifdef _MSC_VER
+    size_t value = *ptr; // volatile accesses already order like acquire/release under msvc
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void tthread_store_release(volatile size_t* ptr, size_t value) {
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *ptr = value;
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+// counters bumped from several threads, no ordering with anything else
+static inline void tthread_add_relaxed(volatile uint64_t* ptr, uint64_t value) {
+#ifdef _MSC_VER
+    InterlockedExchangeAdd64((volatile LONG64*)ptr, (LONG64)value);
+#else
+    __atomic_fetch_add(ptr, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void tthread_max_relaxed(volatile uint64_t* ptr, uint64_t value) {
+#ifdef _MSC_VER
+    LONG64 seen = *(volatile LONG64*)ptr;
+    while ((uint64_t)seen < value) {
+        LONG64 prev = InterlockedCompareExchange64((volatile LONG64*)ptr, (LONG64)value, seen);
+        if (prev == seen)
+            break;
+        seen = prev;
+    }
+#else
+    uint64_t seen = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+    while (seen < value && !__atomic_compare_exchange_n(ptr, &seen, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#endif
+}
+
+static inline uint64_t tthread_load_relaxed(const volatile uint64_t* ptr) {
+#ifdef _MSC_VER
+    return (uint64_t)InterlockedOr64((volatile LONG64*)ptr, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+#endif
+}
+
+#ifdef TTHREAD_IMPLEMENTATION
+#undef TTHREAD_IMPLEMENTATION
+
+#include <stdlib.h>
+
+// both thread apis want a different signature, so fn and arg travel in a small heap block
+typedef struct {
+    tthread_fn_t fn;
+    void* arg;
+} tthread_start_t;
+
+#ifdef _WIN32
+
+static DWORD WINAPI tthread_trampoline(LPVOID param) {
+    tthread_start_t start = *(tthread_start_t*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+bool tthread_create(tthread_t* thread, tthread_fn_t fn, void* arg) {
+    tthread_start_t* start = malloc(sizeof(tthread_start_t));
+    *start = (tthread_start_t){ .fn = fn, .arg = arg };
+    *thread = CreateThread(NULL, 0, tthread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void tthread_join(tthread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void tthread_mutex_init(tthread_mutex_t* mutex) { InitializeCriticalSection(mutex); }
+void tthread_mutex_lock(tthread_mutex_t* mutex) { EnterCriticalSection(mutex); }
+void tthread_mutex_unlock(tthread_mutex_t* mutex) { LeaveCriticalSection(mutex); }
+void tthread_mutex_destroy(tthread_mutex_t* mutex) { DeleteCriticalSection(mutex); }
+
+void tthread_cond_init(tthread_cond_t* cond) { InitializeConditionVariable(cond); }
+void tthread_cond_wait(tthread_cond_t* cond, tthread_mutex_t* mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void tthread_cond_signal(tthread_cond_t* cond) { WakeConditionVariable(cond); }
+void tthread_cond_broadcast(tthread_cond_t* cond) { WakeAllConditionVariable(cond); }
+void tthread_cond_destroy(tthread_cond_t* cond) { (void)cond; }
+
+int tthread_cpu_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void tthread_sleep_ms(int ms) {
+    Sleep(ms);
+}
+
+#else
+#include <unistd.h>
+#include <time.h>
+
+static void* tthread_trampoline(void* param) {
+    tthread_start_t start = *(tthread_start_t*)param;
+    free(param);
+    start.fn(start.arg);
+    return NULL;
+}
+
+bool tthread_create(tthread_t* thread, tthread_fn_t fn, void* arg) {
+    tthread_start_t* start = malloc(sizeof(tthread_start_t));
+    *start = (tthread_start_t){ .fn = fn, .arg = arg };
+    if (pthread_create(thread, NULL, tthread_trampoline, start) != 0) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void tthread_join(tthread_t thread) {
+    pthread_join(thread, NULL);
+}
+
+void tthread_mutex_init(tthread_mutex_t* mutex) { pthread_mutex_init(mutex, NULL); }
+void tthread_mutex_lock(tthread_mutex_t* mutex) { pthread_mutex_lock(mutex); }
+void tthread_mutex_unlock(tthread_mutex_t* mutex) { pthread_mutex_unlock(mutex); }
+void tthread_mutex_destroy(tthread_mutex_t* mutex) { pthread_mutex_destroy(mutex); }
+
+void tthread_cond_init(tthread_cond_t* cond) { pthread_cond_init(cond, NULL); }
+void tthread_cond_wait(tthread_cond_t* cond, tthread_mutex_t* mutex) { pthread_cond_wait(cond, mutex); }
+void tthread_cond_signal(tthread_cond_t* cond) { pthread_cond_signal(cond); }
+void tthread_cond_broadcast(tthread_cond_t* cond) { pthread_cond_broadcast(cond); }
+void tthread_cond_destroy(tthread_cond_t* cond) { pthread_cond_destroy(cond); }
+
+int tthread_cpu_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+void tthread_sleep_ms(int ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+#endif
+
+#endif//TTHREAD_IMPLEMENTATION
+
+#endif//TTHREAD_H_
@@ -0,0 +1,33 @@
+#ifndef TTIME_H_
+#define TTIME_H_
+
+#include <stdint.h>
+
+// monotonic clock in nanoseconds, only meaningful as a difference
+uint64_t ttime_now_ns();
+
+#ifdef TTIME_IMPLEMENTATION
+#undef TTIME_IMPLEMENTATION
+
+#ifdef _WIN32
+#include <windows.h>
+
+uint64_t ttime_now_ns() {
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+#else
+#include <time.h>
+
+uint64_t ttime_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#endif//TTIME_IMPLEMENTATION
+
+#endif//TTIME_H_
@@ -88,6 +88,65 @@ typedef struct tasm_ast{
         AST_OP_PUTS,
         AST_OP_PUTC,
         AST_OP_NATIVE,
+        AST_OP_SPAWN,
+        AST_OP_YIELD,
+        AST_OP_JOIN,
+        AST_OP_PMAP,
+        AST_OP_PREDUCE,
+        AST_OP_VADD,
+        AST_OP_VSUB,
+        AST_OP_VMUL,
+        AST_OP_VDIV,
+        AST_OP_VDOT,
+        AST_OP_VSUM,
+        AST_OP_VMIN,
+        AST_OP_VMAX,
+        AST_OP_VFILL,
+        AST_OP_VCOPY,
+        AST_OP_MCOPY,
+        AST_OP_MFILL,
+        AST_OP_MCMP,
+        AST_OP_MFIND,
+        AST_OP_HGET,
+        AST_OP_HGETOF,
+        AST_OP_ADDL,
+        AST_OP_SUBL,
+        AST_OP_MULTL,
+        AST_OP_DIVL,
+        AST_OP_MODL,
+        AST_OP_DIVUL,
+        AST_OP_MODUL,
+        AST_OP_ADDD,
+        AST_OP_SUBD,
+        AST_OP_MULTD,
+        AST_OP_DIVD,
+        AST_OP_CMPL,
+        AST_OP_CMPUL,
+        AST_OP_CMPD,
+        AST_OP_CI2L,
+        AST_OP_CU2L,
+        AST_OP_CL2I,
+        AST_OP_CL2D,
+        AST_OP_CD2L,
+        AST_OP_CF2D,
+        AST_OP_CD2F,
+        AST_OP_JEQ,
+        AST_OP_JNE,
+        AST_OP_JLT,
+        AST_OP_JLE,
+        AST_OP_JGT,
+        AST_OP_JGE,
+        AST_OP_JLTU,
+        AST_OP_JLEU,
+        AST_OP_JGTU,
+        AST_OP_JGEU,
+        AST_OP_JEQF,
+        AST_OP_JNEF,
+        AST_OP_JLTF,
+        AST_OP_JLEF,
+        AST_OP_JGTF,
+        AST_OP_JGEF,
+        AST_OP_CKPT,
         AST_OP_HALT,
 
         AST_STRING,
@@ -134,6 +193,12 @@ typedef struct tasm_ast{
                 unsigned int u32;
                 int i32;
             } value;
+            // full precision value for typed @data constants
+            bool is_float;
+            union {
+                uint64_t u64;
+                double f64;
+            } wide;
         } number;
 
         struct ast_proc {
@@ -144,6 +209,7 @@ typedef struct tasm_ast{
 
         // tile c interface
         struct ast_cfunction {
+            bool is_async; // "@cfun async i32 name ..."
             uint8_t ret_type;
             uint8_t* arg_types;
             size_t arg_count;
@@ -156,6 +222,8 @@ typedef struct tasm_ast{
 
         struct ast_data {
             struct tasm_ast* value;
+            bool typed;    // "@data f64 3.14"
+            uint8_t ctype; // same encoding as cfunction types
         } data;
     };
 
@@ -420,6 +488,244 @@ void tasm_ast_show(tasm_ast_t* node, int indent) {
                 tasm_ast_show(node->inst.operand, indent + 1);
             }
             break;
+        case AST_OP_SPAWN:
+            printf("SPAWN %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_YIELD:
+            printf("YIELD\n");
+            break;
+        case AST_OP_JOIN:
+            printf("JOIN\n");
+            break;
+        case AST_OP_PMAP:
+            printf("PMAP %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_PREDUCE:
+            printf("PREDUCE %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VADD:
+            printf("VADD %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VSUB:
+            printf("VSUB %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VMUL:
+            printf("VMUL %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VDIV:
+            printf("VDIV %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VDOT:
+            printf("VDOT %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VSUM:
+            printf("VSUM %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VMIN:
+            printf("VMIN %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VMAX:
+            printf("VMAX %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VFILL:
+            printf("VFILL %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_VCOPY:
+            printf("VCOPY %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_MCOPY:
+            printf("MCOPY\n");
+            break;
+        case AST_OP_MFILL:
+            printf("MFILL\n");
+            break;
+        case AST_OP_MCMP:
+            printf("MCMP\n");
+            break;
+        case AST_OP_MFIND:
+            printf("MFIND\n");
+            break;
+        case AST_OP_HGET:
+            printf("HGET %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_HGETOF:
+            printf("HGETOF %s\n", node->inst.name);
+            if (node->inst.operand) {
+                tasm_ast_show(node->inst.operand, indent + 1);
+            }
+            break;
+        case AST_OP_ADDL:
+            printf("ADDL\n");
+            break;
+        case AST_OP_SUBL:
+            printf("SUBL\n");
+            break;
+        case AST_OP_MULTL:
+            printf("MULTL\n");
+            break;
+        case AST_OP_DIVL:
+            printf("DIVL\n");
+            break;
+        case AST_OP_MODL:
+            printf("MODL\n");
+            break;
+        case AST_OP_DIVUL:
+            printf("DIVUL\n");
+            break;
+        case AST_OP_MODUL:
+            printf("MODUL\n");
+            break;
+        case AST_OP_ADDD:
+            printf("ADDD\n");
+            break;
+        case AST_OP_SUBD:
+            printf("SUBD\n");
+            break;
+        case AST_OP_MULTD:
+            printf("MULTD\n");
+            break;
+        case AST_OP_DIVD:
+            printf("DIVD\n");
+            break;
+        case AST_OP_CMPL:
+            printf("CMPL\n");
+            break;
+        case AST_OP_CMPUL:
+            printf("CMPUL\n");
+            break;
+        case AST_OP_CMPD:
+            printf("CMPD\n");
+            break;
+        case AST_OP_CI2L:
+            printf("CI2L\n");
+            break;
+        case AST_OP_CU2L:
+            printf("CU2L\n");
+            break;
+        case AST_OP_CL2I:
+            printf("CL2I\n");
+            break;
+        case AST_OP_CL2D:
+            printf("CL2D\n");
+            break;
+        case AST_OP_CD2L:
+            printf("CD2L\n");
+            break;
+        case AST_OP_CF2D:
+            printf("CF2D\n");
+            break;
+        case AST_OP_CD2F:
+            printf("CD2F\n");
+            break;
+        case AST_OP_JEQ:
+            printf("JEQ\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JNE:
+            printf("JNE\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLT:
+            printf("JLT\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLE:
+            printf("JLE\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGT:
+            printf("JGT\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGE:
+            printf("JGE\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLTU:
+            printf("JLTU\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLEU:
+            printf("JLEU\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGTU:
+            printf("JGTU\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGEU:
+            printf("JGEU\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JEQF:
+            printf("JEQF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JNEF:
+            printf("JNEF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLTF:
+            printf("JLTF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JLEF:
+            printf("JLEF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGTF:
+            printf("JGTF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_JGEF:
+            printf("JGEF\n");
+            tasm_ast_show(node->inst.operand, indent + 1);
+            break;
+        case AST_OP_CKPT:
+            printf("CKPT\n");
+            break;
         case AST_OP_HALT:
             printf("HALT\n");
             break;
@@ -452,7 +758,7 @@ void tasm_ast_show(tasm_ast_t* node, int indent) {
         case AST_CSTRUCT:
             break;
         case AST_CFUNCTION:
-            printf("CFUNCTION %s: ", node->cfunction.name);
+            printf("CFUNCTION %s%s: ", node->cfunction.is_async ? "async " : "", node->cfunction.name);
             printf("%d -> (", node->cfunction.ret_type);
             for (size_t i = 0; i < node->cfunction.arg_count; i++) {
                 printf("%d, ", node->cfunction.arg_types[i]);
@@ -9,11 +9,6 @@
 
 #define TOKENS_ARENA_CAPACITY 2048
 
-typedef struct {
-    int row, col;
-    const char* file_name;
-} loc_t;
-
 typedef struct {
     size_t cursor;
     char prev_char;
@@ -121,13 +116,15 @@ void tasm_lexer_skip_line(tasm_lexer_t* lexer) {
     }
 }
 
-tasm_token_t tasm_lexer_get_next_token(tasm_lexer_t* lexer) {
+static tasm_token_t tasm_lexer_next_token(tasm_lexer_t* lexer, loc_t* loc) {
+    *loc = lexer->loc;
     if (lexer->prev_char == '"' && lexer->current_char != '"'&& lexer->current_char != '\n' && lexer->current_char != EOF && lexer->current_char != '\'')
         return tasm_lexer_collect_str(lexer);
     if (lexer->prev_char == '\'' && lexer->current_char != '\n' && lexer->current_char != EOF && lexer->current_char != '"')
         return tasm_lexer_collect_char(lexer);
     
     tasm_lexer_skip_whitespace(lexer);
+    *loc = lexer->loc;
 
     if (isalpha(lexer->current_char) || lexer->current_char == '_')
         return tasm_lexer_collect_id(lexer);
@@ -142,6 +139,13 @@ tasm_token_t tasm_lexer_get_next_token(tasm_lexer_t* lexer) {
 
 }
 
+tasm_token_t tasm_lexer_get_next_token(tasm_lexer_t* lexer) {
+    loc_t loc;
+    tasm_token_t token = tasm_lexer_next_token(lexer, &loc);
+    token.loc = loc;
+    return token;
+}
+
 tasm_token_t lexer_collect_one_chars(tasm_lexer_t *lexer) {
     switch (lexer->current_char)
     {
@@ -215,13 +219,14 @@ tasm_token_t tasm_lexer_collect_id(tasm_lexer_t *lexer) {
         return tasm_token_create(TOKEN_CFUNCTION, val);
     if (strcmp("data", val) == 0)
         return tasm_token_create(TOKEN_DATA, val);
+    if (strcmp("async", val) == 0)
+        return tasm_token_create(TOKEN_ASYNC, val);
 
     return token;
 }
 
 tasm_token_t tasm_lexer_collect_str(tasm_lexer_t *lexer) {
     size_t len = 0;
-    char temp_val[128];
     // tasm_lexer_advance(lexer);
     size_t line_end = 0;
     char c = tasm_lexer_peek(lexer);
@@ -230,6 +235,8 @@ tasm_token_t tasm_lexer_collect_str(tasm_lexer_t *lexer) {
         c = tasm_lexer_peek(lexer);
     }
     tasm_lexer_peek_reset(lexer);
+    // the string can not be longer than the rest of the line, plus the '\0'
+    char* temp_val = (char*)arena_alloc(&lexer->tokens_arena, line_end + 2);
     while (lexer->current_char != '"') {
         if (len > line_end) {
             printf("%s:%d:%d: "CLR_RED"ERROR"CLR_END" missing string quota '\"'\n",
@@ -265,10 +272,7 @@ tasm_token_t tasm_lexer_collect_str(tasm_lexer_t *lexer) {
     }
 
     temp_val[len] = '\0';
-    len++;
-    char* val = (char*)arena_alloc(&lexer->tokens_arena, len);
-    memmove(val, temp_val, len);
-    tasm_token_t token = tasm_token_create(TOKEN_STRING, val);
+    tasm_token_t token = tasm_token_create(TOKEN_STRING, temp_val);
     return token;
 }
 
@@ -360,7 +364,7 @@ tasm_token_t tasm_lexer_collect_binary_number(tasm_lexer_t *lexer) {
     return token;
 }
 
-const size_t _inst_strings_count = 63;
+const size_t _inst_strings_count = 122;
 
 const char* _inst_strings_lower[] = {
     "nop", "push", "pop",
@@ -378,6 +382,19 @@ const char* _inst_strings_lower[] = {
     "halloc", "deref", "derefb", "hset", "hsetof",
     "puts", "putc",
     "native",
+    "spawn", "yield", "join",
+    "pmap", "preduce",
+    "vadd", "vsub", "vmul", "vdiv", "vdot", "vsum", "vmin", "vmax", "vfill", "vcopy",
+    "mcopy", "mfill", "mcmp", "mfind",
+    "hget", "hgetof",
+    "addl", "subl", "multl", "divl", "modl", "divul", "modul",
+    "addd", "subd", "multd", "divd",
+    "cmpl", "cmpul", "cmpd",
+    "ci2l", "cu2l", "cl2i", "cl2d", "cd2l", "cf2d", "cd2f",
+    "jeq", "jne", "jlt", "jle", "jgt", "jge",
+    "jltu", "jleu", "jgtu", "jgeu",
+    "jeqf", "jnef", "jltf", "jlef", "jgtf", "jgef",
+    "ckpt",
     "hlt"
 };
 
@@ -397,6 +414,19 @@ const char* _inst_strings_upper[] = {
     "HALLOC", "DEREF", "DEREFB", "HSET", "HSETOF",
     "PUTS", "PUTC",
     "NATIVE",
+    "SPAWN", "YIELD", "JOIN",
+    "PMAP", "PREDUCE",
+    "VADD", "VSUB", "VMUL", "VDIV", "VDOT", "VSUM", "VMIN", "VMAX", "VFILL", "VCOPY",
+    "MCOPY", "MFILL", "MCMP", "MFIND",
+    "HGET", "HGETOF",
+    "ADDL", "SUBL", "MULTL", "DIVL", "MODL", "DIVUL", "MODUL",
+    "ADDD", "SUBD", "MULTD", "DIVD",
+    "CMPL", "CMPUL", "CMPD",
+    "CI2L", "CU2L", "CL2I", "CL2D", "CD2L", "CF2D", "CD2F",
+    "JEQ", "JNE", "JLT", "JLE", "JGT", "JGE",
+    "JLTU", "JLEU", "JGTU", "JGEU",
+    "JEQF", "JNEF", "JLTF", "JLEF", "JGTF", "JGEF",
+    "CKPT",
     "HLT"
 };
 
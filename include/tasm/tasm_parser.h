@@ -31,6 +31,12 @@
 #define COMPSITE_ERR_STORE_WRONG_OPERAND               2802
 #define COMPSITE_ERR_NATIVE_WRONG_OPERAND              2902
 #define COMPSITE_ERR_DEREFB_WRONG_OPERAND              3002
+#define COMPSITE_ERR_SPAWN_WRONG_OPERAND               3102
+#define COMPSITE_ERR_PMAP_WRONG_OPERAND                3202
+#define COMPSITE_ERR_PREDUCE_WRONG_OPERAND             3302
+#define COMPSITE_ERR_VEC_WRONG_OPERAND                 3702
+#define COMPSITE_ERR_HGET_WRONG_OPERAND                3802
+#define COMPSITE_ERR_JCC_WRONG_OPERAND                 3902
 #define COMPSITE_ERR_PROC_INSIDE_PROC                  3401
 #define COMPSITE_ERR_META_INSIDE_PROC                  3601
 #define COMPSITE_ERR_CINTERFACE_RET_TYPE_ERR           4000
@@ -78,6 +84,15 @@ tasm_ast_t* tasm_parse_number_operand(tasm_parser_t* parser);
 tasm_ast_t* tasm_parse_int_operand(tasm_parser_t* parser);
 tasm_ast_t* tasm_parse_jmp_operand(tasm_parser_t* parser);
 tasm_ast_t* tasm_parse_label_operand(tasm_parser_t* parser);
+#define TASM_CTYPE_BIT(token) (1u << ((token) - TOKEN_TCI_BEGIN - 1))
+#define TASM_HGET_CTYPES ( \
+    TASM_CTYPE_BIT(TOKEN_TCI_CUINT8) | TASM_CTYPE_BIT(TOKEN_TCI_CINT8) | \
+    TASM_CTYPE_BIT(TOKEN_TCI_CUINT16) | TASM_CTYPE_BIT(TOKEN_TCI_CINT16) | \
+    TASM_CTYPE_BIT(TOKEN_TCI_CUINT32) | TASM_CTYPE_BIT(TOKEN_TCI_CINT32) | \
+    TASM_CTYPE_BIT(TOKEN_TCI_CFLOAT32) | TASM_CTYPE_BIT(TOKEN_TCI_CUINT64) | \
+    TASM_CTYPE_BIT(TOKEN_TCI_CINT64) | TASM_CTYPE_BIT(TOKEN_TCI_CFLOAT64) | \
+    TASM_CTYPE_BIT(TOKEN_TCI_CPTR))
+tasm_ast_t* tasm_parse_ctype_operand(tasm_parser_t* parser, uint32_t allowed);
 tasm_ast_t* tasm_parse_push_operand(tasm_parser_t* parser);
 tasm_ast_t* tasm_parse_label_call(tasm_parser_t* parser);
 tasm_ast_t* tasm_parse_char_lit(tasm_parser_t* parser);
@@ -160,6 +175,24 @@ void tasm_parser_eat_err_msg(int token_type) {
     case COMPSITE_ERR_DEREFB_WRONG_OPERAND:
         fprintf(stderr, "COMPSITE_ERR_DEREFB_WRONG_OPERAND\n");
         break;
+    case COMPSITE_ERR_SPAWN_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_SPAWN_WRONG_OPERAND\n");
+        break;
+    case COMPSITE_ERR_PMAP_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_PMAP_WRONG_OPERAND\n");
+        break;
+    case COMPSITE_ERR_PREDUCE_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_PREDUCE_WRONG_OPERAND\n");
+        break;
+    case COMPSITE_ERR_VEC_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_VEC_WRONG_OPERAND\n");
+        break;
+    case COMPSITE_ERR_HGET_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_HGET_WRONG_OPERAND\n");
+        break;
+    case COMPSITE_ERR_JCC_WRONG_OPERAND:
+        fprintf(stderr, "COMPSITE_ERR_JCC_WRONG_OPERAND\n");
+        break;
     case COMPSITE_ERR_PROC_INSIDE_PROC:
         fprintf(stderr, "COMPSITE_ERR_PROC_INSIDE_PROC\n");
         break;
@@ -406,7 +439,7 @@ tasm_ast_t* tasm_parse_proc_line(tasm_parser_t* parser) {
 
 tasm_ast_t* tasm_parse_label_decl(tasm_parser_t* parser) {
     const char* label_name = parser->current_token.value;
-    const loc_t loc = parser->lexer->loc;
+    const loc_t loc = parser->current_token.loc;
     tasm_parser_eat(parser, TOKEN_ID);
     tasm_parser_eat(parser, TOKEN_COLON);
     return tasm_ast_create((tasm_ast_t) {
@@ -419,7 +452,7 @@ tasm_ast_t* tasm_parse_label_decl(tasm_parser_t* parser) {
 tasm_ast_t* tasm_parse_proc(tasm_parser_t *parser) {
     tasm_parser_eat(parser, TOKEN_PROC);
     const char* proc_name = parser->current_token.value;
-    const loc_t loc = parser->lexer->loc;
+    const loc_t loc = parser->current_token.loc;
     tasm_parser_eat(parser, TOKEN_ID);
     
     tasm_ast_t** lines = NULL;
@@ -483,7 +516,7 @@ bool is_operand_label_call(tasm_parser_t* parser) {
 tasm_ast_t* tasm_parse_instruction(tasm_parser_t* parser) {
     const char* name = parser->current_token.value;
     int type = parser->current_token.type;
-    const loc_t loc = parser->lexer->loc;
+    const loc_t loc = parser->current_token.loc;
     tasm_parser_eat(parser, parser->current_token.type);
         
     tasm_ast_t* operand = NULL;
@@ -643,6 +676,116 @@ tasm_ast_t* tasm_parse_instruction(tasm_parser_t* parser) {
         operand = tasm_parse_int_operand(parser);
         if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_NATIVE_WRONG_OPERAND, "Wrong operand for native insturction");
         break;
+    case TOKEN_OP_SPAWN: tag = AST_OP_SPAWN;
+        operand = tasm_parse_label_operand(parser);
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_SPAWN_WRONG_OPERAND, "Wrong operand for spawn instruction");
+        break;
+    case TOKEN_OP_YIELD: tag = AST_OP_YIELD;
+        break;
+    case TOKEN_OP_JOIN: tag = AST_OP_JOIN;
+        break;
+    case TOKEN_OP_PMAP: tag = AST_OP_PMAP;
+        operand = tasm_parse_label_operand(parser);
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_PMAP_WRONG_OPERAND, "Wrong operand for pmap instruction");
+        break;
+    case TOKEN_OP_PREDUCE: tag = AST_OP_PREDUCE;
+        operand = tasm_parse_label_operand(parser);
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_PREDUCE_WRONG_OPERAND, "Wrong operand for preduce instruction");
+        break;
+    case TOKEN_OP_VADD:
+    case TOKEN_OP_VSUB:
+    case TOKEN_OP_VMUL:
+    case TOKEN_OP_VDIV:
+    case TOKEN_OP_VDOT:
+    case TOKEN_OP_VSUM:
+    case TOKEN_OP_VMIN:
+    case TOKEN_OP_VMAX:
+    case TOKEN_OP_VFILL:
+    case TOKEN_OP_VCOPY:
+        // vector tokens and nodes are declared in the same order
+        tag = AST_OP_VADD + (type - TOKEN_OP_VADD);
+        operand = tasm_parse_ctype_operand(parser, TASM_CTYPE_BIT(TOKEN_TCI_CINT32) | TASM_CTYPE_BIT(TOKEN_TCI_CUINT32) | TASM_CTYPE_BIT(TOKEN_TCI_CFLOAT32));
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_VEC_WRONG_OPERAND, "Vector instructions take an i32, u32 or f32 element type");
+        break;
+    case TOKEN_OP_MCOPY: tag = AST_OP_MCOPY;
+        break;
+    case TOKEN_OP_MFILL: tag = AST_OP_MFILL;
+        break;
+    case TOKEN_OP_MCMP: tag = AST_OP_MCMP;
+        break;
+    case TOKEN_OP_MFIND: tag = AST_OP_MFIND;
+        break;
+    case TOKEN_OP_HGET:
+    case TOKEN_OP_HGETOF:
+        tag = type == TOKEN_OP_HGET ? AST_OP_HGET : AST_OP_HGETOF;
+        operand = tasm_parse_ctype_operand(parser, TASM_HGET_CTYPES);
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_HGET_WRONG_OPERAND, "Wrong element type for hget/hgetof instruction");
+        break;
+    case TOKEN_OP_ADDL: tag = AST_OP_ADDL;
+        break;
+    case TOKEN_OP_SUBL: tag = AST_OP_SUBL;
+        break;
+    case TOKEN_OP_MULTL: tag = AST_OP_MULTL;
+        break;
+    case TOKEN_OP_DIVL: tag = AST_OP_DIVL;
+        break;
+    case TOKEN_OP_MODL: tag = AST_OP_MODL;
+        break;
+    case TOKEN_OP_DIVUL: tag = AST_OP_DIVUL;
+        break;
+    case TOKEN_OP_MODUL: tag = AST_OP_MODUL;
+        break;
+    case TOKEN_OP_ADDD: tag = AST_OP_ADDD;
+        break;
+    case TOKEN_OP_SUBD: tag = AST_OP_SUBD;
+        break;
+    case TOKEN_OP_MULTD: tag = AST_OP_MULTD;
+        break;
+    case TOKEN_OP_DIVD: tag = AST_OP_DIVD;
+        break;
+    case TOKEN_OP_CMPL: tag = AST_OP_CMPL;
+        break;
+    case TOKEN_OP_CMPUL: tag = AST_OP_CMPUL;
+        break;
+    case TOKEN_OP_CMPD: tag = AST_OP_CMPD;
+        break;
+    case TOKEN_OP_CI2L: tag = AST_OP_CI2L;
+        break;
+    case TOKEN_OP_CU2L: tag = AST_OP_CU2L;
+        break;
+    case TOKEN_OP_CL2I: tag = AST_OP_CL2I;
+        break;
+    case TOKEN_OP_CL2D: tag = AST_OP_CL2D;
+        break;
+    case TOKEN_OP_CD2L: tag = AST_OP_CD2L;
+        break;
+    case TOKEN_OP_CF2D: tag = AST_OP_CF2D;
+        break;
+    case TOKEN_OP_CD2F: tag = AST_OP_CD2F;
+        break;
+    case TOKEN_OP_JEQ:
+    case TOKEN_OP_JNE:
+    case TOKEN_OP_JLT:
+    case TOKEN_OP_JLE:
+    case TOKEN_OP_JGT:
+    case TOKEN_OP_JGE:
+    case TOKEN_OP_JLTU:
+    case TOKEN_OP_JLEU:
+    case TOKEN_OP_JGTU:
+    case TOKEN_OP_JGEU:
+    case TOKEN_OP_JEQF:
+    case TOKEN_OP_JNEF:
+    case TOKEN_OP_JLTF:
+    case TOKEN_OP_JLEF:
+    case TOKEN_OP_JGTF:
+    case TOKEN_OP_JGEF:
+        // compare and branch tokens and nodes are declared in the same order
+        tag = AST_OP_JEQ + (type - TOKEN_OP_JEQ);
+        operand = tasm_parse_jmp_operand(parser);
+        if (operand == NULL) tasm_parser_err(parser, COMPSITE_ERR_JCC_WRONG_OPERAND, "Wrong operand for compare and branch instruction");
+        break;
+    case TOKEN_OP_CKPT: tag = AST_OP_CKPT;
+        break;
     case TOKEN_OP_HALT: tag = AST_OP_HALT;
         break;
     default:
@@ -681,6 +824,12 @@ tasm_ast_t* tasm_parse_cfunction(tasm_parser_t* parser) {
     tasm_parser_eat(parser, TOKEN_CFUNCTION);
     const loc_t loc = parser->lexer->loc;
 
+    bool is_async = false;
+    if (parser->current_token.type == TOKEN_ASYNC) {
+        is_async = true;
+        tasm_parser_eat(parser, TOKEN_ASYNC);
+    }
+
     int rtype = parser->current_token.type - TOKEN_TCI_BEGIN - 1;
     if (!is_token_ctype(parser))
         tasm_parser_eat(parser, COMPSITE_ERR_CINTERFACE_RET_TYPE_ERR);
@@ -702,6 +851,7 @@ tasm_ast_t* tasm_parse_cfunction(tasm_parser_t* parser) {
     return tasm_ast_create((tasm_ast_t) {
         .tag = AST_CFUNCTION,
         .loc = loc,
+        .cfunction.is_async = is_async,
         .cfunction.ret_type = rtype,
         .cfunction.arg_types = argtpyes,
         .cfunction.arg_count = argcount,
@@ -724,6 +874,14 @@ tasm_ast_t* tasm_parse_data(tasm_parser_t *parser) {
     tasm_parser_eat(parser, TOKEN_DATA);
     const loc_t loc = parser->lexer->loc;
 
+    bool typed = false;
+    uint8_t ctype = 0;
+    if (is_token_ctype(parser)) {
+        typed = true;
+        ctype = parser->current_token.type - TOKEN_TCI_BEGIN - 1;
+        tasm_parser_eat(parser, parser->current_token.type);
+    }
+
     tasm_ast_t* value = NULL;
     if (parser->current_token.type == TOKEN_QUOTA)
         value = tasm_parse_str_lit(parser);
@@ -736,6 +894,8 @@ tasm_ast_t* tasm_parse_data(tasm_parser_t *parser) {
         .tag = AST_DATA,
         .loc = loc,
         .data.value = value,
+        .data.typed = typed,
+        .data.ctype = ctype,
     });
 }
 
@@ -775,6 +935,22 @@ tasm_ast_t* tasm_parse_label_operand(tasm_parser_t *parser) {
     return NULL;
 }
 
+// element type of the vector instructions, kept as a number holding the ctype
+// the operand is one of the c type names, allowed is a mask of TASM_CTYPE_BIT
+tasm_ast_t* tasm_parse_ctype_operand(tasm_parser_t* parser, uint32_t allowed) {
+    token_type_t type = parser->current_token.type;
+    if (type <= TOKEN_TCI_BEGIN || type >= TOKEN_TCI_END || !(allowed & TASM_CTYPE_BIT(type)))
+        return NULL;
+    const char* text_val = parser->current_token.value;
+    tasm_parser_eat(parser, type);
+    return tasm_ast_create((tasm_ast_t) {
+        .tag = AST_NUMBER,
+        .loc = parser->lexer->loc,
+        .number.text_value = text_val,
+        .number.value.u32 = type - TOKEN_TCI_BEGIN - 1,
+    });
+}
+
 tasm_ast_t* tasm_parse_push_operand(tasm_parser_t* parser) {
     if (is_operand_char(parser))
         return tasm_parse_char_lit(parser);
@@ -787,7 +963,7 @@ tasm_ast_t* tasm_parse_push_operand(tasm_parser_t* parser) {
 
 tasm_ast_t* tasm_parse_label_call(tasm_parser_t *parser) {
     const char* name = parser->current_token.value;
-    const loc_t loc = parser->lexer->loc;
+    const loc_t loc = parser->current_token.loc;
     tasm_parser_eat(parser, TOKEN_ID);
     return tasm_ast_create((tasm_ast_t) {
         .tag = AST_LABEL_CALL,
@@ -800,6 +976,8 @@ tasm_ast_t* tasm_parse_num_lit(tasm_parser_t* parser, bool negative) {
     char* text_val = parser->current_token.value;
     token_type_t type = parser->current_token.type;
     int32_t value;
+    uint64_t wide = 0;
+    double wide_f = 0.0;
     
     if (negative) {
         size_t size = strlen(parser->current_token.value);
@@ -814,15 +992,18 @@ tasm_ast_t* tasm_parse_num_lit(tasm_parser_t* parser, bool negative) {
     case TOKEN_DECIMAL_NUMBER: {
         int32_t val = atoi(text_val);
         value = *(uint32_t*)&val;
+        wide = strtoull(text_val, NULL, 10);
         break;
     }
     case TOKEN_FLOAT_NUMBER: {
         float val = strtof(text_val, NULL);
         value = *(uint32_t*)&val;
+        wide_f = strtod(text_val, NULL);
         break;
     }
     case TOKEN_HEX_NUMBER: {
         int32_t val = strtoll(text_val, NULL, 16);
+        wide = strtoull(text_val, NULL, 16);
         uint32_t beval = *(uint32_t*)&val;
         bool is_le = _is_little_endian();
         if (is_le) {
@@ -833,6 +1014,7 @@ tasm_ast_t* tasm_parse_num_lit(tasm_parser_t* parser, bool negative) {
     }
     case TOKEN_BINARY_NUMBER: {
         int32_t val = strtoll(text_val, NULL, 2);
+        wide = strtoull(text_val, NULL, 2);
         uint32_t beval = *(uint32_t*)&val;
         bool is_le = _is_little_endian();
         if (is_le) {
@@ -846,12 +1028,16 @@ tasm_ast_t* tasm_parse_num_lit(tasm_parser_t* parser, bool negative) {
         tasm_parser_eat(parser, 9600);
         break;
     }
+    if (type == TOKEN_FLOAT_NUMBER)
+        memcpy(&wide, &wide_f, sizeof(wide));
     tasm_parser_eat(parser, type);
     return tasm_ast_create((tasm_ast_t) {
         .tag = AST_NUMBER,
         .loc = parser->lexer->loc,
         .number.text_value = text_val,
         .number.value.i32 = value,
+        .number.is_float = type == TOKEN_FLOAT_NUMBER,
+        .number.wide.u64 = wide,
     });
 }
 
@@ -14,6 +14,7 @@ typedef enum {
     TOKEN_CFUNCTION,
     TOKEN_CSTRUCT,
     TOKEN_DATA,
+    TOKEN_ASYNC,
 
     TOKEN_TCI_BEGIN,
     TOKEN_TCI_CUINT8,
@@ -94,6 +95,65 @@ typedef enum {
     TOKEN_OP_PUTS,
     TOKEN_OP_PUTC,
     TOKEN_OP_NATIVE,
+    TOKEN_OP_SPAWN,
+    TOKEN_OP_YIELD,
+    TOKEN_OP_JOIN,
+    TOKEN_OP_PMAP,
+    TOKEN_OP_PREDUCE,
+    TOKEN_OP_VADD,
+    TOKEN_OP_VSUB,
+    TOKEN_OP_VMUL,
+    TOKEN_OP_VDIV,
+    TOKEN_OP_VDOT,
+    TOKEN_OP_VSUM,
+    TOKEN_OP_VMIN,
+    TOKEN_OP_VMAX,
+    TOKEN_OP_VFILL,
+    TOKEN_OP_VCOPY,
+    TOKEN_OP_MCOPY,
+    TOKEN_OP_MFILL,
+    TOKEN_OP_MCMP,
+    TOKEN_OP_MFIND,
+    TOKEN_OP_HGET,
+    TOKEN_OP_HGETOF,
+    TOKEN_OP_ADDL,
+    TOKEN_OP_SUBL,
+    TOKEN_OP_MULTL,
+    TOKEN_OP_DIVL,
+    TOKEN_OP_MODL,
+    TOKEN_OP_DIVUL,
+    TOKEN_OP_MODUL,
+    TOKEN_OP_ADDD,
+    TOKEN_OP_SUBD,
+    TOKEN_OP_MULTD,
+    TOKEN_OP_DIVD,
+    TOKEN_OP_CMPL,
+    TOKEN_OP_CMPUL,
+    TOKEN_OP_CMPD,
+    TOKEN_OP_CI2L,
+    TOKEN_OP_CU2L,
+    TOKEN_OP_CL2I,
+    TOKEN_OP_CL2D,
+    TOKEN_OP_CD2L,
+    TOKEN_OP_CF2D,
+    TOKEN_OP_CD2F,
+    TOKEN_OP_JEQ,
+    TOKEN_OP_JNE,
+    TOKEN_OP_JLT,
+    TOKEN_OP_JLE,
+    TOKEN_OP_JGT,
+    TOKEN_OP_JGE,
+    TOKEN_OP_JLTU,
+    TOKEN_OP_JLEU,
+    TOKEN_OP_JGTU,
+    TOKEN_OP_JGEU,
+    TOKEN_OP_JEQF,
+    TOKEN_OP_JNEF,
+    TOKEN_OP_JLTF,
+    TOKEN_OP_JLEF,
+    TOKEN_OP_JGTF,
+    TOKEN_OP_JGEF,
+    TOKEN_OP_CKPT,
     TOKEN_OP_HALT,
 
     INSTRUCTIONS_TOKEN_END,
@@ -109,9 +169,15 @@ typedef enum {
     TOKEN_EOF,
 } token_type_t;
 
+typedef struct {
+    int row, col;
+    const char* file_name;
+} loc_t;
+
 typedef struct {
     token_type_t type;
     char* value;
+    loc_t loc; // where the token starts
 } tasm_token_t;
 
 tasm_token_t tasm_token_create(token_type_t type, char* value);
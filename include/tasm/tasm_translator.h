@@ -9,27 +9,19 @@
 #include <common/cli.h>
 
 
-#define MAX_PROGRAM_CAPACITY 1024
-#define SYMBOL_LABEL_CALL_CAPACITY 512
-#define SYMBOL_LABEL_DECL_CAPACITY 512
-#define SYMBOL_PROC_DECL_CAPACITY 512
+typedef struct {
+    size_t addr;
+    const char* name;
+} symbol_t;
 
+// stb_ds arrays, generated sources easily have thousands of labels
 typedef struct {
-    struct {
-        size_t addr;
-        const char* name;
-    } label_decls[SYMBOL_LABEL_DECL_CAPACITY];
+    symbol_t* label_decls;
     size_t label_decls_size;
     size_t label_address_pointer;
-    struct {
-        size_t addr;
-        const char* name;
-    } label_calls[SYMBOL_LABEL_CALL_CAPACITY];
+    symbol_t* label_calls;
     size_t label_calls_size;
-    struct {
-        size_t addr;
-        const char* name;
-    } proc_decls[SYMBOL_PROC_DECL_CAPACITY];
+    symbol_t* proc_decls;
     size_t proc_decls_size;
     size_t proc_address_pointer;
 
@@ -37,10 +29,41 @@ typedef struct {
 
 } symbol_table_t;
 
+// in layout order, every kind starts naturally aligned because the ones before it are multiples of its size
+typedef enum {
+    TASM_CONST_WORD64, // i64, u64, ptr, f64
+    TASM_CONST_WORD,   // untyped numbers, i16 to u32, f32
+    TASM_CONST_BYTE,   // chars, i8, u8
+    TASM_CONST_STRING,
+} tasm_const_kind_t;
+
+// an @data entry waiting for tasm_translate_consts to place it in the constant table
+typedef struct {
+    uint8_t kind;     // tasm_const_kind_t
+    uint8_t obj_type; // stack_obj_type_t pushed by loadc
+    bool is_signed;   // i8, loadcb sign extends it
+    const uint8_t* bytes;
+    uint32_t size; // strings include their terminating '\0'
+    uint32_t ref;  // index in const_table.referances
+} tasm_const_t;
+
+// loadc/aloadc waiting for the byte offset of its constant
+typedef struct {
+    size_t code; // index in program.code
+    uint32_t ref;
+    loc_t loc;
+} tasm_const_fixup_t;
+
 typedef struct {
     symbol_table_t symbols;
     tvm_program_t program;
     arena_t* cstr_arena;
+    tasm_const_t* consts;
+    tasm_const_fixup_t* const_fixups;
+    struct { uint64_t key; uint32_t value; }* const_map; // content hash -> offset in const_table.data
+    uint32_t row; // source row of the line being translated, program_push records it for the debug section
+    uint32_t* rows; // stb_ds array, the row of every instruction
+    tvm_debug_symbol_t* debug_symbols; // procs and top level labels in code order
 } tasm_translator_t;
 
 tasm_translator_t tasm_translator_init();
@@ -49,6 +72,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
 static void tasm_translate_proc_and_line(tasm_translator_t* translator, tasm_ast_t* node);
 void tasm_translate_unit(tasm_translator_t* translator, tasm_ast_t* node);
 static void tasm_translate_proc(tasm_translator_t* translator, tasm_ast_t* node);
+void tasm_fuse_branches(tasm_ast_t* node);
 void tasm_resolve_labels(tasm_translator_t* translator, tasm_ast_t* node, const char* prefix);
 void tasm_resolve_procs(tasm_translator_t* translator, tasm_ast_t* node);
 static void program_push(tasm_translator_t* translator, opcode_t code);
@@ -58,6 +82,7 @@ static size_t get_addr_from_proc_decl_symbol(tasm_translator_t* translator, cons
 void tasm_translate_cfunction(tasm_translator_t* translator, tasm_ast_t* node);
 void tasm_translate_cstruct(tasm_translator_t* translator, tasm_ast_t* node);
 void tasm_translate_data(tasm_translator_t* translator, tasm_ast_t* node);
+void tasm_translate_consts(tasm_translator_t* translator);
 void tasm_translator_generate_bin(tasm_translator_t* translator, cli_parsed_args_t args);
 void symbol_dump(tasm_translator_t* translator);
 bool tasm_translator_is_err(tasm_translator_t* translator);
@@ -128,6 +153,65 @@ case AST_OP_HSETOF: \
 case AST_OP_PUTS: \
 case AST_OP_PUTC: \
 case AST_OP_NATIVE: \
+case AST_OP_SPAWN: \
+case AST_OP_YIELD: \
+case AST_OP_JOIN: \
+case AST_OP_PMAP: \
+case AST_OP_PREDUCE: \
+case AST_OP_VADD: \
+case AST_OP_VSUB: \
+case AST_OP_VMUL: \
+case AST_OP_VDIV: \
+case AST_OP_VDOT: \
+case AST_OP_VSUM: \
+case AST_OP_VMIN: \
+case AST_OP_VMAX: \
+case AST_OP_VFILL: \
+case AST_OP_VCOPY: \
+case AST_OP_MCOPY: \
+case AST_OP_MFILL: \
+case AST_OP_MCMP: \
+case AST_OP_MFIND: \
+case AST_OP_HGET: \
+case AST_OP_HGETOF: \
+case AST_OP_ADDL: \
+case AST_OP_SUBL: \
+case AST_OP_MULTL: \
+case AST_OP_DIVL: \
+case AST_OP_MODL: \
+case AST_OP_DIVUL: \
+case AST_OP_MODUL: \
+case AST_OP_ADDD: \
+case AST_OP_SUBD: \
+case AST_OP_MULTD: \
+case AST_OP_DIVD: \
+case AST_OP_CMPL: \
+case AST_OP_CMPUL: \
+case AST_OP_CMPD: \
+case AST_OP_CI2L: \
+case AST_OP_CU2L: \
+case AST_OP_CL2I: \
+case AST_OP_CL2D: \
+case AST_OP_CD2L: \
+case AST_OP_CF2D: \
+case AST_OP_CD2F: \
+case AST_OP_JEQ: \
+case AST_OP_JNE: \
+case AST_OP_JLT: \
+case AST_OP_JLE: \
+case AST_OP_JGT: \
+case AST_OP_JGE: \
+case AST_OP_JLTU: \
+case AST_OP_JLEU: \
+case AST_OP_JGTU: \
+case AST_OP_JGEU: \
+case AST_OP_JEQF: \
+case AST_OP_JNEF: \
+case AST_OP_JLTF: \
+case AST_OP_JLEF: \
+case AST_OP_JGTF: \
+case AST_OP_JGEF: \
+case AST_OP_CKPT: \
 case AST_OP_HALT \
 
 tasm_translator_t tasm_translator_init() {
@@ -140,21 +224,27 @@ tasm_translator_t tasm_translator_init() {
                 .module_count = 0,
             },
             .const_table = {0},
-            .code = {0},
+            .code = NULL,
             .size = 0,
             .program_arena = NULL,
         },
         .symbols = (symbol_table_t){
-            .label_calls = {0},
+            .label_calls = NULL,
             .label_calls_size = 0,
-            .label_decls = {0},
+            .label_decls = NULL,
             .label_decls_size = 0,
-            .proc_decls = {0},
+            .proc_decls = NULL,
             .proc_decls_size = 0,
             .label_address_pointer = 0,
             .err = false,
         },
         .cstr_arena = arena_init(1024),
+        .consts = NULL,
+        .const_fixups = NULL,
+        .const_map = NULL,
+        .row = 0,
+        .rows = NULL,
+        .debug_symbols = NULL,
     };
 }
 
@@ -162,6 +252,16 @@ void tasm_translator_destroy(tasm_translator_t* translator) {
     arena_destroy(translator->cstr_arena);
     arrfree(translator->program.const_table.referances);
     arrfree(translator->program.const_table.data);
+    arrfree(translator->consts);
+    arrfree(translator->program.code);
+    arrfree(translator->program.metadata.modules[0].cfuns);
+    arrfree(translator->const_fixups);
+    hmfree(translator->const_map);
+    arrfree(translator->rows);
+    arrfree(translator->symbols.label_decls);
+    arrfree(translator->symbols.label_calls);
+    arrfree(translator->symbols.proc_decls);
+    arrfree(translator->debug_symbols);
 }
 
 static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node, const char* prefix, bool is_call) {
@@ -173,15 +273,13 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_PUSH,
                 });
             } else if (node->inst.operand->tag == AST_CHAR) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_CHARACTER,
-                    .operand.ui32 = (uint32_t)node->inst.operand->character.value[0],
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_CHARACTER, (uint32_t)node->inst.operand->character.value[0]),
                     .type = OP_PUSH,
                 });
             }
@@ -206,8 +304,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
                     .type = OP_CLN,
                 });
             }
@@ -216,8 +313,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
                     .type = OP_SWAP,
                 });
             }
@@ -256,8 +352,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
                     .type = OP_JMP,
                 });
             }
@@ -270,8 +365,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
                 }
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = addr,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
                     .type = OP_JMP,
                 });
             }
@@ -280,8 +374,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
                     .type = OP_JZ,
                 });
             }
@@ -294,8 +387,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
                 }
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = addr,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
                     .type = OP_JZ,
                 });
             }
@@ -304,8 +396,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
                     .type = OP_JNZ,
                 });
             }
@@ -318,8 +409,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
                 }
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = addr,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
                     .type = OP_JNZ,
                 });
             }
@@ -334,8 +424,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
                 }
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_VM_ADDRESS,
-                    .operand.ui32 = addr,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
                     .type = OP_CALL,
                 });
             }
@@ -416,22 +505,18 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             program_push(translator, (opcode_t){.type = OP_RSHFT});
             break;
         case AST_OP_LOADC:
-            if (node->inst.operand->tag == AST_NUMBER) {
-                program_push(translator, (opcode_t)
-                {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
-                    .type = OP_LOADC,
-                });
-            }
-            break;
         case AST_OP_ALOADC:
             if (node->inst.operand->tag == AST_NUMBER) {
+                // operand is the @data index for now, tasm_translate_consts turns it into a byte offset
+                arrput(translator->const_fixups, ((tasm_const_fixup_t) {
+                    .code = translator->program.size,
+                    .ref = node->inst.operand->number.value.u32,
+                    .loc = node->loc,
+                }));
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_DATA_ADDRESS,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
-                    .type = OP_ALOADC,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
+                    .type = node->tag == AST_OP_LOADC ? OP_LOADC : OP_ALOADC,
                 });
             }
             break;
@@ -439,8 +524,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_LOAD,
                 });
             }
@@ -449,8 +533,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_STORE,
                 });
             }
@@ -459,8 +542,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_GLOAD,
                 });
             }
@@ -469,8 +551,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_GSTORE,
                 });
             }
@@ -485,8 +566,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_DEREFB,
                 });
             }
@@ -507,12 +587,179 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
             if (node->inst.operand->tag == AST_NUMBER) {
                 program_push(translator, (opcode_t)
                 {
-                    .operand.type = STACK_OBJ_TYPE_NUMBER,
-                    .operand.ui32 = node->inst.operand->number.value.u32,
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
                     .type = OP_NATIVE,
                 });
             }
             break;
+        case AST_OP_SPAWN:
+        case AST_OP_PMAP:
+        case AST_OP_PREDUCE:
+            // the fiber entry or kernel is resolved like a call target
+            if (node->inst.operand->tag == AST_LABEL_CALL) {
+                tasm_translate_line(translator, node->inst.operand, NULL, true);
+                const char* name = node->inst.operand->label_call.name;
+                int addr = get_addr_from_proc_decl_symbol(translator, name);
+                if (addr == -1) {
+                    return;
+                }
+                program_push(translator, (opcode_t)
+                {
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
+                    .type = node->tag == AST_OP_SPAWN ? OP_SPAWN : node->tag == AST_OP_PMAP ? OP_PMAP : OP_PREDUCE,
+                });
+            }
+            break;
+        case AST_OP_YIELD:
+            program_push(translator, (opcode_t){.type = OP_YIELD});
+            break;
+        case AST_OP_JOIN:
+            program_push(translator, (opcode_t){.type = OP_JOIN});
+            break;
+        case AST_OP_VADD:
+        case AST_OP_VSUB:
+        case AST_OP_VMUL:
+        case AST_OP_VDIV:
+        case AST_OP_VDOT:
+        case AST_OP_VSUM:
+        case AST_OP_VMIN:
+        case AST_OP_VMAX:
+        case AST_OP_VFILL:
+        case AST_OP_VCOPY:
+            // vector opcodes are declared in the same order in both enums
+            if (node->inst.operand->tag == AST_NUMBER) {
+                program_push(translator, (opcode_t)
+                {
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
+                    .type = OP_VADD + (node->tag - AST_OP_VADD),
+                });
+            }
+            break;
+        case AST_OP_MCOPY:
+            program_push(translator, (opcode_t){.type = OP_MCOPY});
+            break;
+        case AST_OP_MFILL:
+            program_push(translator, (opcode_t){.type = OP_MFILL});
+            break;
+        case AST_OP_MCMP:
+            program_push(translator, (opcode_t){.type = OP_MCMP});
+            break;
+        case AST_OP_MFIND:
+            program_push(translator, (opcode_t){.type = OP_MFIND});
+            break;
+        case AST_OP_HGET:
+        case AST_OP_HGETOF:
+            if (node->inst.operand->tag == AST_NUMBER) {
+                program_push(translator, (opcode_t)
+                {
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_NUMBER, node->inst.operand->number.value.u32),
+                    .type = node->tag == AST_OP_HGET ? OP_HGET : OP_HGETOF,
+                });
+            }
+            break;
+        case AST_OP_ADDL:
+            program_push(translator, (opcode_t){.type = OP_ADDL});
+            break;
+        case AST_OP_SUBL:
+            program_push(translator, (opcode_t){.type = OP_SUBL});
+            break;
+        case AST_OP_MULTL:
+            program_push(translator, (opcode_t){.type = OP_MULTL});
+            break;
+        case AST_OP_DIVL:
+            program_push(translator, (opcode_t){.type = OP_DIVL});
+            break;
+        case AST_OP_MODL:
+            program_push(translator, (opcode_t){.type = OP_MODL});
+            break;
+        case AST_OP_DIVUL:
+            program_push(translator, (opcode_t){.type = OP_DIVUL});
+            break;
+        case AST_OP_MODUL:
+            program_push(translator, (opcode_t){.type = OP_MODUL});
+            break;
+        case AST_OP_ADDD:
+            program_push(translator, (opcode_t){.type = OP_ADDD});
+            break;
+        case AST_OP_SUBD:
+            program_push(translator, (opcode_t){.type = OP_SUBD});
+            break;
+        case AST_OP_MULTD:
+            program_push(translator, (opcode_t){.type = OP_MULTD});
+            break;
+        case AST_OP_DIVD:
+            program_push(translator, (opcode_t){.type = OP_DIVD});
+            break;
+        case AST_OP_CMPL:
+            program_push(translator, (opcode_t){.type = OP_CMPL});
+            break;
+        case AST_OP_CMPUL:
+            program_push(translator, (opcode_t){.type = OP_CMPUL});
+            break;
+        case AST_OP_CMPD:
+            program_push(translator, (opcode_t){.type = OP_CMPD});
+            break;
+        case AST_OP_CI2L:
+            program_push(translator, (opcode_t){.type = OP_CI2L});
+            break;
+        case AST_OP_CU2L:
+            program_push(translator, (opcode_t){.type = OP_CU2L});
+            break;
+        case AST_OP_CL2I:
+            program_push(translator, (opcode_t){.type = OP_CL2I});
+            break;
+        case AST_OP_CL2D:
+            program_push(translator, (opcode_t){.type = OP_CL2D});
+            break;
+        case AST_OP_CD2L:
+            program_push(translator, (opcode_t){.type = OP_CD2L});
+            break;
+        case AST_OP_CF2D:
+            program_push(translator, (opcode_t){.type = OP_CF2D});
+            break;
+        case AST_OP_CD2F:
+            program_push(translator, (opcode_t){.type = OP_CD2F});
+            break;
+        case AST_OP_JEQ:
+        case AST_OP_JNE:
+        case AST_OP_JLT:
+        case AST_OP_JLE:
+        case AST_OP_JGT:
+        case AST_OP_JGE:
+        case AST_OP_JLTU:
+        case AST_OP_JLEU:
+        case AST_OP_JGTU:
+        case AST_OP_JGEU:
+        case AST_OP_JEQF:
+        case AST_OP_JNEF:
+        case AST_OP_JLTF:
+        case AST_OP_JLEF:
+        case AST_OP_JGTF:
+        case AST_OP_JGEF:
+            if (node->inst.operand->tag == AST_NUMBER) {
+                program_push(translator, (opcode_t)
+                {
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, node->inst.operand->number.value.u32),
+                    .type = OP_JEQ + (node->tag - AST_OP_JEQ),
+                });
+            }
+            else if (node->inst.operand->tag == AST_LABEL_CALL) {
+                tasm_translate_line(translator, node->inst.operand, prefix, false);
+                const char* name = node->inst.operand->label_call.name;
+                int addr = get_addr_from_label_call_symbol(translator, name);
+                if (addr == -1) {
+                    return;
+                }
+                program_push(translator, (opcode_t)
+                {
+                    .operand = tvm_object_create(STACK_OBJ_TYPE_VM_ADDRESS, addr),
+                    .type = OP_JEQ + (node->tag - AST_OP_JEQ),
+                });
+            }
+            break;
+        case AST_OP_CKPT:
+            program_push(translator, (opcode_t){.type = OP_CKPT});
+            break;
         case AST_OP_HALT:
             program_push(translator, (opcode_t){.type = OP_HALT});
             break;
@@ -545,8 +792,7 @@ static void tasm_translate_line(tasm_translator_t* translator, tasm_ast_t* node,
                 translator->symbols.err = true;
                 return;
             }
-            translator->symbols.label_calls[translator->symbols.label_calls_size].name = name;
-            translator->symbols.label_calls[translator->symbols.label_calls_size].addr = addr;
+            arrput(translator->symbols.label_calls, ((symbol_t) { .addr = addr, .name = name }));
             translator->symbols.label_calls_size++;
         }
             break;
@@ -574,10 +820,12 @@ void tasm_translate_cfunction(tasm_translator_t* translator, tasm_ast_t* node) {
         .rtype = node->cfunction.ret_type,
         .atypes = node->cfunction.arg_types,
         .acount = arrlen(node->cfunction.arg_types),
+        .flags = node->cfunction.is_async ? TVM_CFUN_ASYNC : 0,
         .symbol_name = node->cfunction.name,
     };
     //FIXME: make it support more than one module.
-    translator->program.metadata.modules[0].cfuns[translator->program.metadata.modules[0].cfun_count++] = cfun;
+    arrput(translator->program.metadata.modules[0].cfuns, cfun);
+    translator->program.metadata.modules[0].cfun_count++;
 }
 
 void tasm_translate_cstruct(tasm_translator_t* translator, tasm_ast_t* node) {
@@ -586,40 +834,202 @@ void tasm_translate_cstruct(tasm_translator_t* translator, tasm_ast_t* node) {
     // TODO: implement this
 }
 
-void tasm_translate_data(tasm_translator_t *translator, tasm_ast_t *node) {
-    static size_t beginning_address = 0;
-    // if (translator->program.const_table.referance_count <= 0)
+static bool tasm_translate_typed_number(tasm_translator_t* translator, tasm_ast_t* node, tasm_const_t* c) {
+    struct ast_number* number = &node->data.value->number;
+    int64_t integer = number->is_float ? (int64_t)number->wide.f64 : (int64_t)number->wide.u64;
+    double real = number->is_float ? number->wide.f64 : (double)integer;
+    uint8_t* bytes = arena_alloc(&translator->cstr_arena, sizeof(uint64_t));
 
-    switch (node->data.value->tag)
+    switch (node->data.ctype)
     {
-    case AST_STRING: {
-        size_t len = node->data.value->string.length;
-        arrput(translator->program.const_table.referances, beginning_address);
-        uint8_t* begin = arraddnptr(translator->program.const_table.data, len);
-        memmove(begin, node->data.value->string.value, len);
-        beginning_address += len;
+    case CTYPE_UINT8:
+    case CTYPE_INT8:
+        c->kind = TASM_CONST_BYTE;
+        c->size = sizeof(uint8_t);
+        c->is_signed = node->data.ctype == CTYPE_INT8;
+        bytes[0] = (uint8_t)integer;
+        break;
+    case CTYPE_UINT16:
+    case CTYPE_INT16:
+    case CTYPE_UINT32:
+    case CTYPE_INT32: {
+        uint32_t value = (uint32_t)integer;
+        c->kind = TASM_CONST_WORD;
+        c->size = sizeof(uint32_t);
+        memcpy(bytes, &value, sizeof(value));
         break;
     }
-    case AST_NUMBER: {
-        size_t len = sizeof(uint32_t);
-        arrput(translator->program.const_table.referances, beginning_address);
-        uint8_t* begin = arraddnptr(translator->program.const_table.data, len);
-        memmove(begin, (uint8_t*)&node->data.value->number.value.u32, len);
-        beginning_address += len;
+    case CTYPE_FLOAT32: {
+        float value = (float)real;
+        c->kind = TASM_CONST_WORD;
+        c->size = sizeof(float);
+        memcpy(bytes, &value, sizeof(value));
         break;
     }
-    case AST_CHAR: {
-        arrput(translator->program.const_table.referances, beginning_address);
-        uint8_t* begin = arraddnptr(translator->program.const_table.data, 1);
-        memmove(begin, (uint8_t*)&node->data.value->character.value[0], 1);
-        beginning_address += 1;
+    case CTYPE_UINT64:
+    case CTYPE_INT64:
+    case CTYPE_PTR:
+        c->kind = TASM_CONST_WORD64;
+        c->size = sizeof(uint64_t);
+        memcpy(bytes, &integer, sizeof(integer));
+        break;
+    case CTYPE_FLOAT64:
+        c->kind = TASM_CONST_WORD64;
+        c->size = sizeof(double);
+        memcpy(bytes, &real, sizeof(real));
         break;
-    }    
     default:
+        return false;
+    }
+    c->bytes = bytes;
+    return true;
+}
+
+void tasm_translate_data(tasm_translator_t *translator, tasm_ast_t *node) {
+    // only record the constant here, tasm_translate_consts lays out the table once all of them are known
+    tasm_const_t c = {
+        .obj_type = STACK_OBJ_TYPE_NUMBER,
+        .ref = translator->program.const_table.referance_count,
+    };
+    switch (node->data.value->tag)
+    {
+    case AST_STRING:
+        c.kind = TASM_CONST_STRING;
+        c.bytes = (const uint8_t*)node->data.value->string.value;
+        c.size = node->data.value->string.length + 1;
+        break;
+    case AST_NUMBER:
+        if (node->data.typed) {
+            if (!tasm_translate_typed_number(translator, node, &c)) {
+                fprintf(stderr, "%s:%d:%d:"CLR_RED"Invalid constant type:"CLR_END" %s\n", node->loc.file_name, node->loc.row, node->loc.col, _tci_ctypes[node->data.ctype]);
+                translator->symbols.err = true;
+                return;
+            }
+            break;
+        }
+        c.kind = TASM_CONST_WORD;
+        c.bytes = (const uint8_t*)&node->data.value->number.value.u32;
+        c.size = sizeof(uint32_t);
+        break;
+    case AST_CHAR:
+        c.kind = TASM_CONST_BYTE;
+        c.obj_type = STACK_OBJ_TYPE_CHARACTER;
+        c.bytes = (const uint8_t*)&node->data.value->character.value[0];
+        c.size = 1;
         break;
+    default:
+        return;
     }
+    arrput(translator->consts, c);
+    arrput(translator->program.const_table.referances, 0);
     translator->program.const_table.referance_count++;
-    translator->program.const_table.data_size = beginning_address;
+}
+
+// FNV-1a, seeded with the kind so a number never aliases a string with the same bytes
+static uint64_t tasm_const_hash_seed(uint8_t kind) {
+    return 14695981039346656037ull ^ kind;
+}
+
+static uint64_t tasm_const_hash_byte(uint64_t hash, uint8_t byte) {
+    hash ^= byte;
+    return hash * 1099511628211ull;
+}
+
+// back to front, so the hashes of all the tails of a string come out of one pass over it
+static uint64_t tasm_const_hash(uint8_t kind, const uint8_t* bytes, uint32_t size) {
+    uint64_t hash = tasm_const_hash_seed(kind);
+    for (uint32_t i = size; i-- > 0;)
+        hash = tasm_const_hash_byte(hash, bytes[i]);
+    return hash;
+}
+
+static int tasm_const_cmp_ref(const void* a, const void* b) {
+    const tasm_const_t* x = a;
+    const tasm_const_t* y = b;
+    return x->ref < y->ref ? -1 : x->ref > y->ref;
+}
+
+static int tasm_const_cmp(const void* a, const void* b) {
+    const tasm_const_t* x = a;
+    const tasm_const_t* y = b;
+    if (x->kind != y->kind)
+        return x->kind - y->kind;
+    // longest strings first, shorter ones can then share their tails
+    if (x->size != y->size)
+        return x->size < y->size ? 1 : -1;
+    return x->ref < y->ref ? -1 : x->ref > y->ref;
+}
+
+static bool tasm_const_find(tasm_translator_t* translator, uint64_t hash, tasm_const_t* c, uint32_t* offset) {
+    ptrdiff_t slot = hmgeti(translator->const_map, hash);
+    if (slot < 0)
+        return false;
+    uint32_t found = translator->const_map[slot].value;
+    // hashes can collide, trust only the bytes
+    if (found + c->size > arrlenu(translator->program.const_table.data)
+    || memcmp(&translator->program.const_table.data[found], c->bytes, c->size) != 0)
+        return false;
+    *offset = found;
+    return true;
+}
+
+void tasm_translate_consts(tasm_translator_t* translator) {
+    size_t count = arrlenu(translator->consts);
+    qsort(translator->consts, count, sizeof(tasm_const_t), tasm_const_cmp);
+
+    for (size_t i = 0; i < count; i++) {
+        tasm_const_t* c = &translator->consts[i];
+        uint64_t hash = tasm_const_hash(c->kind, c->bytes, c->size);
+        uint32_t offset;
+        if (!tasm_const_find(translator, hash, c, &offset)) {
+            offset = (uint32_t)arrlenu(translator->program.const_table.data);
+            uint8_t* begin = arraddnptr(translator->program.const_table.data, c->size);
+            memcpy(begin, c->bytes, c->size);
+            if (c->kind == TASM_CONST_STRING) {
+                // every tail of a '\0' terminated string is a valid string too
+                uint64_t suffix_hash = tasm_const_hash_seed(c->kind);
+                for (uint32_t k = c->size; k-- > 0;) {
+                    suffix_hash = tasm_const_hash_byte(suffix_hash, c->bytes[k]);
+                    if (hmgeti(translator->const_map, suffix_hash) < 0)
+                        hmput(translator->const_map, suffix_hash, offset + k);
+                }
+            } else {
+                hmput(translator->const_map, hash, offset);
+            }
+        }
+        translator->program.const_table.referances[c->ref] = offset;
+    }
+    translator->program.const_table.data_size = (uint32_t)arrlenu(translator->program.const_table.data);
+
+    // back in @data order, consts[ref] is the constant of that reference again
+    qsort(translator->consts, count, sizeof(tasm_const_t), tasm_const_cmp_ref);
+    for (size_t i = 0; i < arrlenu(translator->const_fixups); i++) {
+        tasm_const_fixup_t* fixup = &translator->const_fixups[i];
+        opcode_t* op = &translator->program.code[fixup->code];
+        if (fixup->ref >= count) {
+            fprintf(stderr, "%s:%d:%d:"CLR_RED"Invalid constant referance:"CLR_END" %u\n", fixup->loc.file_name, fixup->loc.row, fixup->loc.col, fixup->ref);
+            translator->symbols.err = true;
+            continue;
+        }
+        tasm_const_t* c = &translator->consts[fixup->ref];
+        uint32_t offset = translator->program.const_table.referances[fixup->ref];
+        if (op->type == OP_ALOADC) {
+            op->operand = tvm_object_create(STACK_OBJ_TYPE_CONST_ADDRESS, offset);
+            continue;
+        }
+        // pick the load that matches the width of the constant
+        switch (c->kind)
+        {
+        case TASM_CONST_WORD64: op->type = OP_LOADCW; break;
+        case TASM_CONST_WORD: op->type = OP_LOADC; break;
+        case TASM_CONST_BYTE: op->type = OP_LOADCB; break;
+        default:
+            fprintf(stderr, "%s:%d:%d:"CLR_RED"loadc can not load a string, use aloadc:"CLR_END" %u\n", fixup->loc.file_name, fixup->loc.row, fixup->loc.col, fixup->ref);
+            translator->symbols.err = true;
+            continue;
+        }
+        op->operand = tvm_object_create(c->obj_type, offset | (c->is_signed ? TVM_LOADCB_SIGNED : 0));
+    }
 }
 
 static void tasm_translate_proc_and_line(tasm_translator_t *translator, tasm_ast_t *node) {
@@ -628,7 +1038,17 @@ static void tasm_translate_proc_and_line(tasm_translator_t *translator, tasm_ast
     case AST_PROC:
         tasm_translate_proc(translator, node);
         break;
+    case AST_LABEL_DECL:
+        // labels inside procs stay out, the proc already names that code
+        arrput(translator->debug_symbols, ((tvm_debug_symbol_t) {
+            .name = node->label_decl.name,
+            .addr = translator->program.size,
+            .end = 0,
+            .kind = TVM_DEBUG_SYMBOL_LABEL,
+        }));
+        break;
     default:
+        translator->row = node->loc.row;
         tasm_translate_line(translator, node, NULL, false);
         break;
     }
@@ -643,6 +1063,7 @@ void tasm_translate_unit(tasm_translator_t *translator, tasm_ast_t *node) {
         for (size_t i = 0; i < node->file.line_size; i++) {
             tasm_translate_proc_and_line(translator, node->file.lines[i]);
         }
+        tasm_translate_consts(translator);
         break;
     default:
         break;
@@ -654,16 +1075,94 @@ static void tasm_translate_proc(tasm_translator_t *translator, tasm_ast_t *node)
     {
     case AST_NONE:
         break;
-    case AST_PROC:
+    case AST_PROC: {
+        uint32_t addr = translator->program.size;
         for (size_t i = 0; i < node->proc.line_size; i++) {
+            translator->row = node->proc.lines[i]->loc.row;
             tasm_translate_line(translator, node->proc.lines[i], node->proc.name, false);
         }
+        arrput(translator->debug_symbols, ((tvm_debug_symbol_t) {
+            .name = node->proc.name,
+            .addr = addr,
+            .end = translator->program.size,
+            .kind = TVM_DEBUG_SYMBOL_PROC,
+        }));
         break;
+    }
     default:
         break;
     }
 }
 
+// the compare a jz/jnz pops, or -1, jz branches on the negated compare
+static int tasm_fused_branch(int compare, int jump) {
+    bool taken = jump == AST_OP_JNZ;
+    switch (compare) {
+    case AST_OP_EQ: return taken ? AST_OP_JEQ : AST_OP_JNE;
+    case AST_OP_LT: return taken ? AST_OP_JLT : AST_OP_JGE;
+    case AST_OP_LE: return taken ? AST_OP_JLE : AST_OP_JGT;
+    case AST_OP_GT: return taken ? AST_OP_JGT : AST_OP_JLE;
+    case AST_OP_GE: return taken ? AST_OP_JGE : AST_OP_JLT;
+    case AST_OP_EQF: return taken ? AST_OP_JEQF : AST_OP_JNEF;
+    // !(a < b) is not a >= b once a NaN shows up, so float compares only fuse with jnz
+    case AST_OP_LTF: return taken ? AST_OP_JLTF : -1;
+    case AST_OP_LEF: return taken ? AST_OP_JLEF : -1;
+    case AST_OP_GTF: return taken ? AST_OP_JGTF : -1;
+    case AST_OP_GEF: return taken ? AST_OP_JGEF : -1;
+    default: return -1;
+    }
+}
+
+static void tasm_fuse_lines(tasm_ast_t*** lines, size_t* line_size) {
+    for (size_t i = 0; i + 1 < *line_size; i++) {
+        tasm_ast_t* compare = (*lines)[i];
+        tasm_ast_t* jump = (*lines)[i + 1];
+        if (jump->tag != AST_OP_JZ && jump->tag != AST_OP_JNZ)
+            continue;
+        int fused = tasm_fused_branch(compare->tag, jump->tag);
+        if (fused == -1)
+            continue;
+        // a label between the two would be a line of its own, so the jump can not be a target here
+        compare->tag = fused;
+        compare->inst.operand = jump->inst.operand;
+        compare->inst.name = jump->inst.name;
+        arrdel(*lines, i + 1);
+        (*line_size)--;
+    }
+}
+
+// a jump or call to a plain number targets an instruction index that fusing would shift
+static bool tasm_has_numeric_target(tasm_ast_t** lines, size_t line_size) {
+    for (size_t i = 0; i < line_size; i++) {
+        tasm_ast_t* line = lines[i];
+        if (line->tag == AST_PROC) {
+            if (tasm_has_numeric_target(line->proc.lines, line->proc.line_size))
+                return true;
+            continue;
+        }
+        bool branch = line->tag == AST_OP_JMP || line->tag == AST_OP_JZ || line->tag == AST_OP_JNZ
+            || line->tag == AST_OP_CALL || (line->tag >= AST_OP_JEQ && line->tag <= AST_OP_JGEF);
+        if (branch && line->inst.operand != NULL && line->inst.operand->tag == AST_NUMBER)
+            return true;
+    }
+    return false;
+}
+
+// runs before the symbols are resolved so that label addresses count the fused instructions
+void tasm_fuse_branches(tasm_ast_t* node) {
+    if (node->tag != AST_FILE)
+        return;
+    // numeric targets are not remapped, such a unit is left as written
+    if (tasm_has_numeric_target(node->file.lines, node->file.line_size))
+        return;
+    tasm_fuse_lines(&node->file.lines, &node->file.line_size);
+    for (size_t i = 0; i < node->file.line_size; i++) {
+        tasm_ast_t* line = node->file.lines[i];
+        if (line->tag == AST_PROC)
+            tasm_fuse_lines(&line->proc.lines, &line->proc.line_size);
+    }
+}
+
 void tasm_resolve_labels(tasm_translator_t *translator, tasm_ast_t* node, const char* prefix) {
     switch (node->tag) {
         case AST_NONE:
@@ -690,16 +1189,19 @@ void tasm_resolve_labels(tasm_translator_t *translator, tasm_ast_t* node, const
             } else {
                 name = (char*)node->label_decl.name;
             }
-            for (size_t i = 0; i < translator->symbols.label_decls_size; i++) {
+            bool duplicate = false;
+            for (size_t i = 0; i < translator->symbols.label_decls_size && !duplicate; i++) {
                 if (strcmp(translator->symbols.label_decls[i].name, name) == 0) {
                     fprintf(stderr, "%s:%d:%d:"CLR_RED"Duplicated label decleration:"CLR_END" %s\n", node->loc.file_name, node->loc.row, node->loc.col, name);
                     translator->symbols.err = true;
-                    exit(1);
+                    duplicate = true;
                 }
             }
+            // the first declaration wins, resolving goes on so every duplicate is reported
+            if (duplicate)
+                break;
             size_t addr = translator->symbols.label_address_pointer;
-            translator->symbols.label_decls[translator->symbols.label_decls_size].name = name;
-            translator->symbols.label_decls[translator->symbols.label_decls_size].addr = addr;
+            arrput(translator->symbols.label_decls, ((symbol_t) { .addr = addr, .name = name }));
             translator->symbols.label_decls_size++;
             break;
         }
@@ -730,16 +1232,19 @@ void tasm_resolve_procs(tasm_translator_t *translator, tasm_ast_t *node) {
             // TODO: hash tables or something can be used here as a performance improvement
             const char* name = node->proc.name;
             size_t addr = translator->symbols.proc_address_pointer;
-            for (size_t i = 0; i < translator->symbols.proc_decls_size; i++) {
+            bool duplicate = false;
+            for (size_t i = 0; i < translator->symbols.proc_decls_size && !duplicate; i++) {
                 if (strcmp(translator->symbols.proc_decls[i].name, name) == 0) {
                     fprintf(stderr, "%s:%d:%d:"CLR_RED"Duplicated proc decleration:"CLR_END" %s\n", node->loc.file_name, node->loc.row, node->loc.col, name);
                     translator->symbols.err = true;
-                    exit(1);
+                    duplicate = true;
                 }
             }
-            translator->symbols.proc_decls[translator->symbols.proc_decls_size].name = name;
-            translator->symbols.proc_decls[translator->symbols.proc_decls_size].addr = addr;
-            translator->symbols.proc_decls_size++;
+            // its body still takes addresses, so the procs after it keep theirs
+            if (!duplicate) {
+                arrput(translator->symbols.proc_decls, ((symbol_t) { .addr = addr, .name = name }));
+                translator->symbols.proc_decls_size++;
+            }
 
             for (size_t i = 0; i < node->proc.line_size; i++) {
                 tasm_resolve_procs(translator, node->proc.lines[i]);
@@ -752,7 +1257,9 @@ void tasm_resolve_procs(tasm_translator_t *translator, tasm_ast_t *node) {
 }
 
 static void program_push(tasm_translator_t* translator, opcode_t code) {
-    translator->program.code[translator->program.size++] = code;
+    arrput(translator->program.code, code);
+    arrput(translator->rows, translator->row);
+    translator->program.size++;
 }
 
 static size_t get_addr_from_label_decl_symbol(tasm_translator_t* translator, const char* name) {
@@ -782,6 +1289,29 @@ size_t get_addr_from_proc_decl_symbol(tasm_translator_t *translator, const char
     return -1;
 }
 
+static void tasm_write_uleb(FILE* file, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0)
+            byte |= 0x80;
+        fwrite(&byte, sizeof(byte), 1, file);
+    } while (value != 0);
+}
+
+static void tasm_write_sleb(FILE* file, int32_t value) {
+    for (;;) {
+        uint8_t byte = value & 0x7f;
+        value >>= 7; // arithmetic shift keeps the sign
+        bool done = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+        if (!done)
+            byte |= 0x80;
+        fwrite(&byte, sizeof(byte), 1, file);
+        if (done)
+            break;
+    }
+}
+
 void tasm_translator_generate_bin(tasm_translator_t *translator, cli_parsed_args_t args) {
     FILE* file;
     file = fopen(args.output_name, "wb");
@@ -822,11 +1352,13 @@ void tasm_translator_generate_bin(tasm_translator_t *translator, cli_parsed_args
                 uint8_t fun_name_len = strlen(fun_name);
                 uint16_t acount = translator->program.metadata.modules[k].cfuns[i].acount;
                 uint8_t rtype = translator->program.metadata.modules[k].cfuns[i].rtype;            
+                uint8_t flags = translator->program.metadata.modules[k].cfuns[i].flags;
                 
                 fwrite(&fun_name_len, sizeof(fun_name_len), 1, file);
                 fwrite(fun_name, sizeof(fun_name[0]), fun_name_len, file);
                 fwrite(&acount, sizeof(acount), 1, file);
                 fwrite(&rtype, sizeof(rtype), 1, file);
+                fwrite(&flags, sizeof(flags), 1, file);
                 for (size_t j = 0; j < acount; j++) {
                     uint8_t atype = translator->program.metadata.modules[k].cfuns[i].atypes[j];
                     fwrite(&atype, sizeof(atype), 1, file);
@@ -838,16 +1370,73 @@ void tasm_translator_generate_bin(tasm_translator_t *translator, cli_parsed_args
         size_t elem_len = 0;
         if (translator->program.const_table.referance_count > 0)
             elem_len = translator->program.const_table.data_size;
-        fwrite(&translator->program.const_table.referance_count, sizeof(size_t), 1, file);
-        fwrite(&translator->program.const_table.data_size, sizeof(size_t), 1, file);
+        fwrite(&translator->program.const_table.referance_count, sizeof(uint32_t), 1, file);
+        fwrite(&translator->program.const_table.data_size, sizeof(uint32_t), 1, file);
         if (translator->program.const_table.referance_count > 0) {
-            fwrite(translator->program.const_table.referances, sizeof(size_t), translator->program.const_table.referance_count, file);
+            fwrite(translator->program.const_table.referances, sizeof(uint32_t), translator->program.const_table.referance_count, file);
             fwrite(translator->program.const_table.data, sizeof(uint8_t), elem_len, file);
         }
     }
     
     fwrite(translator->program.code, sizeof(translator->program.code[0]), translator->program.size, file);
 
+//    .DEBUG, optional (tasm -s leaves it out), found through the trailer at the end of the file
+//      1 byte TVM_DEBUG_VERSION
+//      2 byte file name length, file name
+//      uleb run_count
+//    .run, instructions that share a row
+//         uleb instruction count, sleb row delta
+//      uleb symbol_count
+//    .symbol
+//         1 byte kind, uleb addr delta, uleb proc length
+//         1 byte name length, name
+//    .TRAILER
+//      4 byte debug section size, 4 byte TVM_DEBUG_MAGIC
+    if (!args.strip) {
+        long start = ftell(file);
+        uint8_t version = TVM_DEBUG_VERSION;
+        fwrite(&version, sizeof(version), 1, file);
+        uint16_t file_name_len = strlen(args.file_name);
+        fwrite(&file_name_len, sizeof(file_name_len), 1, file);
+        fwrite(args.file_name, sizeof(char), file_name_len, file);
+
+        uint32_t run_count = 0;
+        for (size_t i = 0; i < translator->program.size; i++) {
+            if (i == 0 || translator->rows[i] != translator->rows[i - 1])
+                run_count++;
+        }
+        tasm_write_uleb(file, run_count);
+        uint32_t row = 0;
+        for (size_t i = 0; i < translator->program.size;) {
+            size_t j = i + 1;
+            while (j < translator->program.size && translator->rows[j] == translator->rows[i])
+                j++;
+            tasm_write_uleb(file, j - i);
+            tasm_write_sleb(file, (int32_t)(translator->rows[i] - row));
+            row = translator->rows[i];
+            i = j;
+        }
+
+        uint32_t symbol_count = arrlenu(translator->debug_symbols);
+        tasm_write_uleb(file, symbol_count);
+        uint32_t addr = 0;
+        for (uint32_t i = 0; i < symbol_count; i++) {
+            tvm_debug_symbol_t* symbol = &translator->debug_symbols[i];
+            size_t len = strlen(symbol->name);
+            uint8_t name_len = len > UINT8_MAX ? UINT8_MAX : len;
+            fwrite(&symbol->kind, sizeof(symbol->kind), 1, file);
+            tasm_write_uleb(file, symbol->addr - addr);
+            tasm_write_uleb(file, symbol->kind == TVM_DEBUG_SYMBOL_PROC ? symbol->end - symbol->addr : 0);
+            fwrite(&name_len, sizeof(name_len), 1, file);
+            fwrite(symbol->name, sizeof(char), name_len, file);
+            addr = symbol->addr;
+        }
+        uint32_t debug_size = ftell(file) - start;
+        uint32_t magic = TVM_DEBUG_MAGIC;
+        fwrite(&debug_size, sizeof(debug_size), 1, file);
+        fwrite(&magic, sizeof(magic), 1, file);
+    }
+
     fclose(file);
     fprintf(stdout, "out.bin created "CLR_GREEN"successfully."CLR_END"\n");
 }
@@ -6,6 +6,7 @@
 #else
 #include <dlfcn.h>
 #endif
+#include <stdio.h>
 #include <common/arena.h>
 
 #include <tvm/tvm.h>
@@ -23,10 +24,23 @@
 #endif
 
 #define TCI_MODULE_CAPACITY 32
+#define TCI_LATENCY_BUCKETS 256 // four per power of two of nanoseconds
+
+// filled only after tci_stats_enable, async calls are counted when their result is pushed,
+// every field is updated with relaxed atomics so vms on other threads may share a tci
+typedef struct {
+    uint64_t calls;
+    uint64_t total_ns;    // inside ffi_call, the native and the libffi argument setup
+    uint64_t max_ns;
+    uint64_t overhead_ns; // the vm building the argument array before ffi_call
+    uint64_t latency[TCI_LATENCY_BUCKETS];
+} tci_native_stats_t;
 
 typedef struct {
     ffi_cif cif;
+    cfunptr_t fn; // resolved once by tci_metaprogram_to_ffi, NULL when the symbol is missing
     bool is_ok;
+    tci_native_stats_t stats;
 } tci_native_func_t;
 
 typedef struct {
@@ -36,26 +50,35 @@ typedef struct {
     uint32_t native_func_count;
 } tci_module_t;
 
-typedef struct {
+typedef struct tci {
     tci_module_t modules[TCI_MODULE_CAPACITY];
     size_t module_count;
     arena_t* ffi_arena;
+    bool stats; // natives are timed, see tci_stats_enable
 } tci_t;
 
 tci_t tci_init();
 void tci_destroy(tci_t* instance);
 
-void tci_load_module(tci_t* instance, const char* module_name);
-void tci_unload_all(tci_t* instance);
+// both report the error and return false, nothing exits the process
+bool tci_load_module(tci_t* instance, const char* module_name);
+bool tci_unload_all(tci_t* instance);
 
 
 void tci_prepare_last_module(tci_t* instance, uint32_t native_func_count);
-void tci_prepare_function(arena_t* arena, tci_native_func_t* function, uint8_t rtype, uint8_t* atypes, uint16_t acount);
+void tci_prepare_function(arena_t** arena, tci_native_func_t* function, uint8_t rtype, uint8_t* atypes, uint16_t acount);
 
 cfunptr_t tci_get_cfunction(tci_t* instance, /* TODO: give module name as param */ const char* func_name);
 
 void tci_metaprogram_to_ffi(tci_t* instance, tvm_t* vm);
-void tci_native_call(tvm_t* vm, uint32_t id, void* rvalue, void** avalues);
+// false when the native can not be called, the vm raises EXCEPT_INVALID_NATIVE_FUNCTION_ACCESS
+bool tci_native_call(tvm_t* vm, uint32_t id, void* rvalue, void** avalues, uint64_t start_ns);
+
+void tci_stats_enable(tci_t* instance);
+// one line per native that was called, the most expensive first
+void tci_stats_write(tci_t* instance, tvm_t* vm, FILE* out);
+// async signal safe, the counters are written to stderr by the next native call
+void tci_stats_request_dump();
 
 ffi_type* tci_ctype_to_ffi_type(uint8_t ctype);
 
@@ -9,6 +9,8 @@
 #include <stddef.h>
 #include <assert.h>
 
+#include <common/ttime.h>
+
 _Static_assert(sizeof(void*) == sizeof(uintptr_t), "Incompetible pointer size on the current architecture!");
 
 typedef struct gc_block gc_block;
@@ -27,83 +29,291 @@ struct gc_block {
     int64_t marked;
 };
 
-uintptr_t tgc_create_block(size_t size, size_t pointer_count);
-void tgc_mark(void* ptr);
-void tgc_sweep();
+#define TGC_PAUSE_BUCKETS 48     // powers of two of nanoseconds
+#define TGC_SIZE_CLASSES 24      // powers of two of bytes, the last one takes everything bigger
+#define TGC_SIZE_CLASS_MIN_LOG2 4 // blocks up to 16 bytes share the first class
+#define TGC_MIN_THRESHOLD (256 * 1024) // bytes, the next collection starts at twice what the last one kept but never below this
+
+// collection counters, reset with the heap
+typedef struct {
+    uint64_t cycles;
+    uint64_t freed_count;
+    uint64_t freed_bytes;
+    uint64_t mark_ns; // summed over every cycle
+    uint64_t sweep_ns;
+    uint64_t max_pause_ns;
+    uint64_t pauses[TGC_PAUSE_BUCKETS]; // mark and sweep of one cycle
+    size_t live_count; // after the last cycle
+    size_t live_bytes;
+} tgc_stats_t;
+
+// one heap per vm, blocks are allocated one by one so their addresses never change
+typedef struct {
+    gc_block** blocks; // stb_ds array, sorted by address while a collection marks
+    gc_block** gray;   // stb_ds array, marked blocks whose values are not scanned yet
+    size_t block_count;
+    size_t counter;    // instructions since the last collection
+    size_t threshold;  // live bytes that start the next collection
+    size_t alloc_count; // blocks created since the last reset
+    size_t alloc_bytes;
+    size_t live_bytes;  // bytes of the blocks in the heap right now
+    size_t peak_bytes;
+    uint64_t start_ns;  // of the heap, for allocation rates
+    tgc_stats_t stats;
+    FILE* dump_out;     // see tgc_stats_dump_every
+    uint64_t dump_interval_ns;
+    uint64_t dump_last_ns;
+} tgc_t;
+
+tgc_t tgc_init();
+// 0 when the block or its value can not be allocated
+uintptr_t tgc_create_block(tgc_t* gc, size_t size, size_t pointer_count);
+// sorts the blocks so tgc_find_block can tell block addresses from other words, done before marking
+void tgc_index(tgc_t* gc);
+// NULL when ptr is not the address of a block, only valid after tgc_index
+gc_block* tgc_find_block(const tgc_t* gc, uintptr_t ptr);
+// the caller scans the values of the blocks left in gc->gray for more pointers
+void tgc_mark(tgc_t* gc, gc_block* block);
+void tgc_sweep(tgc_t* gc);
+void tgc_reset(tgc_t* gc);
+void tgc_destroy(tgc_t* gc);
+
+// counts one mark and sweep cycle, the caller times its own mark phase
+void tgc_stats_cycle(tgc_t* gc, uint64_t mark_ns, uint64_t sweep_ns);
+// blocks and bytes in the heap right now by size class
+void tgc_size_classes(const tgc_t* gc, uint64_t* counts, uint64_t* bytes);
+void tgc_stats_write(const tgc_t* gc, FILE* out);
+// writes the stats to out from allocations and collections at most once per interval_ms, 0 turns it off
+void tgc_stats_dump_every(tgc_t* gc, FILE* out, uint64_t interval_ms);
 
 #ifdef TGC_IMPLEMENTATION
 
 #define STB_DS_IMPLEMENTATION
 #include <stb_ds.h>
 
-gc_block* __heap = NULL;
-size_t __heap_block_count = 0;
+tgc_t tgc_init() {
+    return (tgc_t) {
+        .blocks = NULL,
+        .gray = NULL,
+        .block_count = 0,
+        .counter = 0,
+        .threshold = TGC_MIN_THRESHOLD,
+        .alloc_count = 0,
+        .alloc_bytes = 0,
+        .live_bytes = 0,
+        .peak_bytes = 0,
+        .start_ns = ttime_now_ns(),
+        .stats = {0},
+        .dump_out = NULL,
+        .dump_interval_ns = 0,
+        .dump_last_ns = 0,
+    };
+}
+
+static void tgc_stats_dump_check(tgc_t* gc) {
+    uint64_t now = ttime_now_ns();
+    if (now - gc->dump_last_ns < gc->dump_interval_ns)
+        return;
+    gc->dump_last_ns = now;
+    tgc_stats_write(gc, gc->dump_out);
+}
 
-uintptr_t tgc_create_block(size_t size, size_t pointer_count) {
-    gc_block block = (gc_block) {
+uintptr_t tgc_create_block(tgc_t* gc, size_t size, size_t pointer_count) {
+    // pointer slots are placed right after the block, like they used to be in the shared heap array
+    gc_block* block = calloc(pointer_count + 1, sizeof(gc_block));
+    if (block == NULL)
+        return 0;
+    *block = (gc_block) {
         .size = size,
         .value = malloc(size),
         .pointers = NULL,
         .pointer_count = pointer_count,
         .marked = false,
     };
-    // put the block to the heap
-    arrput(__heap, block);
-
-    // add pointers after the allocated the block
-    if (pointer_count != 0)
-        arraddnptr(__heap, pointer_count);
-    
-    uintptr_t block_addr = (uintptr_t)&__heap[__heap_block_count];
-    __heap_block_count += pointer_count + 1;
-
-    if ((uintptr_t)block.value % 8 != 0) {
-        fprintf(stderr, "tgc_create_block: Misaligned value=%p\n", block.value);
+    if (block->value == NULL && size > 0) {
+        free(block);
+        return 0;
     }
+    arrput(gc->blocks, block);
+    gc->block_count++;
+    gc->alloc_count++;
+    gc->alloc_bytes += size;
+    gc->live_bytes += size;
+    if (gc->live_bytes > gc->peak_bytes)
+        gc->peak_bytes = gc->live_bytes;
+    if (gc->dump_out != NULL)
+        tgc_stats_dump_check(gc);
 
-    // printf("heap_size: %llu\n", __heap_block_count);
-    // TODO: set the array capacity of heap bigger than 10 (10 is default, use arrsetcap)
-    // printf("cap: %llu\n", arrcap(__heap));
-    // printf("last_block_addr: %p\n", block_addr);
-    // printf("sizeof(uintptr_t): %d\nsizeof(uint64_t): %d\n", sizeof(uintptr_t), sizeof(uint64_t));
-    return block_addr;
+    if ((uintptr_t)block->value % 8 != 0) {
+        fprintf(stderr, "tgc_create_block: Misaligned value=%p\n", block->value);
+    }
+    return (uintptr_t)block;
 }
 
-void tgc_mark(void* root) {
-    if (root == NULL) return;
-    gc_block* block = (gc_block*)root;
-    if (block->marked) return; // Already marked
+static int tgc_block_compare(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)*(gc_block* const*)a;
+    uintptr_t y = (uintptr_t)*(gc_block* const*)b;
+    return x < y ? -1 : x > y;
+}
 
-    block->marked = 1;
+void tgc_index(tgc_t* gc) {
+    qsort(gc->blocks, arrlenu(gc->blocks), sizeof(gc_block*), tgc_block_compare);
+}
 
-    // Recursively mark pointers inside the block
-    for (size_t i = 0; i < arrlenu(block->pointers); i++) {
-        void* child = &block->pointers[i];
-        tgc_mark(child);
+gc_block* tgc_find_block(const tgc_t* gc, uintptr_t ptr) {
+    size_t low = 0, high = arrlenu(gc->blocks);
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        uintptr_t block = (uintptr_t)gc->blocks[mid];
+        if (block == ptr)
+            return gc->blocks[mid];
+        if (block < ptr)
+            low = mid + 1;
+        else
+            high = mid;
     }
+    return NULL;
+}
+
+void tgc_mark(tgc_t* gc, gc_block* block) {
+    if (block == NULL || block->marked)
+        return;
+    block->marked = 1;
+    // a gray list instead of recursion, long linked lists would overflow the C stack
+    arrput(gc->gray, block);
+}
+
+static void tgc_free_block(gc_block* block) {
+    free(block->value);
+    free(block);
 }
 
-void tgc_sweep() {
-    for (size_t i = 0; i < arrlenu(__heap); i++) {
-        if (__heap[i].marked) {
-            __heap[i].marked = 0;
-            printf("marked!\n");
+void tgc_sweep(tgc_t* gc) {
+    for (size_t i = 0; i < arrlenu(gc->blocks);) {
+        gc_block* block = gc->blocks[i];
+        if (block->marked) {
+            block->marked = 0;
+            i++;
         } else {
-            arrdel(__heap, i);
-            __heap_block_count--;
-            if (__heap[i].value)
-                free(__heap[i].value);
-            printf("unmarked deleted\n");
+            // the last block takes this slot, so do not advance
+            arrdelswap(gc->blocks, i);
+            gc->block_count--;
+            gc->live_bytes -= block->size;
+            gc->stats.freed_count++;
+            gc->stats.freed_bytes += block->size;
+            tgc_free_block(block);
         }
     }
+    gc->counter = 0;
+    gc->threshold = gc->live_bytes * 2 > TGC_MIN_THRESHOLD ? gc->live_bytes * 2 : TGC_MIN_THRESHOLD;
 }
 
-void tgc_destroy() {
-    // tgc_sweep();
-    arrfree(__heap);
+// frees every block but keeps the block array, so a reused vm does not regrow it
+void tgc_reset(tgc_t* gc) {
+    for (size_t i = 0; i < arrlenu(gc->blocks); i++) {
+        tgc_free_block(gc->blocks[i]);
+    }
+    // arrsetlen(a, 0) trips -Wtype-limits inside stb_ds, so the lengths are cleared by hand
+    if (gc->blocks != NULL)
+        stbds_header(gc->blocks)->length = 0;
+    if (gc->gray != NULL)
+        stbds_header(gc->gray)->length = 0;
+    gc->block_count = 0;
+    gc->counter = 0;
+    gc->threshold = TGC_MIN_THRESHOLD;
+    gc->alloc_count = 0;
+    gc->alloc_bytes = 0;
+    gc->live_bytes = 0;
+    gc->peak_bytes = 0;
+    gc->start_ns = ttime_now_ns();
+    gc->stats = (tgc_stats_t) {0};
+}
+
+void tgc_destroy(tgc_t* gc) {
+    tgc_reset(gc);
+    arrfree(gc->blocks);
+    arrfree(gc->gray);
+}
+
+static uint32_t tgc_log2(uint64_t value) {
+    uint32_t log2 = 0;
+    while (value >>= 1)
+        log2++;
+    return log2;
 }
 
+void tgc_stats_cycle(tgc_t* gc, uint64_t mark_ns, uint64_t sweep_ns) {
+    uint64_t pause = mark_ns + sweep_ns;
+    uint32_t bucket = tgc_log2(pause);
+    gc->stats.cycles++;
+    gc->stats.mark_ns += mark_ns;
+    gc->stats.sweep_ns += sweep_ns;
+    if (pause > gc->stats.max_pause_ns)
+        gc->stats.max_pause_ns = pause;
+    gc->stats.pauses[bucket < TGC_PAUSE_BUCKETS ? bucket : TGC_PAUSE_BUCKETS - 1]++;
+    gc->stats.live_count = gc->block_count;
+    gc->stats.live_bytes = gc->live_bytes;
+    if (gc->dump_out != NULL)
+        tgc_stats_dump_check(gc);
+}
+
+void tgc_size_classes(const tgc_t* gc, uint64_t* counts, uint64_t* bytes) {
+    memset(counts, 0, sizeof(uint64_t) * TGC_SIZE_CLASSES);
+    memset(bytes, 0, sizeof(uint64_t) * TGC_SIZE_CLASSES);
+    for (size_t i = 0; i < arrlenu(gc->blocks); i++) {
+        uint64_t size = gc->blocks[i]->size;
+        // rounded up, a 17 byte block is in the 32 byte class
+        uint32_t log2 = size > 1 ? tgc_log2(size - 1) + 1 : 0;
+        uint32_t class = log2 > TGC_SIZE_CLASS_MIN_LOG2 ? log2 - TGC_SIZE_CLASS_MIN_LOG2 : 0;
+        if (class >= TGC_SIZE_CLASSES)
+            class = TGC_SIZE_CLASSES - 1;
+        counts[class]++;
+        bytes[class] += size;
+    }
+}
+
+void tgc_stats_write(const tgc_t* gc, FILE* out) {
+    const tgc_stats_t* stats = &gc->stats;
+    double seconds = (ttime_now_ns() - gc->start_ns) / 1e9;
+    fprintf(out, "gc: allocated %zu blocks, %zu bytes", gc->alloc_count, gc->alloc_bytes);
+    if (seconds > 0.0)
+        fprintf(out, " (%.1f KB/s)", gc->alloc_bytes / 1024.0 / seconds);
+    fprintf(out, "\n    live %zu blocks, %zu bytes, peak %zu bytes\n", gc->block_count, gc->live_bytes, gc->peak_bytes);
+    fprintf(out, "    %llu cycles, freed %llu blocks, %llu bytes\n", (unsigned long long)stats->cycles,
+        (unsigned long long)stats->freed_count, (unsigned long long)stats->freed_bytes);
+    if (stats->cycles > 0) {
+        fprintf(out, "    last cycle kept %zu blocks, %zu bytes\n", stats->live_count, stats->live_bytes);
+        fprintf(out, "    mark %.3f ms, sweep %.3f ms, mean pause %.1f us, max pause %.1f us\n",
+            stats->mark_ns / 1e6, stats->sweep_ns / 1e6,
+            (stats->mark_ns + stats->sweep_ns) / 1e3 / stats->cycles, stats->max_pause_ns / 1e3);
+        fprintf(out, "    pauses:\n");
+        for (int i = 0; i < TGC_PAUSE_BUCKETS; i++) {
+            if (stats->pauses[i] != 0)
+                fprintf(out, "      < %12.1f us %10llu\n", (double)(2ull << i) / 1e3, (unsigned long long)stats->pauses[i]);
+        }
+    }
+
+    uint64_t counts[TGC_SIZE_CLASSES], bytes[TGC_SIZE_CLASSES];
+    tgc_size_classes(gc, counts, bytes);
+    if (gc->block_count > 0)
+        fprintf(out, "    size classes:\n");
+    for (int i = 0; i < TGC_SIZE_CLASSES; i++) {
+        if (counts[i] == 0)
+            continue;
+        if (i == TGC_SIZE_CLASSES - 1)
+            fprintf(out, "      > %10llu B", 1ull << (i + TGC_SIZE_CLASS_MIN_LOG2 - 1));
+        else
+            fprintf(out, "     <= %10llu B", 1ull << (i + TGC_SIZE_CLASS_MIN_LOG2));
+        fprintf(out, " %10llu blocks %12llu bytes\n", (unsigned long long)counts[i], (unsigned long long)bytes[i]);
+    }
+}
+
+void tgc_stats_dump_every(tgc_t* gc, FILE* out, uint64_t interval_ms) {
+    gc->dump_out = interval_ms > 0 ? out : NULL;
+    gc->dump_interval_ns = interval_ms * 1000000ull;
+    gc->dump_last_ns = ttime_now_ns();
+}
 
 #endif//TGC_IMPLEMENTATION
 
-#endif//TGC_H_
\ No newline at end of file
+#endif//TGC_H_
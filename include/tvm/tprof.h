@@ -0,0 +1,217 @@
+#ifndef TPROF_H_
+#define TPROF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <common/cmd_colors.h>
+#include <tvm/tvm.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#define TPROF_DEFAULT_HZ 1000
+#define TPROF_DEFAULT_CAPACITY (1 << 21) // words, 8MB
+#define TPROF_MAX_DEPTH 64               // deeper call chains keep their innermost frames
+
+/*
+    A SIGPROF timer samples the ip and the return stack of the thread that called tprof_start.
+    The handler only appends to a preallocated buffer, mapping samples to procs and source rows
+    through the debug section is left to tprof_write_folded once the run is over.
+*/
+typedef struct {
+    tvm_t* vm;
+    uint32_t* samples; // per sample: depth, ip, then depth return addresses innermost first
+    size_t capacity;   // in words
+    volatile size_t used;
+    volatile uint64_t count;
+    volatile uint64_t dropped; // samples that did not fit
+    int hz;
+    bool running;
+#ifndef _WIN32
+    pthread_t thread;
+    struct sigaction old_action;
+#endif
+} tprof_t;
+
+bool tprof_start(tprof_t* prof, tvm_t* vm, int hz, size_t capacity);
+void tprof_stop(tprof_t* prof);
+// one "outer;...;inner count" line per distinct stack, the format flamegraph.pl and speedscope read
+bool tprof_write_folded(tprof_t* prof, FILE* out);
+void tprof_destroy(tprof_t* prof);
+
+#ifdef TPROF_IMPLEMENTATION
+#undef TPROF_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stb_ds.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+
+static tprof_t* volatile tprof_active = NULL;
+
+static void tprof_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    tprof_t* prof = tprof_active;
+    // ITIMER_PROF counts the whole process, samples that land on a pool thread are not ours
+    if (prof == NULL || !pthread_equal(pthread_self(), prof->thread)) {
+        errno = saved_errno;
+        return;
+    }
+    tvm_t* vm = prof->vm;
+    word_t rsp = vm->rsp;
+    if (rsp > RETURN_STACK_CAPACITY)
+        rsp = RETURN_STACK_CAPACITY;
+    word_t depth = rsp > TPROF_MAX_DEPTH ? TPROF_MAX_DEPTH : rsp;
+    size_t used = prof->used;
+    if (used + depth + 2 > prof->capacity) {
+        prof->dropped++;
+    } else {
+        uint32_t* sample = &prof->samples[used];
+        sample[0] = depth;
+        sample[1] = vm->ip;
+        for (word_t i = 0; i < depth; i++)
+            sample[2 + i] = vm->return_stack[rsp - 1 - i];
+        prof->used = used + depth + 2;
+        prof->count++;
+    }
+    errno = saved_errno;
+}
+
+bool tprof_start(tprof_t* prof, tvm_t* vm, int hz, size_t capacity) {
+    if (tprof_active != NULL) {
+        fprintf(stderr, CLR_RED"tprof: "CLR_END"only one profiler can run at a time\n");
+        return false;
+    }
+    *prof = (tprof_t) {
+        .vm = vm,
+        .samples = malloc(sizeof(uint32_t) * capacity),
+        .capacity = capacity,
+        .used = 0,
+        .count = 0,
+        .dropped = 0,
+        .hz = hz > 0 ? hz : TPROF_DEFAULT_HZ,
+        .running = false,
+        .thread = pthread_self(),
+    };
+    if (prof->samples == NULL)
+        return false;
+    tprof_active = prof;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = tprof_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &prof->old_action) != 0) {
+        tprof_active = NULL;
+        return false;
+    }
+
+    struct itimerval timer = {0};
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / prof->hz;
+    if (timer.it_interval.tv_usec == 0)
+        timer.it_interval.tv_usec = 1;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &prof->old_action, NULL);
+        tprof_active = NULL;
+        return false;
+    }
+    prof->running = true;
+    return true;
+}
+
+void tprof_stop(tprof_t* prof) {
+    if (!prof->running)
+        return;
+    struct itimerval timer = {0};
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &prof->old_action, NULL);
+    tprof_active = NULL;
+    prof->running = false;
+}
+
+#else
+
+bool tprof_start(tprof_t* prof, tvm_t* vm, int hz, size_t capacity) {
+    (void)capacity;
+    *prof = (tprof_t) { .vm = vm, .hz = hz };
+    fprintf(stderr, CLR_YELLOW"tprof: "CLR_END"sampling needs SIGPROF, profiling is off on windows\n");
+    return false;
+}
+
+void tprof_stop(tprof_t* prof) {
+    (void)prof;
+}
+
+#endif
+
+// "proc:row", or the top level label, or the bare address without debug info
+static int tprof_frame_name(const tvm_program_t* program, word_t addr, char* buf, size_t size) {
+    const tvm_debug_symbol_t* symbol = tvm_debug_symbol(program, addr);
+    uint32_t row = tvm_debug_line(program, addr);
+    if (symbol != NULL && row != 0)
+        return snprintf(buf, size, "%s:%u", symbol->name, row);
+    if (row != 0)
+        return snprintf(buf, size, "%s:%u", program->debug.file_name, row);
+    return snprintf(buf, size, "0x%x", addr);
+}
+
+bool tprof_write_folded(tprof_t* prof, FILE* out) {
+    if (prof->samples == NULL)
+        return false;
+    tvm_debug_map(&prof->vm->program);
+    const tvm_program_t* program = &prof->vm->program;
+    struct { char* key; uint64_t value; }* stacks = NULL;
+    sh_new_arena(stacks);
+
+    char line[TPROF_MAX_DEPTH * 96];
+    size_t cursor = 0;
+    while (cursor < prof->used) {
+        uint32_t* sample = &prof->samples[cursor];
+        uint32_t depth = sample[0];
+        size_t len = 0;
+        // outermost caller first, a return address points one past its call
+        for (uint32_t i = depth; i > 0 && len < sizeof(line); i--) {
+            uint32_t call = sample[1 + i] > 0 ? sample[1 + i] - 1 : 0;
+            len += tprof_frame_name(program, call, line + len, sizeof(line) - len);
+            if (len < sizeof(line))
+                line[len++] = ';';
+        }
+        if (len < sizeof(line))
+            tprof_frame_name(program, sample[1], line + len, sizeof(line) - len);
+        line[sizeof(line) - 1] = '\0';
+
+        ptrdiff_t index = shgeti(stacks, line);
+        if (index < 0)
+            shput(stacks, line, 1);
+        else
+            stacks[index].value++;
+        cursor += depth + 2;
+    }
+
+    for (size_t i = 0; i < (size_t)shlen(stacks); i++)
+        fprintf(out, "%s %llu\n", stacks[i].key, (unsigned long long)stacks[i].value);
+    shfree(stacks);
+    return true;
+}
+
+void tprof_destroy(tprof_t* prof) {
+    tprof_stop(prof);
+    free(prof->samples);
+    prof->samples = NULL;
+}
+
+#endif//TPROF_IMPLEMENTATION
+
+#endif//TPROF_H_
@@ -0,0 +1,434 @@
+#ifndef TSNAP_H_
+#define TSNAP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <tvm/tvm.h>
+
+/*
+    A snapshot is a vm stopped on a ckpt instruction, written out so a later run starts
+    right after it: the init phase, the constant table and the program loading are all skipped.
+
+    header     u32 magic, u32 version
+    vm         ip, icount, sp and the stack, rsp and the return stack,
+               frame count and the locals of every frame from the root, globals
+    heap       block count, then size, pointer count and value bytes of every block
+    relocs     count, then one tsnap_reloc_t per word that holds a heap or constant address
+    program    the image tvm_program_write writes, up to the end of the file
+
+    Addresses are saved as a block (or the constant table) plus an offset and patched on load.
+    Stack slots, locals and globals are relocated when their tag says they hold an address,
+    in heap values only the tagged words 8 byte hset/hsetof store are (see tvm_heap_word),
+    an address written there any other way, with mcopy from a native say, is saved as is.
+    Natives are not part of it, the host loads the module and binds the cfuns again.
+*/
+
+#define TSNAP_MAGIC 0x504e5354 // "TSNP"
+#define TSNAP_VERSION 2 // 1 relocated untagged heap words
+
+typedef enum {
+    TSNAP_WHERE_STACK,
+    TSNAP_WHERE_LOCAL,  // index is frame * TVM_MAX_LOCAL_VAR + slot, frame 0 is the root
+    TSNAP_WHERE_GLOBAL,
+    TSNAP_WHERE_HEAP,   // index is the block, offset the byte offset in its value
+} tsnap_where_t;
+
+typedef enum {
+    TSNAP_TARGET_BLOCK, // the gc_block header, what halloc pushes
+    TSNAP_TARGET_VALUE, // the bytes of a block
+    TSNAP_TARGET_CONST, // the constant table data
+} tsnap_target_t;
+
+typedef struct {
+    uint8_t where;  // tsnap_where_t
+    uint8_t target; // tsnap_target_t
+    uint16_t reserved;
+    uint32_t index;
+    uint32_t offset;
+    uint32_t target_index;  // block, unused for constants
+    uint64_t target_offset;
+} tsnap_reloc_t;
+
+_Static_assert(sizeof(tsnap_reloc_t) == 24, "tsnap_reloc_t is written as is");
+
+// false when the vm can not be saved: fibers, a native call in flight or a parallel worker
+bool tsnap_write(tvm_t* vm, FILE* out);
+bool tsnap_save(tvm_t* vm, const char* file_name);
+// vm must come straight from tvm_init, the program is loaded from the snapshot
+bool tsnap_load_from_buffer(tvm_t* vm, const uint8_t* buffer, size_t size);
+bool tsnap_load(tvm_t* vm, const char* file_name);
+
+#ifdef TSNAP_IMPLEMENTATION
+#undef TSNAP_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <stb_ds.h>
+#include <common/cmd_colors.h>
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    uint8_t target;
+    uint32_t index;
+} tsnap_range_t;
+
+static int tsnap_range_compare(const void* a, const void* b) {
+    const tsnap_range_t* x = a;
+    const tsnap_range_t* y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// every address range a saved word may point into, sorted by start, the caller frees the result
+static tsnap_range_t* tsnap_ranges(tvm_t* vm, size_t* count) {
+    size_t block_count = arrlenu(vm->gc.blocks);
+    tsnap_range_t* ranges = malloc(sizeof(tsnap_range_t) * (2 * block_count + 1));
+    size_t len = 0;
+    for (size_t i = 0; i < block_count; i++) {
+        gc_block* block = vm->gc.blocks[i];
+        ranges[len++] = (tsnap_range_t) {
+            .start = (uintptr_t)block,
+            .end = (uintptr_t)(block + block->pointer_count + 1),
+            .target = TSNAP_TARGET_BLOCK,
+            .index = (uint32_t)i,
+        };
+        if (block->size > 0) {
+            ranges[len++] = (tsnap_range_t) {
+                .start = (uintptr_t)block->value,
+                .end = (uintptr_t)block->value + block->size,
+                .target = TSNAP_TARGET_VALUE,
+                .index = (uint32_t)i,
+            };
+        }
+    }
+    const tvm_const_table* table = &vm->program.const_table;
+    if (table->data != NULL && table->data_size > 0) {
+        ranges[len++] = (tsnap_range_t) {
+            .start = (uintptr_t)table->data,
+            .end = (uintptr_t)table->data + table->data_size,
+            .target = TSNAP_TARGET_CONST,
+            .index = 0,
+        };
+    }
+    qsort(ranges, len, sizeof(tsnap_range_t), tsnap_range_compare);
+    *count = len;
+    return ranges;
+}
+
+static const tsnap_range_t* tsnap_find(const tsnap_range_t* ranges, size_t count, uintptr_t addr) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (addr < ranges[mid].start)
+            hi = mid;
+        else if (addr >= ranges[mid].end)
+            lo = mid + 1;
+        else
+            return &ranges[mid];
+    }
+    return NULL;
+}
+
+static void tsnap_reloc_add(tsnap_reloc_t** relocs, const tsnap_range_t* ranges, size_t count,
+                            uintptr_t addr, tsnap_where_t where, uint32_t index, uint32_t offset) {
+    const tsnap_range_t* range = tsnap_find(ranges, count, addr);
+    if (range == NULL)
+        return;
+    tsnap_reloc_t reloc = {
+        .where = where,
+        .target = range->target,
+        .index = index,
+        .offset = offset,
+        .target_index = range->index,
+        .target_offset = addr - range->start,
+    };
+    arrput(*relocs, reloc);
+}
+
+static void tsnap_reloc_object(tsnap_reloc_t** relocs, const tsnap_range_t* ranges, size_t count,
+                               object_t obj, tsnap_where_t where, uint32_t index, uint32_t offset) {
+    uint64_t type = obj.raw >> TVM_OBJECT_TAG_SHIFT;
+    if (type == STACK_OBJ_TYPE_DATA_ADDRESS || type == STACK_OBJ_TYPE_CONST_ADDRESS)
+        tsnap_reloc_add(relocs, ranges, count, TVM_OBJECT_PTR(obj), where, index, offset);
+}
+
+// the frame chain from the root to the current frame, the caller frees the result
+static tvm_frame_t** tsnap_frames(tvm_t* vm, uint32_t* count) {
+    uint32_t len = 1;
+    for (tvm_frame_t* frame = vm->frame; frame->prev != NULL; frame = frame->prev)
+        len++;
+    tvm_frame_t** frames = malloc(sizeof(tvm_frame_t*) * len);
+    tvm_frame_t* frame = vm->frame;
+    for (uint32_t i = len; i-- > 0; frame = frame->prev)
+        frames[i] = frame;
+    *count = len;
+    return frames;
+}
+
+bool tsnap_write(tvm_t* vm, FILE* out) {
+    if (vm->sched.fibers != NULL || vm->pending != NULL || vm->blocked || vm->parallel || vm->halted) {
+        fprintf(stderr, CLR_RED"Snapshot: "CLR_END"the vm must be on a ckpt of the main program with no native call in flight\n");
+        return false;
+    }
+
+    uint32_t header[2] = { TSNAP_MAGIC, TSNAP_VERSION };
+    fwrite(header, sizeof(uint32_t), 2, out);
+    fwrite(&vm->ip, sizeof(word_t), 1, out);
+    fwrite(&vm->icount, sizeof(uint64_t), 1, out);
+    fwrite(&vm->sp, sizeof(word_t), 1, out);
+    fwrite(vm->stack, sizeof(object_t), vm->sp, out);
+    fwrite(&vm->rsp, sizeof(word_t), 1, out);
+    fwrite(vm->return_stack, sizeof(word_t), vm->rsp, out);
+
+    uint32_t frame_count;
+    tvm_frame_t** frames = tsnap_frames(vm, &frame_count);
+    fwrite(&frame_count, sizeof(uint32_t), 1, out);
+    for (uint32_t i = 0; i < frame_count; i++)
+        fwrite(frames[i]->local_vars, sizeof(object_t), TVM_MAX_LOCAL_VAR, out);
+    fwrite(vm->gframe->global_vars, sizeof(object_t), TVM_MAX_GLOBAL_VAR, out);
+
+    uint32_t block_count = (uint32_t)arrlenu(vm->gc.blocks);
+    fwrite(&block_count, sizeof(uint32_t), 1, out);
+    for (uint32_t i = 0; i < block_count; i++) {
+        gc_block* block = vm->gc.blocks[i];
+        fwrite(&block->size, sizeof(uint64_t), 1, out);
+        fwrite(&block->pointer_count, sizeof(uint64_t), 1, out);
+        fwrite(block->value, 1, block->size, out);
+    }
+
+    size_t range_count;
+    tsnap_range_t* ranges = tsnap_ranges(vm, &range_count);
+    tsnap_reloc_t* relocs = NULL;
+    for (word_t i = 0; i < vm->sp; i++)
+        tsnap_reloc_object(&relocs, ranges, range_count, vm->stack[i], TSNAP_WHERE_STACK, i, 0);
+    for (uint32_t f = 0; f < frame_count; f++) {
+        for (uint32_t i = 0; i < TVM_MAX_LOCAL_VAR; i++)
+            tsnap_reloc_object(&relocs, ranges, range_count, frames[f]->local_vars[i], TSNAP_WHERE_LOCAL, f * TVM_MAX_LOCAL_VAR + i, 0);
+    }
+    for (uint32_t i = 0; i < TVM_MAX_GLOBAL_VAR; i++)
+        tsnap_reloc_object(&relocs, ranges, range_count, vm->gframe->global_vars[i], TSNAP_WHERE_GLOBAL, i, 0);
+    for (uint32_t i = 0; i < block_count; i++) {
+        gc_block* block = vm->gc.blocks[i];
+        // hsetof may have put them at any byte offset
+        for (uint32_t offset = 0; offset + sizeof(object_t) <= block->size; offset++) {
+            object_t obj;
+            memcpy(&obj.raw, (uint8_t*)block->value + offset, sizeof(obj.raw));
+            tsnap_reloc_object(&relocs, ranges, range_count, obj, TSNAP_WHERE_HEAP, i, offset);
+        }
+    }
+    uint32_t reloc_count = (uint32_t)arrlenu(relocs);
+    fwrite(&reloc_count, sizeof(uint32_t), 1, out);
+    fwrite(relocs, sizeof(tsnap_reloc_t), reloc_count, out);
+    arrfree(relocs);
+    free(ranges);
+    free(frames);
+
+    return tvm_program_write(&vm->program, out);
+}
+
+bool tsnap_save(tvm_t* vm, const char* file_name) {
+    FILE* out = fopen(file_name, "wb");
+    if (out == NULL) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return false;
+    }
+    bool ok = tsnap_write(vm, out);
+    ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t cursor;
+} tsnap_reader_t;
+
+static bool tsnap_read(tsnap_reader_t* reader, void* dst, size_t size) {
+    if (size > reader->size - reader->cursor)
+        return false;
+    memcpy(dst, &reader->data[reader->cursor], size);
+    reader->cursor += size;
+    return true;
+}
+
+static bool tsnap_relocate(tvm_t* vm, const tsnap_reloc_t* reloc, tvm_frame_t** frames, uint32_t frame_count) {
+    gc_block** blocks = vm->gc.blocks;
+    size_t block_count = arrlenu(blocks);
+    uintptr_t base;
+    uint64_t limit;
+    switch (reloc->target) {
+    case TSNAP_TARGET_BLOCK:
+        if (reloc->target_index >= block_count)
+            return false;
+        base = (uintptr_t)blocks[reloc->target_index];
+        limit = sizeof(gc_block) * (blocks[reloc->target_index]->pointer_count + 1);
+        break;
+    case TSNAP_TARGET_VALUE:
+        if (reloc->target_index >= block_count)
+            return false;
+        base = (uintptr_t)blocks[reloc->target_index]->value;
+        limit = blocks[reloc->target_index]->size;
+        break;
+    case TSNAP_TARGET_CONST:
+        base = (uintptr_t)vm->program.const_table.data;
+        limit = vm->program.const_table.data_size;
+        break;
+    default:
+        return false;
+    }
+    if (reloc->target_offset >= limit)
+        return false;
+    uintptr_t addr = base + reloc->target_offset;
+
+    object_t* slot;
+    switch (reloc->where) {
+    case TSNAP_WHERE_STACK:
+        if (reloc->index >= vm->sp)
+            return false;
+        slot = &vm->stack[reloc->index];
+        break;
+    case TSNAP_WHERE_LOCAL:
+        if (reloc->index / TVM_MAX_LOCAL_VAR >= frame_count)
+            return false;
+        slot = &frames[reloc->index / TVM_MAX_LOCAL_VAR]->local_vars[reloc->index % TVM_MAX_LOCAL_VAR];
+        break;
+    case TSNAP_WHERE_GLOBAL:
+        if (reloc->index >= TVM_MAX_GLOBAL_VAR)
+            return false;
+        slot = &vm->gframe->global_vars[reloc->index];
+        break;
+    case TSNAP_WHERE_HEAP: {
+        if (reloc->index >= block_count || (uint64_t)reloc->offset + sizeof(uint64_t) > blocks[reloc->index]->size)
+            return false;
+        uint8_t* dst = (uint8_t*)blocks[reloc->index]->value + reloc->offset;
+        object_t obj;
+        memcpy(&obj.raw, dst, sizeof(obj.raw));
+        obj = tvm_object_ptr(TVM_OBJECT_TYPE(obj), addr);
+        memcpy(dst, &obj.raw, sizeof(obj.raw));
+        return true;
+    }
+    default:
+        return false;
+    }
+    *slot = tvm_object_ptr(TVM_OBJECT_TYPE(*slot), addr);
+    return true;
+}
+
+bool tsnap_load_from_buffer(tvm_t* vm, const uint8_t* buffer, size_t size) {
+    tsnap_reader_t reader = {
+        .data = buffer,
+        .size = size,
+        .cursor = 0,
+    };
+    uint32_t header[2];
+    if (!tsnap_read(&reader, header, sizeof(header)) || header[0] != TSNAP_MAGIC) {
+        fprintf(stderr, CLR_RED"Invalid snapshot: "CLR_END"bad magic\n");
+        return false;
+    }
+    if (header[1] != TSNAP_VERSION) {
+        fprintf(stderr, CLR_RED"Invalid snapshot: "CLR_END"version %u, this vm reads version %d\n", header[1], TSNAP_VERSION);
+        return false;
+    }
+
+    tvm_reset(vm);
+    tvm_frame_t** frames = NULL;
+    tsnap_reloc_t* relocs = NULL;
+    uint32_t frame_count, block_count, reloc_count;
+    if (!tsnap_read(&reader, &vm->ip, sizeof(word_t))
+    || !tsnap_read(&reader, &vm->icount, sizeof(uint64_t))
+    || !tsnap_read(&reader, &vm->sp, sizeof(word_t))
+    || vm->sp > TVM_STACK_CAPACITY
+    || !tsnap_read(&reader, vm->stack, sizeof(object_t) * vm->sp)
+    || !tsnap_read(&reader, &vm->rsp, sizeof(word_t))
+    || vm->rsp > RETURN_STACK_CAPACITY
+    || !tsnap_read(&reader, vm->return_stack, sizeof(word_t) * vm->rsp)
+    || !tsnap_read(&reader, &frame_count, sizeof(uint32_t))
+    || frame_count == 0
+    || frame_count > (reader.size - reader.cursor) / sizeof(vm->frame->local_vars))
+        goto truncated;
+
+    frames = malloc(sizeof(tvm_frame_t*) * frame_count);
+    for (uint32_t i = 0; i < frame_count; i++) {
+        if (i > 0)
+            vm->frame = tvm_frame_next(vm->frame);
+        frames[i] = vm->frame;
+        if (!tsnap_read(&reader, vm->frame->local_vars, sizeof(vm->frame->local_vars)))
+            goto truncated;
+    }
+    if (!tsnap_read(&reader, vm->gframe->global_vars, sizeof(object_t) * TVM_MAX_GLOBAL_VAR)
+    || !tsnap_read(&reader, &block_count, sizeof(uint32_t)))
+        goto truncated;
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        uint64_t block_size, pointer_count;
+        if (!tsnap_read(&reader, &block_size, sizeof(uint64_t))
+        || !tsnap_read(&reader, &pointer_count, sizeof(uint64_t))
+        || block_size > reader.size - reader.cursor
+        || pointer_count > UINT32_MAX)
+            goto truncated;
+        gc_block* block = (gc_block*)tgc_create_block(&vm->gc, block_size, pointer_count);
+        if (block == NULL) {
+            fprintf(stderr, CLR_RED"Snapshot: "CLR_END"out of memory for block %u of %llu bytes\n", i, (unsigned long long)block_size);
+            goto failed;
+        }
+        if (!tsnap_read(&reader, block->value, block_size))
+            goto truncated;
+    }
+
+    if (!tsnap_read(&reader, &reloc_count, sizeof(uint32_t))
+    || reloc_count > (reader.size - reader.cursor) / sizeof(tsnap_reloc_t))
+        goto truncated;
+    relocs = malloc(sizeof(tsnap_reloc_t) * (reloc_count + 1));
+    if (relocs == NULL || !tsnap_read(&reader, relocs, sizeof(tsnap_reloc_t) * reloc_count))
+        goto truncated;
+
+    // constant addresses need the table where the loader put it
+    if (!tvm_load_program_from_buffer(vm, &reader.data[reader.cursor], reader.size - reader.cursor))
+        goto failed;
+    for (uint32_t i = 0; i < reloc_count; i++) {
+        if (!tsnap_relocate(vm, &relocs[i], frames, frame_count)) {
+            fprintf(stderr, CLR_RED"Invalid snapshot: "CLR_END"relocation %u is out of range\n", i);
+            goto failed;
+        }
+    }
+    free(relocs);
+    free(frames);
+    return true;
+
+truncated:
+    fprintf(stderr, CLR_RED"Invalid snapshot: "CLR_END"truncated at byte %zu\n", reader.cursor);
+failed:
+    free(relocs);
+    free(frames);
+    tvm_reset(vm);
+    return false;
+}
+
+bool tsnap_load(tvm_t* vm, const char* file_name) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return false;
+    }
+    fseek(file, 0L, SEEK_END);
+    long byte_size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    if (byte_size < 0) {
+        fclose(file);
+        return false;
+    }
+    uint8_t* buffer = malloc(byte_size ? byte_size : 1);
+    size_t read = fread(buffer, 1, byte_size, file);
+    fclose(file);
+
+    bool ok = read == (size_t)byte_size && tsnap_load_from_buffer(vm, buffer, read);
+    free(buffer);
+    return ok;
+}
+
+#endif // TSNAP_IMPLEMENTATION
+
+#endif // TSNAP_H_
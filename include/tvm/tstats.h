@@ -0,0 +1,188 @@
+#ifndef TSTATS_H_
+#define TSTATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <tvm/tvm.h>
+
+#define TSTATS_TEXT_TOP 20 // rows of the pair and address tables in the text dump
+
+// both write the counters of a vm built with TVM_STATS, false when it has none
+bool tstats_write_text(tvm_t* vm, FILE* out);
+bool tstats_write_json(tvm_t* vm, FILE* out);
+
+#ifdef TSTATS_IMPLEMENTATION
+#undef TSTATS_IMPLEMENTATION
+
+#ifdef TVM_STATS
+
+#include <stdlib.h>
+
+typedef struct {
+    uint64_t count;
+    uint32_t index;
+} tstats_entry_t;
+
+static int tstats_entry_compare(const void* a, const void* b) {
+    const tstats_entry_t* x = a;
+    const tstats_entry_t* y = b;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// the non zero counters, largest first, the caller frees the result
+static tstats_entry_t* tstats_sorted(const uint64_t* counts, size_t count, size_t* out_len) {
+    tstats_entry_t* entries = malloc(sizeof(tstats_entry_t) * (count + 1));
+    size_t len = 0;
+    if (entries == NULL) {
+        *out_len = 0;
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (counts[i] != 0)
+            entries[len++] = (tstats_entry_t) { .count = counts[i], .index = (uint32_t)i };
+    }
+    qsort(entries, len, sizeof(tstats_entry_t), tstats_entry_compare);
+    *out_len = len;
+    return entries;
+}
+
+static uint64_t tstats_total(const tvm_stats_t* stats) {
+    uint64_t total = 0;
+    for (size_t i = 0; i <= OP_HALT; i++)
+        total += stats->ops[i];
+    return total;
+}
+
+// branch counts summed over every site of op
+static void tstats_branch(const tvm_t* vm, uint8_t op, uint64_t* taken, uint64_t* not_taken) {
+    const tvm_stats_t* stats = vm->stats;
+    *taken = 0;
+    for (size_t i = 0; i < stats->size && i < vm->program.size; i++) {
+        if (vm->program.code[i].type == op)
+            *taken += stats->taken[i];
+    }
+    *not_taken = stats->ops[op] - *taken;
+}
+
+bool tstats_write_text(tvm_t* vm, FILE* out) {
+    const tvm_stats_t* stats = vm->stats;
+    if (stats == NULL)
+        return false;
+    tvm_debug_map(&vm->program);
+    uint64_t total = tstats_total(stats);
+    double scale = total ? 100.0 / (double)total : 0.0;
+    size_t len;
+
+    fprintf(out, "instructions: %llu\n\nopcodes:\n", (unsigned long long)total);
+    tstats_entry_t* ops = tstats_sorted(stats->ops, OP_HALT + 1, &len);
+    for (size_t i = 0; i < len; i++)
+        fprintf(out, "  %-8s %14llu %6.2f%%\n", tvm_opcode_to_cstr(ops[i].index), (unsigned long long)ops[i].count, ops[i].count * scale);
+
+    fprintf(out, "\nbranches:          taken      not taken\n");
+    for (size_t i = 0; i < len; i++) {
+        if (!tvm_opcode_is_branch(ops[i].index))
+            continue;
+        uint64_t taken, not_taken;
+        tstats_branch(vm, ops[i].index, &taken, &not_taken);
+        fprintf(out, "  %-8s %14llu %14llu\n", tvm_opcode_to_cstr(ops[i].index), (unsigned long long)taken, (unsigned long long)not_taken);
+    }
+    free(ops);
+
+    fprintf(out, "\npairs:\n");
+    tstats_entry_t* pairs = tstats_sorted(&stats->pairs[0][0], (OP_HALT + 1) * (OP_HALT + 1), &len);
+    for (size_t i = 0; i < len && i < TSTATS_TEXT_TOP; i++) {
+        uint32_t first = pairs[i].index / (OP_HALT + 1);
+        uint32_t second = pairs[i].index % (OP_HALT + 1);
+        fprintf(out, "  %-8s %-8s %14llu %6.2f%%\n", tvm_opcode_to_cstr(first), tvm_opcode_to_cstr(second), (unsigned long long)pairs[i].count, pairs[i].count * scale);
+    }
+    free(pairs);
+
+    fprintf(out, "\naddresses:\n");
+    tstats_entry_t* hits = tstats_sorted(stats->hits, stats->size, &len);
+    for (size_t i = 0; i < len && i < TSTATS_TEXT_TOP; i++) {
+        word_t addr = hits[i].index;
+        fprintf(out, "  0x%08x %-8s line %-6u %14llu", addr, tvm_opcode_to_cstr(vm->program.code[addr].type),
+            tvm_debug_line(&vm->program, addr), (unsigned long long)hits[i].count);
+        if (tvm_opcode_is_branch(vm->program.code[addr].type))
+            fprintf(out, " taken %llu", (unsigned long long)stats->taken[addr]);
+        fprintf(out, "\n");
+    }
+    free(hits);
+    return true;
+}
+
+bool tstats_write_json(tvm_t* vm, FILE* out) {
+    const tvm_stats_t* stats = vm->stats;
+    if (stats == NULL)
+        return false;
+    tvm_debug_map(&vm->program);
+    size_t len;
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"opcodes\": {", (unsigned long long)tstats_total(stats));
+    tstats_entry_t* ops = tstats_sorted(stats->ops, OP_HALT + 1, &len);
+    for (size_t i = 0; i < len; i++)
+        fprintf(out, "%s\n    \"%s\": %llu", i ? "," : "", tvm_opcode_to_cstr(ops[i].index), (unsigned long long)ops[i].count);
+
+    fprintf(out, "\n  },\n  \"branches\": {");
+    bool first = true;
+    for (size_t i = 0; i < len; i++) {
+        if (!tvm_opcode_is_branch(ops[i].index))
+            continue;
+        uint64_t taken, not_taken;
+        tstats_branch(vm, ops[i].index, &taken, &not_taken);
+        fprintf(out, "%s\n    \"%s\": { \"taken\": %llu, \"not_taken\": %llu }", first ? "" : ",",
+            tvm_opcode_to_cstr(ops[i].index), (unsigned long long)taken, (unsigned long long)not_taken);
+        first = false;
+    }
+    free(ops);
+
+    fprintf(out, "\n  },\n  \"pairs\": [");
+    tstats_entry_t* pairs = tstats_sorted(&stats->pairs[0][0], (OP_HALT + 1) * (OP_HALT + 1), &len);
+    for (size_t i = 0; i < len; i++) {
+        fprintf(out, "%s\n    { \"first\": \"%s\", \"second\": \"%s\", \"count\": %llu }", i ? "," : "",
+            tvm_opcode_to_cstr(pairs[i].index / (OP_HALT + 1)), tvm_opcode_to_cstr(pairs[i].index % (OP_HALT + 1)),
+            (unsigned long long)pairs[i].count);
+    }
+    free(pairs);
+
+    // in address order, so two runs of the same program diff cleanly
+    fprintf(out, "\n  ],\n  \"addresses\": [");
+    first = true;
+    for (size_t addr = 0; addr < stats->size; addr++) {
+        if (stats->hits[addr] == 0)
+            continue;
+        uint8_t op = vm->program.code[addr].type;
+        fprintf(out, "%s\n    { \"addr\": %zu, \"op\": \"%s\", \"line\": %u, \"hits\": %llu", first ? "" : ",",
+            addr, tvm_opcode_to_cstr(op), tvm_debug_line(&vm->program, (word_t)addr), (unsigned long long)stats->hits[addr]);
+        if (tvm_opcode_is_branch(op))
+            fprintf(out, ", \"taken\": %llu", (unsigned long long)stats->taken[addr]);
+        fprintf(out, " }");
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return true;
+}
+
+#else
+
+bool tstats_write_text(tvm_t* vm, FILE* out) {
+    (void)vm;
+    (void)out;
+    return false;
+}
+
+bool tstats_write_json(tvm_t* vm, FILE* out) {
+    (void)vm;
+    (void)out;
+    return false;
+}
+
+#endif//TVM_STATS
+
+#endif//TSTATS_IMPLEMENTATION
+
+#endif//TSTATS_H_
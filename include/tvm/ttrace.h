@@ -0,0 +1,383 @@
+#ifndef TTRACE_H_
+#define TTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <common/tthread.h>
+#include <tvm/tvm.h>
+
+#define TTRACE_MAGIC 0x43525454           // "TTRC", the first 4 bytes of a trace file
+#define TTRACE_VERSION 1
+#define TTRACE_DEFAULT_CAPACITY (1 << 23) // ring bytes, a power of two
+#define TTRACE_TIME_INTERVAL 4096         // events between two time stamps
+#define TTRACE_FLUSH_MS 1
+#define TTRACE_EVENT_MAX_SIZE 32          // one kind byte and at most three leb128 fields
+
+/*
+    Only control flow is recorded, the instructions between two events ran in a straight line.
+    Every event is a kind byte followed by leb128 fields, the ip of an event is a signed delta
+    from the ip of the event before it and targets are deltas from their own ip.
+    The vm thread appends to a single producer ring that a flush thread drains into the file,
+    neither ever waits on the other. Events that find the ring full are counted and reported
+    as one lost event once there is room again.
+*/
+typedef enum {
+    TTRACE_EVENT_BRANCH_NOT_TAKEN, // ip
+    TTRACE_EVENT_BRANCH_TAKEN,     // ip, target
+    TTRACE_EVENT_JUMP,             // ip, target, jmp and fiber switches
+    TTRACE_EVENT_CALL,             // ip, target
+    TTRACE_EVENT_RET,              // ip, target
+    TTRACE_EVENT_NATIVE,           // ip, native id, ns spent in the call
+    TTRACE_EVENT_ALLOC,            // ip, bytes
+    TTRACE_EVENT_EXCEPTION,        // ip, exception_t
+    TTRACE_EVENT_TIME,             // ns since the start, instructions executed
+    TTRACE_EVENT_LOST,             // events dropped while the ring was full
+    TTRACE_EVENT_END,              // instructions executed
+    TTRACE_EVENT_COUNT,
+} ttrace_event_kind_t;
+
+typedef struct ttrace {
+    uint8_t* ring;
+    size_t capacity;
+    volatile size_t head; // written by the vm thread
+    volatile size_t tail; // written by the flush thread
+    volatile size_t stop;
+    tthread_t thread;
+    FILE* out;
+    tvm_t* vm;
+    word_t last_ip;
+    uint64_t start_ns;
+    uint64_t native_start_ns;
+    uint64_t events;  // since the last time event
+    uint64_t lost;    // dropped and not reported yet
+    uint64_t dropped; // over the whole trace
+} ttrace_t;
+
+typedef struct {
+    uint8_t kind;   // ttrace_event_kind_t
+    word_t ip;
+    word_t target;  // taken branches, jumps, calls and returns
+    uint64_t value; // native id, bytes, exception, lost events or instructions
+    uint64_t ns;    // natives and time events
+} ttrace_event_t;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t cursor;
+    word_t ip;
+} ttrace_reader_t;
+
+// records vm into file_name until ttrace_stop, capacity is rounded up to a power of two
+bool ttrace_start(ttrace_t* trace, tvm_t* vm, const char* file_name, size_t capacity);
+// writes the end event, drains the ring and closes the file
+void ttrace_stop(ttrace_t* trace);
+
+// checks the header, data has to outlive the reader
+bool ttrace_reader_init(ttrace_reader_t* reader, const uint8_t* data, size_t size);
+// false at the end of the trace or on a truncated event
+bool ttrace_next(ttrace_reader_t* reader, ttrace_event_t* event);
+const char* ttrace_event_to_cstr(uint8_t kind);
+
+#ifdef TTRACE_IMPLEMENTATION
+#undef TTRACE_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <common/cmd_colors.h>
+#include <common/ttime.h>
+
+static size_t ttrace_put_uleb(uint8_t* buf, uint64_t value) {
+    size_t len = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[len++] = byte | (value != 0 ? 0x80 : 0);
+    } while (value != 0);
+    return len;
+}
+
+static size_t ttrace_put_sleb(uint8_t* buf, int64_t value) {
+    size_t len = 0;
+    for (;;) {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        bool done = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+        buf[len++] = byte | (done ? 0 : 0x80);
+        if (done)
+            return len;
+    }
+}
+
+static bool ttrace_push(ttrace_t* trace, const uint8_t* buf, size_t len) {
+    size_t head = trace->head;
+    size_t tail = tthread_load_acquire(&trace->tail);
+    if (trace->capacity - (head - tail) < len)
+        return false;
+    size_t start = head & (trace->capacity - 1);
+    size_t first = trace->capacity - start < len ? trace->capacity - start : len;
+    memcpy(&trace->ring[start], buf, first);
+    memcpy(trace->ring, buf + first, len - first);
+    tthread_store_release(&trace->head, head + len);
+    return true;
+}
+
+// has_ip events move last_ip, so a dropped one must not
+static void ttrace_emit(ttrace_t* trace, uint8_t kind, bool has_ip, word_t ip, bool has_target, word_t target, int fields, uint64_t a, uint64_t b) {
+    uint8_t buf[TTRACE_EVENT_MAX_SIZE];
+    if (trace->lost > 0) {
+        buf[0] = TTRACE_EVENT_LOST;
+        size_t len = 1 + ttrace_put_uleb(buf + 1, trace->lost);
+        if (!ttrace_push(trace, buf, len)) {
+            trace->lost++;
+            trace->dropped++;
+            return;
+        }
+        trace->lost = 0;
+    }
+    size_t len = 0;
+    buf[len++] = kind;
+    if (has_ip)
+        len += ttrace_put_sleb(buf + len, (int64_t)ip - (int64_t)trace->last_ip);
+    if (has_target)
+        len += ttrace_put_sleb(buf + len, (int64_t)target - (int64_t)ip);
+    if (fields > 0)
+        len += ttrace_put_uleb(buf + len, a);
+    if (fields > 1)
+        len += ttrace_put_uleb(buf + len, b);
+    if (!ttrace_push(trace, buf, len)) {
+        trace->lost++;
+        trace->dropped++;
+        return;
+    }
+    if (has_ip)
+        trace->last_ip = ip;
+}
+
+static void ttrace_flush_run(void* arg) {
+    ttrace_t* trace = arg;
+    for (;;) {
+        // read stop before head, the last events are published before stop is set
+        bool stop = tthread_load_acquire(&trace->stop) != 0;
+        size_t head = tthread_load_acquire(&trace->head);
+        size_t tail = trace->tail;
+        if (head != tail) {
+            size_t len = head - tail;
+            size_t start = tail & (trace->capacity - 1);
+            size_t first = trace->capacity - start < len ? trace->capacity - start : len;
+            fwrite(&trace->ring[start], 1, first, trace->out);
+            fwrite(trace->ring, 1, len - first, trace->out);
+            tthread_store_release(&trace->tail, head);
+        } else if (stop) {
+            break;
+        } else {
+            tthread_sleep_ms(TTRACE_FLUSH_MS);
+        }
+    }
+}
+
+bool ttrace_start(ttrace_t* trace, tvm_t* vm, const char* file_name, size_t capacity) {
+    size_t size = 64;
+    while (size < capacity)
+        size <<= 1;
+    *trace = (ttrace_t) {
+        .ring = malloc(size),
+        .capacity = size,
+        .head = 0,
+        .tail = 0,
+        .stop = 0,
+        .out = fopen(file_name, "wb"),
+        .vm = vm,
+        .last_ip = 0,
+        .start_ns = ttime_now_ns(),
+    };
+    if (trace->out == NULL) {
+        fprintf(stderr, CLR_RED"ttrace: "CLR_END"can't open %s\n", file_name);
+        free(trace->ring);
+        trace->ring = NULL;
+        return false;
+    }
+    uint32_t magic = TTRACE_MAGIC;
+    uint8_t version = TTRACE_VERSION;
+    fwrite(&magic, sizeof(magic), 1, trace->out);
+    fwrite(&version, sizeof(version), 1, trace->out);
+    if (trace->ring == NULL || !tthread_create(&trace->thread, ttrace_flush_run, trace)) {
+        fclose(trace->out);
+        free(trace->ring);
+        trace->ring = NULL;
+        return false;
+    }
+    vm->trace = trace;
+    return true;
+}
+
+void ttrace_stop(ttrace_t* trace) {
+    if (trace->ring == NULL)
+        return;
+    trace->vm->trace = NULL;
+    ttrace_emit(trace, TTRACE_EVENT_END, false, 0, false, 0, 1, trace->vm->icount, 0);
+    tthread_store_release(&trace->stop, 1);
+    tthread_join(trace->thread);
+    fclose(trace->out);
+    free(trace->ring);
+    trace->ring = NULL;
+}
+
+void ttrace_native_begin(struct ttrace* trace) {
+    trace->native_start_ns = ttime_now_ns();
+}
+
+void ttrace_step(struct ttrace* trace, tvm_t* vm, word_t ip, uint8_t op, exception_t except) {
+    word_t next = vm->ip;
+    if (except != EXCEPT_OK) {
+        ttrace_emit(trace, TTRACE_EVENT_EXCEPTION, true, ip, false, 0, 1, except, 0);
+        return;
+    }
+    switch (op) {
+    case OP_CALL:
+        ttrace_emit(trace, TTRACE_EVENT_CALL, true, ip, true, next, 0, 0, 0);
+        break;
+    case OP_RET:
+        ttrace_emit(trace, TTRACE_EVENT_RET, true, ip, true, next, 0, 0, 0);
+        break;
+    case OP_NATIVE:
+        ttrace_emit(trace, TTRACE_EVENT_NATIVE, true, ip, false, 0, 2,
+            vm->program.code[ip].operand.ui32, ttime_now_ns() - trace->native_start_ns);
+        break;
+    case OP_HALLOC: {
+        gc_block* block = tvm_heap_block(vm->stack[vm->sp - 1]);
+        ttrace_emit(trace, TTRACE_EVENT_ALLOC, true, ip, false, 0, 1, block ? block->size : 0, 0);
+        break;
+    }
+    default:
+        if (tvm_opcode_is_branch(op)) {
+            if (next == ip + 1)
+                ttrace_emit(trace, TTRACE_EVENT_BRANCH_NOT_TAKEN, true, ip, false, 0, 0, 0, 0);
+            else
+                ttrace_emit(trace, TTRACE_EVENT_BRANCH_TAKEN, true, ip, true, next, 0, 0, 0);
+        } else if (next != ip + 1) {
+            ttrace_emit(trace, TTRACE_EVENT_JUMP, true, ip, true, next, 0, 0, 0);
+        } else {
+            return;
+        }
+        break;
+    }
+    if (++trace->events >= TTRACE_TIME_INTERVAL) {
+        trace->events = 0;
+        ttrace_emit(trace, TTRACE_EVENT_TIME, false, 0, false, 0, 2, ttime_now_ns() - trace->start_ns, vm->icount);
+    }
+}
+
+static bool ttrace_get_uleb(ttrace_reader_t* reader, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->cursor >= reader->size)
+            return false;
+        uint8_t byte = reader->data[reader->cursor++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ttrace_get_sleb(ttrace_reader_t* reader, int64_t* value) {
+    int64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->cursor >= reader->size)
+            return false;
+        uint8_t byte = reader->data[reader->cursor++];
+        result |= (int64_t)((uint64_t)(byte & 0x7f) << shift);
+        if (!(byte & 0x80)) {
+            if ((byte & 0x40) && shift + 7 < 64)
+                result |= -((int64_t)1 << (shift + 7));
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ttrace_reader_init(ttrace_reader_t* reader, const uint8_t* data, size_t size) {
+    uint32_t magic;
+    *reader = (ttrace_reader_t) { .data = data, .size = size, .cursor = 5, .ip = 0 };
+    if (size < 5)
+        return false;
+    memcpy(&magic, data, sizeof(magic));
+    return magic == TTRACE_MAGIC && data[4] == TTRACE_VERSION;
+}
+
+bool ttrace_next(ttrace_reader_t* reader, ttrace_event_t* event) {
+    if (reader->cursor >= reader->size)
+        return false;
+    *event = (ttrace_event_t) { .kind = reader->data[reader->cursor++] };
+    bool has_ip = true, has_target = false;
+    int fields = 0;
+    switch (event->kind) {
+    case TTRACE_EVENT_BRANCH_NOT_TAKEN: break;
+    case TTRACE_EVENT_BRANCH_TAKEN:
+    case TTRACE_EVENT_JUMP:
+    case TTRACE_EVENT_CALL:
+    case TTRACE_EVENT_RET:       has_target = true; break;
+    case TTRACE_EVENT_NATIVE:    fields = 2; break;
+    case TTRACE_EVENT_ALLOC:
+    case TTRACE_EVENT_EXCEPTION: fields = 1; break;
+    case TTRACE_EVENT_TIME:      has_ip = false; fields = 2; break;
+    case TTRACE_EVENT_LOST:
+    case TTRACE_EVENT_END:       has_ip = false; fields = 1; break;
+    default:
+        return false;
+    }
+    int64_t delta;
+    if (has_ip) {
+        if (!ttrace_get_sleb(reader, &delta))
+            return false;
+        reader->ip += (word_t)delta;
+        event->ip = reader->ip;
+    }
+    if (has_target) {
+        if (!ttrace_get_sleb(reader, &delta))
+            return false;
+        event->target = event->ip + (word_t)delta;
+    }
+    // natives and time events carry their ns in the second field
+    uint64_t first = 0, second = 0;
+    if (fields > 0 && !ttrace_get_uleb(reader, &first))
+        return false;
+    if (fields > 1 && !ttrace_get_uleb(reader, &second))
+        return false;
+    if (event->kind == TTRACE_EVENT_TIME) {
+        event->ns = first;
+        event->value = second;
+    } else {
+        event->value = first;
+        event->ns = second;
+    }
+    return true;
+}
+
+const char* ttrace_event_to_cstr(uint8_t kind) {
+    switch (kind) {
+    case TTRACE_EVENT_BRANCH_NOT_TAKEN: return "fall";
+    case TTRACE_EVENT_BRANCH_TAKEN:     return "branch";
+    case TTRACE_EVENT_JUMP:             return "jump";
+    case TTRACE_EVENT_CALL:             return "call";
+    case TTRACE_EVENT_RET:              return "ret";
+    case TTRACE_EVENT_NATIVE:           return "native";
+    case TTRACE_EVENT_ALLOC:            return "alloc";
+    case TTRACE_EVENT_EXCEPTION:        return "exception";
+    case TTRACE_EVENT_TIME:             return "time";
+    case TTRACE_EVENT_LOST:             return "lost";
+    case TTRACE_EVENT_END:              return "end";
+    default:                            return "?";
+    }
+}
+
+#endif//TTRACE_IMPLEMENTATION
+
+#endif//TTRACE_H_
@@ -0,0 +1,400 @@
+#ifndef TVEC_H_
+#define TVEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+    Bulk kernels behind the vector opcodes. Every entry point picks the widest
+    instruction set the cpu reports (AVX2, then SSE2) and falls back to plain C.
+    The SIMD paths are built with GCC/Clang target attributes, other compilers get the scalar ones.
+    i32 and u32 share the wrapping add/sub/mul/sum/dot kernels, results are returned as raw 32 bit patterns.
+    Float sums and dot products are accumulated lane by lane, so the rounding can differ from a scalar loop.
+    Float min/max skip NaN elements unless a[0] is one, then the result is NaN, on every instruction set.
+    Which of -0 and +0 comes back when both are there can still depend on the instruction set.
+*/
+
+typedef enum {
+    TVEC_I32,
+    TVEC_U32,
+    TVEC_F32,
+} tvec_type_t;
+
+typedef enum {
+    TVEC_ADD,
+    TVEC_SUB,
+    TVEC_MUL,
+    TVEC_DIV,
+} tvec_op_t;
+
+typedef enum {
+    TVEC_ISA_SCALAR,
+    TVEC_ISA_SSE2,
+    TVEC_ISA_AVX2,
+} tvec_isa_t;
+
+tvec_isa_t tvec_isa();
+// dst[i] = a[i] op b[i], false on an integer division by zero (dst is left untouched then)
+bool tvec_binary(tvec_op_t op, tvec_type_t type, void* dst, const void* a, const void* b, size_t n);
+uint32_t tvec_dot(tvec_type_t type, const void* a, const void* b, size_t n);
+uint32_t tvec_sum(tvec_type_t type, const void* a, size_t n);
+// 0 for empty arrays
+uint32_t tvec_min(tvec_type_t type, const void* a, size_t n);
+uint32_t tvec_max(tvec_type_t type, const void* a, size_t n);
+void tvec_fill(void* dst, uint32_t value, size_t n);
+void tvec_copy(void* dst, const void* src, size_t n);
+
+#ifdef TVEC_IMPLEMENTATION
+#undef TVEC_IMPLEMENTATION
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TVEC_X86
+#include <immintrin.h>
+#define TVEC_TARGET_SSE2 __attribute__((target("sse2")))
+#define TVEC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+tvec_isa_t tvec_isa() {
+#ifdef TVEC_X86
+    // reads the cpu model libgcc filled in at startup, cheap enough to ask on every call
+    if (__builtin_cpu_supports("avx2"))
+        return TVEC_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return TVEC_ISA_SSE2;
+#endif
+    return TVEC_ISA_SCALAR;
+}
+
+static float tvec_f32(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t tvec_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* scalar kernels, they also finish the tails of the SIMD ones */
+
+static void tvec_binary_f32_scalar(tvec_op_t op, float* dst, const float* a, const float* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        switch (op) {
+        case TVEC_ADD: dst[i] = a[i] + b[i]; break;
+        case TVEC_SUB: dst[i] = a[i] - b[i]; break;
+        case TVEC_MUL: dst[i] = a[i] * b[i]; break;
+        case TVEC_DIV: dst[i] = a[i] / b[i]; break;
+        }
+    }
+}
+
+static void tvec_binary_int_scalar(tvec_op_t op, tvec_type_t type, uint32_t* dst, const uint32_t* a, const uint32_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        switch (op) {
+        case TVEC_ADD: dst[i] = a[i] + b[i]; break;
+        case TVEC_SUB: dst[i] = a[i] - b[i]; break;
+        case TVEC_MUL: dst[i] = a[i] * b[i]; break;
+        case TVEC_DIV:
+            // INT32_MIN / -1 traps, it wraps like divl
+            if (type == TVEC_I32)
+                dst[i] = (int32_t)b[i] == -1 ? 0u - a[i] : (uint32_t)((int32_t)a[i] / (int32_t)b[i]);
+            else
+                dst[i] = a[i] / b[i];
+            break;
+        }
+    }
+}
+
+static float tvec_sum_f32_scalar(const float* a, size_t n) {
+    float sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i];
+    return sum;
+}
+
+static uint32_t tvec_sum_int_scalar(const uint32_t* a, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i];
+    return sum;
+}
+
+static float tvec_dot_f32_scalar(const float* a, const float* b, size_t n) {
+    float sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+static uint32_t tvec_dot_int_scalar(const uint32_t* a, const uint32_t* b, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+static bool tvec_less(tvec_type_t type, uint32_t x, uint32_t y) {
+    switch (type) {
+    case TVEC_I32: return (int32_t)x < (int32_t)y;
+    case TVEC_U32: return x < y;
+    default:       return tvec_f32(x) < tvec_f32(y);
+    }
+}
+
+// folds a[0..n) into acc, is_max picks the direction
+static uint32_t tvec_minmax_scalar(tvec_type_t type, bool is_max, uint32_t acc, const uint32_t* a, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (is_max ? tvec_less(type, acc, a[i]) : tvec_less(type, a[i], acc))
+            acc = a[i];
+    }
+    return acc;
+}
+
+#ifdef TVEC_X86
+
+/* SSE2, 4 lanes. It has no 32 bit integer multiply or min/max, those stay scalar */
+
+TVEC_TARGET_SSE2 static size_t tvec_binary_sse2(tvec_op_t op, tvec_type_t type, void* dst, const void* a, const void* b, size_t n) {
+    size_t i = 0;
+    if (type == TVEC_F32) {
+        const float* x = a; const float* y = b; float* d = dst;
+        switch (op) {
+        case TVEC_ADD: for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i))); break;
+        case TVEC_SUB: for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i))); break;
+        case TVEC_MUL: for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i))); break;
+        case TVEC_DIV: for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_div_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i))); break;
+        }
+        return i;
+    }
+    const __m128i* x = a; const __m128i* y = b; __m128i* d = dst;
+    switch (op) {
+    case TVEC_ADD: for (; i + 4 <= n; i += 4) _mm_storeu_si128(d + i / 4, _mm_add_epi32(_mm_loadu_si128(x + i / 4), _mm_loadu_si128(y + i / 4))); break;
+    case TVEC_SUB: for (; i + 4 <= n; i += 4) _mm_storeu_si128(d + i / 4, _mm_sub_epi32(_mm_loadu_si128(x + i / 4), _mm_loadu_si128(y + i / 4))); break;
+    default: break;
+    }
+    return i;
+}
+
+TVEC_TARGET_SSE2 static float tvec_sum_f32_sse2(const float* a, size_t n) {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = _mm_add_ps(acc, _mm_loadu_ps(a + i));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + tvec_sum_f32_scalar(a + i, n - i);
+}
+
+TVEC_TARGET_SSE2 static uint32_t tvec_sum_int_sse2(const uint32_t* a, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(a + i)));
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + tvec_sum_int_scalar(a + i, n - i);
+}
+
+TVEC_TARGET_SSE2 static float tvec_dot_f32_sse2(const float* a, const float* b, size_t n) {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + tvec_dot_f32_scalar(a + i, b + i, n - i);
+}
+
+// max_ps(x, acc) is x > acc ? x : acc, a NaN x keeps acc and a NaN a[0] stays, like tvec_minmax_scalar
+TVEC_TARGET_SSE2 static uint32_t tvec_minmax_f32_sse2(bool is_max, const float* a, size_t n) {
+    __m128 acc = _mm_set1_ps(a[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        acc = is_max ? _mm_max_ps(x, acc) : _mm_min_ps(x, acc);
+    }
+    uint32_t lanes[4];
+    _mm_storeu_ps((float*)lanes, acc);
+    uint32_t result = tvec_minmax_scalar(TVEC_F32, is_max, lanes[0], lanes + 1, 3);
+    return tvec_minmax_scalar(TVEC_F32, is_max, result, (const uint32_t*)a + i, n - i);
+}
+
+/* AVX2, 8 lanes */
+
+TVEC_TARGET_AVX2 static size_t tvec_binary_avx2(tvec_op_t op, tvec_type_t type, void* dst, const void* a, const void* b, size_t n) {
+    size_t i = 0;
+    if (type == TVEC_F32) {
+        const float* x = a; const float* y = b; float* d = dst;
+        switch (op) {
+        case TVEC_ADD: for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i))); break;
+        case TVEC_SUB: for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i))); break;
+        case TVEC_MUL: for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i))); break;
+        case TVEC_DIV: for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_div_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i))); break;
+        }
+        return i;
+    }
+    const __m256i* x = a; const __m256i* y = b; __m256i* d = dst;
+    switch (op) {
+    case TVEC_ADD: for (; i + 8 <= n; i += 8) _mm256_storeu_si256(d + i / 8, _mm256_add_epi32(_mm256_loadu_si256(x + i / 8), _mm256_loadu_si256(y + i / 8))); break;
+    case TVEC_SUB: for (; i + 8 <= n; i += 8) _mm256_storeu_si256(d + i / 8, _mm256_sub_epi32(_mm256_loadu_si256(x + i / 8), _mm256_loadu_si256(y + i / 8))); break;
+    case TVEC_MUL: for (; i + 8 <= n; i += 8) _mm256_storeu_si256(d + i / 8, _mm256_mullo_epi32(_mm256_loadu_si256(x + i / 8), _mm256_loadu_si256(y + i / 8))); break;
+    default: break; // no integer division in SIMD
+    }
+    return i;
+}
+
+TVEC_TARGET_AVX2 static float tvec_sum_f32_avx2(const float* a, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    return tvec_sum_f32_scalar(lanes, 8) + tvec_sum_f32_scalar(a + i, n - i);
+}
+
+TVEC_TARGET_AVX2 static uint32_t tvec_sum_int_avx2(const uint32_t* a, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)(a + i)));
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return tvec_sum_int_scalar(lanes, 8) + tvec_sum_int_scalar(a + i, n - i);
+}
+
+TVEC_TARGET_AVX2 static float tvec_dot_f32_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    return tvec_sum_f32_scalar(lanes, 8) + tvec_dot_f32_scalar(a + i, b + i, n - i);
+}
+
+TVEC_TARGET_AVX2 static uint32_t tvec_dot_int_avx2(const uint32_t* a, const uint32_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return tvec_sum_int_scalar(lanes, 8) + tvec_dot_int_scalar(a + i, b + i, n - i);
+}
+
+TVEC_TARGET_AVX2 static uint32_t tvec_minmax_avx2(tvec_type_t type, bool is_max, const uint32_t* a, size_t n) {
+    uint32_t lanes[8];
+    size_t i = 8;
+    if (type == TVEC_F32) {
+        // every lane starts at a[0] so NaNs fold as in tvec_minmax_f32_sse2
+        __m256 acc = _mm256_set1_ps(((const float*)a)[0]);
+        for (i = 0; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps((const float*)a + i);
+            acc = is_max ? _mm256_max_ps(x, acc) : _mm256_min_ps(x, acc);
+        }
+        _mm256_storeu_ps((float*)lanes, acc);
+    } else {
+        __m256i acc = _mm256_loadu_si256((const __m256i*)a);
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            if (type == TVEC_I32)
+                acc = is_max ? _mm256_max_epi32(acc, x) : _mm256_min_epi32(acc, x);
+            else
+                acc = is_max ? _mm256_max_epu32(acc, x) : _mm256_min_epu32(acc, x);
+        }
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+    }
+    uint32_t result = tvec_minmax_scalar(type, is_max, lanes[0], lanes + 1, 7);
+    return tvec_minmax_scalar(type, is_max, result, a + i, n - i);
+}
+
+#endif//TVEC_X86
+
+bool tvec_binary(tvec_op_t op, tvec_type_t type, void* dst, const void* a, const void* b, size_t n) {
+    if (op == TVEC_DIV && type != TVEC_F32) {
+        for (size_t i = 0; i < n; i++) {
+            if (((const uint32_t*)b)[i] == 0)
+                return false;
+        }
+    }
+    size_t done = 0;
+#ifdef TVEC_X86
+    switch (tvec_isa()) {
+    case TVEC_ISA_AVX2: done = tvec_binary_avx2(op, type, dst, a, b, n); break;
+    case TVEC_ISA_SSE2: done = tvec_binary_sse2(op, type, dst, a, b, n); break;
+    default: break;
+    }
+#endif
+    if (type == TVEC_F32)
+        tvec_binary_f32_scalar(op, (float*)dst + done, (const float*)a + done, (const float*)b + done, n - done);
+    else
+        tvec_binary_int_scalar(op, type, (uint32_t*)dst + done, (const uint32_t*)a + done, (const uint32_t*)b + done, n - done);
+    return true;
+}
+
+uint32_t tvec_dot(tvec_type_t type, const void* a, const void* b, size_t n) {
+    tvec_isa_t isa = tvec_isa();
+    if (type == TVEC_F32) {
+#ifdef TVEC_X86
+        if (isa == TVEC_ISA_AVX2) return tvec_bits(tvec_dot_f32_avx2(a, b, n));
+        if (isa == TVEC_ISA_SSE2) return tvec_bits(tvec_dot_f32_sse2(a, b, n));
+#endif
+        return tvec_bits(tvec_dot_f32_scalar(a, b, n));
+    }
+#ifdef TVEC_X86
+    if (isa == TVEC_ISA_AVX2) return tvec_dot_int_avx2(a, b, n);
+#endif
+    (void)isa;
+    return tvec_dot_int_scalar(a, b, n);
+}
+
+uint32_t tvec_sum(tvec_type_t type, const void* a, size_t n) {
+    tvec_isa_t isa = tvec_isa();
+    if (type == TVEC_F32) {
+#ifdef TVEC_X86
+        if (isa == TVEC_ISA_AVX2) return tvec_bits(tvec_sum_f32_avx2(a, n));
+        if (isa == TVEC_ISA_SSE2) return tvec_bits(tvec_sum_f32_sse2(a, n));
+#endif
+        return tvec_bits(tvec_sum_f32_scalar(a, n));
+    }
+#ifdef TVEC_X86
+    if (isa == TVEC_ISA_AVX2) return tvec_sum_int_avx2(a, n);
+    if (isa == TVEC_ISA_SSE2) return tvec_sum_int_sse2(a, n);
+#endif
+    (void)isa;
+    return tvec_sum_int_scalar(a, n);
+}
+
+static uint32_t tvec_minmax(tvec_type_t type, bool is_max, const uint32_t* a, size_t n) {
+    if (n == 0)
+        return 0;
+#ifdef TVEC_X86
+    tvec_isa_t isa = tvec_isa();
+    if (isa == TVEC_ISA_AVX2 && n >= 8)
+        return tvec_minmax_avx2(type, is_max, a, n);
+    if (isa >= TVEC_ISA_SSE2 && type == TVEC_F32 && n >= 4)
+        return tvec_minmax_f32_sse2(is_max, (const float*)a, n);
+#endif
+    return tvec_minmax_scalar(type, is_max, a[0], a + 1, n - 1);
+}
+
+uint32_t tvec_min(tvec_type_t type, const void* a, size_t n) {
+    return tvec_minmax(type, false, a, n);
+}
+
+uint32_t tvec_max(tvec_type_t type, const void* a, size_t n) {
+    return tvec_minmax(type, true, a, n);
+}
+
+void tvec_fill(void* dst, uint32_t value, size_t n) {
+    uint32_t* d = dst;
+    // plain loop, compilers turn it into wide stores on their own
+    for (size_t i = 0; i < n; i++) d[i] = value;
+}
+
+void tvec_copy(void* dst, const void* src, size_t n) {
+    memmove(dst, src, n * sizeof(uint32_t));
+}
+
+#endif//TVEC_IMPLEMENTATION
+
+#endif//TVEC_H_
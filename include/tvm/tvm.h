@@ -1,22 +1,42 @@
 #ifndef TVM_H_
 #define TVM_H_
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
 
+#ifdef TVM_IMPLEMENTATION
 #define ARENA_IMPLEMENTATION
+#endif
 #include <common/arena.h>
 
-// #include <tvm/tgc.h>
+#ifdef TVM_IMPLEMENTATION
+#define TTIME_IMPLEMENTATION
+#endif
+#include <common/ttime.h>
+
+#ifdef TVM_IMPLEMENTATION
+#define TGC_IMPLEMENTATION
+#endif
+#include <tvm/tgc.h>
+
+#ifdef TVM_IMPLEMENTATION
+#define TPOOL_IMPLEMENTATION
+#endif
+#include <common/tpool.h>
+
+#ifdef TVM_IMPLEMENTATION
+#define TVEC_IMPLEMENTATION
+#endif
+#include <tvm/tvec.h>
 
 #define TVM_STACK_CAPACITY 1024
-#define TVM_PROGRAM_CAPACITY 1024
-#define TVM_METADATA_MAX_CFUN_CAPACITY 512
 #define TVM_METADATA_MAX_MODULE_CAPACITY 32
 #define RETURN_STACK_CAPACITY 1024
 #define TVM_MAX_LOCAL_VAR 64
 #define TVM_MAX_GLOBAL_VAR 64
+#define TVM_PAR_CHUNKS_PER_THREAD 8 // pmap chunks handed out per thread, more chunks balance uneven procs better
 
 #define ARRAY_LENGTH(x) (sizeof(x) / sizeof((x)[0]))
 #define UNUSED_VAR(x) ((void)(x))
@@ -38,7 +58,12 @@ typedef enum {
     EXCEPT_DIVISION_BY_ZERO,
     EXCEPT_INVALID_PRIMITIVE_SIZE,
     EXCEPT_INVALID_ARRAY_INDEX,
-    EXCEPT_INVALID_BYTE_SIZE
+    EXCEPT_INVALID_BYTE_SIZE,
+    EXCEPT_INVALID_FIBER,
+    EXCEPT_FIBER_DEADLOCK,
+    EXCEPT_INVALID_PARALLEL_ACCESS,
+    EXCEPT_INVALID_HEAP_ACCESS,
+    EXCEPT_OUT_OF_MEMORY
 } exception_t;
 
 typedef uint32_t word_t;
@@ -99,6 +124,8 @@ typedef enum {
     OP_RSHFT,
     /* load store */
     OP_LOADC,  // load constant to stack
+    OP_LOADCB, // 1 byte constant, zero extended or sign extended for i8 (emitted by tasm for char/u8/i8 constants)
+    OP_LOADCW, // 8 byte constant into two slots (emitted by tasm for 64 bit constants)
     OP_ALOADC, // load address of constant to stack
     OP_LOAD,   // load to stack
     OP_STORE,  // store to local variable
@@ -116,29 +143,133 @@ typedef enum {
     OP_PUTC,
     /* native */
     OP_NATIVE,
+    /* fibers */
+    OP_SPAWN, // start a proc as a fiber, its argument is moved over and the fiber id is pushed
+    OP_YIELD, // let the next ready fiber run
+    OP_JOIN,  // wait for the fiber id on the stack and replace it with the fiber's return value
+    /* data parallel */
+    OP_PMAP,    // [array, elem_size] -> [], array[i] = proc(i, array[i]) across the parallel pool
+    OP_PREDUCE, // [array, elem_size, init] -> [result], folds the array with an associative proc(acc, elem)
+                // elem_size is 1, 2, 4 or 8, 8 byte elements, init and result are wide (two slots)
+    /* vector, the operand is the element ctype (i32, u32 or f32) and arrays are halloc'd blocks */
+    OP_VADD,  // [dst, a, b] -> [], dst[i] = a[i] + b[i] for every element of dst
+    OP_VSUB,
+    OP_VMUL,
+    OP_VDIV,
+    OP_VDOT,  // [a, b] -> [a . b]
+    OP_VSUM,  // [a] -> [sum]
+    OP_VMIN,  // [a] -> [min], 0 when empty
+    OP_VMAX,
+    OP_VFILL, // [dst, value] -> []
+    OP_VCOPY, // [dst, src] -> [], copies as many elements as dst holds
+    /* bulk memory, offsets and lengths are in bytes, sources may also be constant addresses */
+    OP_MCOPY, // [dst, dst_off, src, src_off, len] -> [], the ranges may overlap
+    OP_MFILL, // [dst, off, byte, len] -> []
+    OP_MCMP,  // [a, a_off, b, b_off, len] -> [-1, 0 or 1]
+    OP_MFIND, // [a, off, byte, len] -> [byte offset of the first match or -1]
+    /* typed heap loads, the operand is the element ctype */
+    OP_HGET,   // [addr, index] -> [value], reads addr[index], 64 bit types push a wide value (two slots), ptr one object
+    OP_HGETOF, // [addr, offset] -> [value], reads the value at a byte offset
+    /* 64 bit, a wide value takes two slots with the low word pushed first like loadcw does */
+    OP_ADDL,
+    OP_SUBL,
+    OP_MULTL,
+    OP_DIVL,
+    OP_MODL,
+    OP_DIVUL,
+    OP_MODUL,
+    OP_ADDD,
+    OP_SUBD,
+    OP_MULTD,
+    OP_DIVD,
+    OP_CMPL,  // [a, b] -> [-1, 0 or 1]
+    OP_CMPUL,
+    OP_CMPD,  // unordered compares as 1
+    OP_CI2L,
+    OP_CU2L,
+    OP_CL2I,  // keeps the low word
+    OP_CL2D,
+    OP_CD2L,
+    OP_CF2D,
+    OP_CD2F,
+    /* compare and branch, [a, b] -> [] and jumps when the compare holds, tasm fuses compares followed by jz/jnz into these */
+    OP_JEQ,
+    OP_JNE,
+    OP_JLT,
+    OP_JLE,
+    OP_JGT,
+    OP_JGE,
+    OP_JLTU,
+    OP_JLEU,
+    OP_JGTU,
+    OP_JGEU,
+    OP_JEQF,
+    OP_JNEF,
+    OP_JLTF,
+    OP_JLEF,
+    OP_JGTF,
+    OP_JGEF,
+    OP_CKPT, // end of the init phase, tvm_step_n stops there so the host can take a snapshot
     /* halt */
     OP_HALT // termination
 } optype_t;
 
 typedef enum {
     STACK_OBJ_NO_OPERAND,
-    STACK_OBJ_TYPE_DATA_ADDRESS,
+    STACK_OBJ_TYPE_DATA_ADDRESS,  // gc_block on the heap, the only type the GC follows
     STACK_OBJ_TYPE_VM_ADDRESS,
     STACK_OBJ_TYPE_NUMBER,
     STACK_OBJ_TYPE_CHARACTER,
+    STACK_OBJ_TYPE_CONST_ADDRESS, // pointer into the constant table
 } stack_obj_type_t;
 
-typedef struct {
-    uint8_t type; //stack_obj_type_t
-    union {
-        uint8_t ui8;
-        uintptr_t ui64; // usually for addresses
-        uint32_t ui32;
-        int32_t  i32;
-        float    f32;
-    };
+/*
+    An object is one 8 byte word. The stack_obj_type_t tag lives in the high 16 bits
+    and the payload in the low 48 bits, which holds any user space pointer on x86_64 and aarch64.
+    32 bit scalars sit in the low word so they can be read through the union members
+    (little endian only, like the rest of the bytecode format).
+    Always write a whole object with the tvm_object_* constructors, assigning a single
+    member keeps the old tag around.
+    64 bit values take two consecutive slots, low word first.
+*/
+#define TVM_OBJECT_TAG_SHIFT 48
+#define TVM_OBJECT_PAYLOAD_MASK ((UINT64_C(1) << TVM_OBJECT_TAG_SHIFT) - 1)
+
+typedef union {
+    uint64_t raw; // tag | payload
+    uint8_t  ui8;
+    uint32_t ui32;
+    int32_t  i32;
+    float    f32;
 } object_t;
 
+_Static_assert(sizeof(object_t) == 8, "object_t must be a single word");
+
+#define TVM_OBJECT_TYPE(obj) ((uint8_t)((obj).raw >> TVM_OBJECT_TAG_SHIFT))
+#define TVM_OBJECT_PTR(obj)  ((uintptr_t)((obj).raw & TVM_OBJECT_PAYLOAD_MASK))
+
+static inline object_t tvm_object_create(uint8_t type, uint64_t payload) {
+    return (object_t){ .raw = ((uint64_t)type << TVM_OBJECT_TAG_SHIFT) | (payload & TVM_OBJECT_PAYLOAD_MASK) };
+}
+
+static inline object_t tvm_object_i32(int32_t value) {
+    return tvm_object_create(STACK_OBJ_TYPE_NUMBER, (uint32_t)value);
+}
+
+static inline object_t tvm_object_u32(uint32_t value) {
+    return tvm_object_create(STACK_OBJ_TYPE_NUMBER, value);
+}
+
+static inline object_t tvm_object_f32(float value) {
+    object_t obj = tvm_object_create(STACK_OBJ_TYPE_NUMBER, 0);
+    obj.f32 = value;
+    return obj;
+}
+
+static inline object_t tvm_object_ptr(uint8_t type, uintptr_t ptr) {
+    return tvm_object_create(type, ptr);
+}
+
 typedef struct {
     uint8_t type; //optype_t
     object_t operand;
@@ -159,10 +290,14 @@ typedef enum {
     CTYPE_VOID,
 } tvm_ctype;
 
+#define TVM_CFUN_ASYNC 0x01 // "@cfun async", runs on the native pool when the host gives the vm one
+#define TVM_LOADCB_SIGNED (UINT64_C(1) << 32) // loadcb operand bit above the offset, the byte is an i8
+
 typedef struct {
     uint8_t  rtype;           // return type
     uint8_t* atypes;          // arg types
     uint16_t acount;          // arg count
+    uint8_t  flags;           // TVM_CFUN_* bits
     const char* symbol_name;  // function name
 } tvm_program_cfun_t;
 //TODO: support structs and function pointers, it will be much more complicated. it is now only primitives
@@ -174,7 +309,7 @@ typedef struct {
 // } tvm_program_cstruct_t;
 
 typedef struct {
-    tvm_program_cfun_t cfuns[TVM_METADATA_MAX_CFUN_CAPACITY];
+    tvm_program_cfun_t* cfuns;
     const char* module_name;
     uint32_t cfun_count;
 } tvm_program_metadata_module_t;
@@ -186,18 +321,52 @@ typedef struct {
 } tvm_program_metadata_t;
 
 typedef struct {
-    size_t* referances;
-    size_t referance_count;
+    uint32_t* referances; // byte offsets into data, one per @data entry
+    uint32_t referance_count;
     uint8_t* data;
-    size_t data_size;
+    uint32_t data_size;
 } tvm_const_table;
 
+typedef enum {
+    TVM_DEBUG_SYMBOL_PROC,
+    TVM_DEBUG_SYMBOL_LABEL,
+} tvm_debug_symbol_kind_t;
+
+typedef struct {
+    const char* name;
+    uint32_t addr;
+    uint32_t end; // one past the last instruction of a proc, labels leave it 0
+    uint8_t kind; // tvm_debug_symbol_kind_t
+} tvm_debug_symbol_t;
+
+typedef struct {
+    uint32_t addr; // first instruction of a run of instructions on one row
+    uint32_t row;
+} tvm_debug_line_t;
+
+// optional, tasm appends it after the code and the vm runs the same without it.
+// the loader only copies the section, tvm_debug_map decodes it the first time it is needed
+typedef struct {
+    const uint8_t* section;
+    uint32_t section_size;
+    bool mapped;
+    const char* file_name;
+    tvm_debug_line_t* lines; // sorted by addr
+    uint32_t line_count;
+    tvm_debug_symbol_t* symbols; // sorted by addr
+    uint32_t symbol_count;
+} tvm_program_debug_t;
+
+#define TVM_DEBUG_MAGIC 0x47424454 // "TDBG", the last 4 bytes of an image with debug info
+#define TVM_DEBUG_VERSION 1        // first byte of the section
+
 typedef struct {
     tvm_program_metadata_t metadata;
     tvm_const_table const_table;
-    opcode_t code[TVM_PROGRAM_CAPACITY];
+    opcode_t* code;
     size_t size;
-    arena_t* program_arena;
+    tvm_program_debug_t debug;
+    arena_t* program_arena; // owns everything the loader allocates, code included
 } tvm_program_t;
 
 typedef struct tvm_frame {
@@ -210,7 +379,69 @@ typedef struct tvm_gframe {
     object_t global_vars[TVM_MAX_LOCAL_VAR];
 } tvm_gframe_t;
 
+// an async native call, the pool worker only touches this struct so the vm stacks stay single threaded
+typedef struct {
+    tpool_job_t job;
+    void* cif;         // filled by tci_native_bind
+    void (*fn)(void);
+    uint64_t args[64];
+    void* vargs[64];
+    uint64_t ret;
+    uint8_t rtype;
+    void* stats;       // tci_native_stats_t of the native when tci times calls
+    uint64_t ns;       // time the worker spent in the call, set only with stats
+    uint64_t overhead_ns; // building the arguments and binding the call, set only with stats
+    uint32_t argc;     // args in use, heap blocks passed to a call in flight are kept alive
+} tvm_native_call_t;
+
+typedef enum {
+    TVM_FIBER_READY,
+    TVM_FIBER_JOINING, // parked on a join until join_id is done
+    TVM_FIBER_NATIVE,  // parked until its async native call is done
+    TVM_FIBER_DONE,
+} tvm_fiber_state_t;
+
+/*
+    Fibers share the vm stacks, a suspended fiber keeps a copy of just the live slots
+    so an idle fiber costs its frame chain plus a few bytes per stack slot in use.
+*/
 typedef struct {
+    tvm_fiber_state_t state;
+    word_t join_id;
+    word_t ip;
+    object_t result; // top of the stack when the fiber returned
+    tvm_native_call_t* pending;
+
+    object_t* stack;
+    word_t sp;
+    word_t stack_capacity;
+
+    word_t* return_stack;
+    word_t rsp;
+    word_t return_stack_capacity;
+
+    tvm_frame_t* frame;
+} tvm_fiber_t;
+
+typedef struct {
+    tvm_fiber_t* fibers; // stb_ds array indexed by fiber id, 0 is the main program (empty until the first spawn)
+    word_t current;
+} tvm_fiber_sched_t;
+
+#ifdef TVM_STATS
+// dispatch counters of a vm built with TVM_STATS, see tvm_stats_enable
+typedef struct {
+    uint64_t ops[OP_HALT + 1];
+    uint64_t pairs[OP_HALT + 1][OP_HALT + 1]; // [previous][current] opcode
+    uint64_t* hits;  // per instruction address
+    uint64_t* taken; // per instruction address, conditional jumps that did not fall through
+    size_t size;     // program size the address counters were made for
+    uint8_t prev;
+    bool has_prev;
+} tvm_stats_t;
+#endif
+
+typedef struct tvm {
     object_t stack[TVM_STACK_CAPACITY];
     word_t sp; // stack pointer
 
@@ -224,18 +455,72 @@ typedef struct {
     word_t ip; // instruction pointer
 
     bool halted;
+    exception_t except; // set when tvm_step_n stops with TVM_STATUS_EXCEPTION
+    word_t except_ip;   // ip of the faulting instruction
+    uint64_t icount;    // instructions executed since the last reset
+
+    tgc_t gc;
+    struct tci* tci; // native interface, owned by the host (NULL if the program has no natives)
+
+    tvm_fiber_sched_t sched;
+
+    tpool_t* pool;               // async native workers, owned by the host (NULL runs async natives inline)
+    tvm_native_call_t* pending;  // call the vm waits on when there are no fibers
+    bool blocked;                // set when nothing can run until a native call is done
+
+    tpool_t* par_pool;           // pmap/preduce workers, owned by the host (NULL runs them on the vm thread)
+    struct tvm** par_workers;    // stb_ds array of worker vms, created on the first parallel region
+    bool parallel;               // this vm is a pmap/preduce worker
+#ifdef TVM_STATS
+    tvm_stats_t* stats;          // NULL until tvm_stats_enable, pmap/preduce workers are not counted
+#endif
+    struct ttrace* trace;        // set between ttrace_start and ttrace_stop, see ttrace.h
 } tvm_t;
 
 
 
+typedef enum {
+    TVM_STATUS_RUNNING,   // budget used up, call tvm_step_n again
+    TVM_STATUS_HALTED,
+    TVM_STATUS_EXCEPTION, // see vm->except and vm->except_ip
+    TVM_STATUS_BLOCKED,   // waiting on async natives, see tvm_wait_native
+    TVM_STATUS_CHECKPOINT, // ran a ckpt, call tvm_step_n again to go on
+} tvm_status_t;
+
 void tvm_load_program_from_memory(tvm_t* vm, const opcode_t* code, size_t program_size);
 void tvm_save_program_to_memory(tvm_t* vm, opcode_t* code);
-void tvm_load_program_from_file(tvm_t* vm, const char* file_path);
+// both loaders parse a .bin image produced by tasm, the buffer is copied and can be freed afterwards
+bool tvm_load_program_from_buffer(tvm_t* vm, const uint8_t* buffer, size_t size);
+bool tvm_load_program_from_file(tvm_t* vm, const char* file_path);
+
+// decodes the debug section, false when there is none or it is broken
+bool tvm_debug_map(tvm_program_t* program);
+// source row of the instruction at addr, 0 when the program has no debug info or it is not mapped yet
+uint32_t tvm_debug_line(const tvm_program_t* program, word_t addr);
+// the proc addr is in, or the closest label before it outside of procs
+const tvm_debug_symbol_t* tvm_debug_symbol(const tvm_program_t* program, word_t addr);
 void tvm_save_program_to_file(tvm_t* vm, const char* file_path);
+// writes the image tasm would have written for the loaded program, debug section included
+bool tvm_program_write(const tvm_program_t* program, FILE* out);
 const char* exception_to_cstr(exception_t except);
+const char* tvm_opcode_to_cstr(uint8_t op);
 tvm_t tvm_init();
 void tvm_destroy(tvm_t* vm);
+// rewinds the vm to the first instruction and drops the heap, the loaded program stays
+void tvm_reset(tvm_t* vm);
 exception_t tvm_exec_opcode(tvm_t* vm);
+// runs at most budget instructions
+tvm_status_t tvm_step_n(tvm_t* vm, uint64_t budget);
+// marks the blocks reachable from the stacks, frames, globals, fibers and async native calls, then sweeps,
+// tvm_step_n runs it once the heap grows past gc.threshold
+void tvm_gc_collect(tvm_t* vm);
+// sleeps until one of the native calls a blocked vm is waiting on is done
+void tvm_wait_native(tvm_t* vm);
+// starts counting opcodes, addresses, branches and opcode pairs of the loaded program,
+// false when the vm was built without TVM_STATS
+bool tvm_stats_enable(tvm_t* vm);
+// conditional jumps, the ones with taken/not taken counts
+bool tvm_opcode_is_branch(uint8_t op);
 
 tvm_frame_t* tvm_frame_init();
 tvm_gframe_t* tvm_gframe_init();
@@ -244,10 +529,21 @@ tvm_frame_t* tvm_frame_prev(tvm_frame_t* node);
 void tvm_frame_free(tvm_frame_t* last);
 void tvm_gframe_free(tvm_gframe_t* gframe);
 
-void tvm_run(tvm_t* vm);
+exception_t tvm_run(tvm_t* vm);
 void tvm_stack_dump(tvm_t* vm);
+// the faulting instruction and every call on the return stack, innermost first,
+// the vm keeps them until tvm_reset so a host can print this and run the next job
+void tvm_stack_trace(tvm_t* vm, FILE* out);
+
+// start of a native call when tci times them, taken before the arguments are built, 0 otherwise
+uint64_t tci_native_clock(tvm_t* vm);
+bool tci_native_call(tvm_t* vm, uint32_t id, void* rvalue, void** avalues, uint64_t start_ns);
+bool tci_native_bind(tvm_t* vm, uint32_t id, tvm_native_call_t* call, uint64_t start_ns);
+void tci_native_finish(tvm_t* vm, tvm_native_call_t* call);
 
-void tci_native_call(tvm_t* vm, uint32_t id, void* rvalue, void** avalues);
+struct ttrace;
+void ttrace_native_begin(struct ttrace* trace);
+void ttrace_step(struct ttrace* trace, tvm_t* vm, word_t ip, uint8_t op, exception_t except);
 
 #ifdef TVM_IMPLEMENTATION
 
@@ -256,11 +552,21 @@ void tci_native_call(tvm_t* vm, uint32_t id, void* rvalue, void** avalues);
 #include <string.h>
 #include <common/cmd_colors.h>
 
-#define TGC_IMPLEMENTATION
-#include <tvm/tgc.h>
+static void tvm_program_clear(tvm_program_t* program) {
+    arena_reset(&program->program_arena);
+    memset(&program->metadata, 0, sizeof(program->metadata));
+    memset(&program->const_table, 0, sizeof(program->const_table));
+    memset(&program->debug, 0, sizeof(program->debug));
+    program->code = NULL;
+    program->size = 0;
+}
 
 void tvm_load_program_from_memory(tvm_t* vm, const opcode_t* code, size_t program_size) {
+    tvm_program_clear(&vm->program);
     vm->program.size = program_size;
+    if (program_size == 0)
+        return;
+    vm->program.code = arena_alloc(&vm->program.program_arena, program_size * sizeof(vm->program.code[0]));
     memcpy(vm->program.code, code, vm->program.size * sizeof(vm->program.code[0]));
 }
 
@@ -269,98 +575,349 @@ void tvm_save_program_to_memory(tvm_t* vm, opcode_t* program) {
     UNUSED_VAR(program);
 }
 
-void tvm_load_program_from_file(tvm_t* vm, const char* file_path) {
-    FILE* file = fopen(file_path, "rb");
-    if (!file) {
-        perror("Failed to open file");
-        exit(EXIT_FAILURE);
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t cursor;
+} tvm_reader_t;
+
+static bool tvm_read(tvm_reader_t* reader, void* dst, size_t size) {
+    if (reader->size - reader->cursor < size)
+        return false;
+    memcpy(dst, &reader->data[reader->cursor], size);
+    reader->cursor += size;
+    return true;
+}
+
+// copies size bytes into the program arena, with a trailing '\0' for names
+static void* tvm_read_alloc(tvm_reader_t* reader, arena_t** arena, size_t size, bool cstr) {
+    if (reader->size - reader->cursor < size)
+        return NULL;
+    uint8_t* dst = arena_alloc(arena, size + cstr);
+    if (dst == NULL) // arena_alloc(0) gives NULL
+        return NULL;
+    memcpy(dst, &reader->data[reader->cursor], size);
+    if (cstr)
+        dst[size] = '\0';
+    reader->cursor += size;
+    return dst;
+}
+
+static bool tvm_read_uleb(tvm_reader_t* reader, uint32_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!tvm_read(reader, &byte, sizeof(uint8_t)))
+            return false;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = (uint32_t)result;
+            return result <= UINT32_MAX;
+        }
+    }
+    return false;
+}
+
+static bool tvm_read_sleb(tvm_reader_t* reader, int32_t* value) {
+    int64_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!tvm_read(reader, &byte, sizeof(uint8_t)))
+            return false;
+        result |= (int64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            if (byte & 0x40)
+                result -= (int64_t)1 << (shift + 7);
+            *value = (int32_t)result;
+            return result >= INT32_MIN && result <= INT32_MAX;
+        }
+    }
+    return false;
+}
+
+static bool tvm_load_debug(tvm_program_t* program, tvm_reader_t* reader) {
+    tvm_program_debug_t* debug = &program->debug;
+    uint8_t version;
+    uint16_t file_name_len;
+    if (!tvm_read(reader, &version, sizeof(uint8_t)) || version != TVM_DEBUG_VERSION)
+        return false;
+    if (!tvm_read(reader, &file_name_len, sizeof(uint16_t)))
+        return false;
+    debug->file_name = tvm_read_alloc(reader, &program->program_arena, file_name_len, true);
+    if (debug->file_name == NULL || !tvm_read_uleb(reader, &debug->line_count))
+        return false;
+    // every run takes at least 2 bytes
+    if (debug->line_count > (reader->size - reader->cursor) / 2)
+        return false;
+    debug->lines = debug->line_count ? arena_alloc(&program->program_arena, sizeof(tvm_debug_line_t) * debug->line_count) : NULL;
+    uint32_t addr = 0, row = 0;
+    for (uint32_t i = 0; i < debug->line_count; i++) {
+        uint32_t length;
+        int32_t delta;
+        if (!tvm_read_uleb(reader, &length) || !tvm_read_sleb(reader, &delta))
+            return false;
+        row += delta;
+        debug->lines[i] = (tvm_debug_line_t) { .addr = addr, .row = row };
+        addr += length;
     }
-    
-    fseek(file,0L,SEEK_END);
-    long int byte_size = ftell(file);
-    fseek(file,0L,SEEK_SET);
-    size_t opcode_size = sizeof(vm->program.code[0]);
+
+    if (!tvm_read_uleb(reader, &debug->symbol_count))
+        return false;
+    // every symbol takes at least 4 bytes
+    if (debug->symbol_count > (reader->size - reader->cursor) / 4)
+        return false;
+    debug->symbols = debug->symbol_count ? arena_alloc(&program->program_arena, sizeof(tvm_debug_symbol_t) * debug->symbol_count) : NULL;
+    addr = 0;
+    for (uint32_t i = 0; i < debug->symbol_count; i++) {
+        tvm_debug_symbol_t* symbol = &debug->symbols[i];
+        uint32_t delta, length;
+        uint8_t name_len;
+        if (!tvm_read(reader, &symbol->kind, sizeof(uint8_t))
+        || !tvm_read_uleb(reader, &delta)
+        || !tvm_read_uleb(reader, &length)
+        || !tvm_read(reader, &name_len, sizeof(uint8_t)))
+            return false;
+        addr += delta;
+        symbol->addr = addr;
+        symbol->end = symbol->kind == TVM_DEBUG_SYMBOL_PROC ? addr + length : 0;
+        symbol->name = tvm_read_alloc(reader, &program->program_arena, name_len, true);
+        if (symbol->name == NULL)
+            return false;
+    }
+    return true;
+}
+
+bool tvm_debug_map(tvm_program_t* program) {
+    tvm_program_debug_t* debug = &program->debug;
+    if (debug->mapped)
+        return debug->line_count > 0 || debug->symbol_count > 0;
+    if (debug->section == NULL)
+        return false;
+    tvm_reader_t reader = {
+        .data = debug->section,
+        .size = debug->section_size,
+        .cursor = 0,
+    };
+    debug->mapped = true;
+    if (!tvm_load_debug(program, &reader)) {
+        // a broken debug section only costs the debug info
+        fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"ignoring a broken debug section\n");
+        debug->file_name = NULL;
+        debug->lines = NULL;
+        debug->line_count = 0;
+        debug->symbols = NULL;
+        debug->symbol_count = 0;
+        return false;
+    }
+    return true;
+}
+
+uint32_t tvm_debug_line(const tvm_program_t* program, word_t addr) {
+    const tvm_program_debug_t* debug = &program->debug;
+    if (debug->line_count == 0 || addr >= program->size || addr < debug->lines[0].addr)
+        return 0;
+    // the last run that starts at or before addr
+    uint32_t lo = 0, hi = debug->line_count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (debug->lines[mid].addr <= addr)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return debug->lines[lo].row;
+}
+
+const tvm_debug_symbol_t* tvm_debug_symbol(const tvm_program_t* program, word_t addr) {
+    const tvm_debug_symbol_t* label = NULL;
+    for (uint32_t i = 0; i < program->debug.symbol_count; i++) {
+        const tvm_debug_symbol_t* symbol = &program->debug.symbols[i];
+        if (symbol->addr > addr)
+            break;
+        if (symbol->kind == TVM_DEBUG_SYMBOL_PROC) {
+            if (addr < symbol->end)
+                return symbol;
+            label = NULL; // labels before a proc do not cover the code after it
+        } else {
+            label = symbol;
+        }
+    }
+    return label;
+}
+
+bool tvm_load_program_from_buffer(tvm_t* vm, const uint8_t* buffer, size_t size) {
+    tvm_program_t* program = &vm->program;
+    tvm_program_clear(program);
+    tvm_reader_t reader = {
+        .data = buffer,
+        .size = size,
+        .cursor = 0,
+    };
 
     uint32_t module_count;
-    fread(&module_count, sizeof(uint32_t), 1, file);
-    byte_size -= sizeof(uint32_t);
-    vm->program.metadata.module_count = module_count;
+    if (!tvm_read(&reader, &module_count, sizeof(uint32_t)))
+        goto truncated;
+    if (module_count > TVM_METADATA_MAX_MODULE_CAPACITY) {
+        fprintf(stderr, CLR_RED"Invalid program: "CLR_END"%u modules, at most %d are supported\n", module_count, TVM_METADATA_MAX_MODULE_CAPACITY);
+        return false;
+    }
+    program->metadata.module_count = module_count;
 
     for (size_t k = 0; k < module_count; k++) {
+        tvm_program_metadata_module_t* module = &program->metadata.modules[k];
         uint8_t module_name_len;
-        fread(&module_name_len, sizeof(uint8_t), 1, file);
-        byte_size -= sizeof(uint8_t);
-
-        char* module_name = arena_alloc(&vm->program.program_arena, sizeof(char) * module_name_len + 1);
-        fread(module_name, sizeof(char), module_name_len, file);
-        module_name[module_name_len] = '\0';
-        byte_size -= sizeof(char) * module_name_len;
-        vm->program.metadata.modules[k].module_name = module_name;
+        if (!tvm_read(&reader, &module_name_len, sizeof(uint8_t)))
+            goto truncated;
+        module->module_name = tvm_read_alloc(&reader, &program->program_arena, module_name_len, true);
+        if (module->module_name == NULL)
+            goto truncated;
 
         uint32_t cfun_count;
-        fread(&cfun_count, sizeof(uint32_t), 1, file);
-        byte_size -= sizeof(uint32_t);
-        vm->program.metadata.modules[k].cfun_count = cfun_count;
-
-        for (size_t i = 0; i < cfun_count; i++) {    
+        if (!tvm_read(&reader, &cfun_count, sizeof(uint32_t)))
+            goto truncated;
+        // every cfun takes at least 5 bytes, reject counts the image can not hold before allocating
+        if (cfun_count > (reader.size - reader.cursor) / 5)
+            goto truncated;
+        module->cfun_count = cfun_count;
+        module->cfuns = cfun_count ? arena_alloc(&program->program_arena, sizeof(tvm_program_cfun_t) * cfun_count) : NULL;
+
+        for (size_t i = 0; i < cfun_count; i++) {
+            tvm_program_cfun_t* cfun = &module->cfuns[i];
             uint8_t symbol_name_len;
-            fread(&symbol_name_len, sizeof(uint8_t), 1, file);
-            byte_size -= sizeof(uint8_t);
-
-            char* symbol_name = arena_alloc(&vm->program.program_arena, sizeof(char) * symbol_name_len + 1);
-            fread(symbol_name, sizeof(char), symbol_name_len, file);
-            symbol_name[symbol_name_len] = '\0';
-            byte_size -= sizeof(char) * symbol_name_len;
-
-            uint16_t acount;
-            fread(&acount, sizeof(uint16_t), 1, file);
-            byte_size -= sizeof(uint16_t);
-
-            uint8_t rtype;
-            fread(&rtype, sizeof(uint8_t), 1, file);
-            byte_size -= sizeof(uint8_t);
-
-            uint8_t* atypes = arena_alloc(&vm->program.program_arena, sizeof(uint8_t) * acount);
-            fread(atypes, sizeof(uint8_t), acount, file);
-            byte_size -= sizeof(uint8_t) * acount;
-
-            vm->program.metadata.modules[k].cfuns[i].symbol_name = symbol_name;
-            vm->program.metadata.modules[k].cfuns[i].acount = acount;
-            vm->program.metadata.modules[k].cfuns[i].rtype = rtype;
-            vm->program.metadata.modules[k].cfuns[i].atypes = atypes;
+            if (!tvm_read(&reader, &symbol_name_len, sizeof(uint8_t)))
+                goto truncated;
+            cfun->symbol_name = tvm_read_alloc(&reader, &program->program_arena, symbol_name_len, true);
+            if (cfun->symbol_name == NULL
+            || !tvm_read(&reader, &cfun->acount, sizeof(uint16_t))
+            || !tvm_read(&reader, &cfun->rtype, sizeof(uint8_t))
+            || !tvm_read(&reader, &cfun->flags, sizeof(uint8_t)))
+                goto truncated;
+            cfun->atypes = tvm_read_alloc(&reader, &program->program_arena, cfun->acount, false);
+            if (cfun->atypes == NULL && cfun->acount > 0)
+                goto truncated;
         }
     }
     {
-        size_t referance_count;
-        fread(&referance_count, sizeof(size_t), 1, file);
-        byte_size -= sizeof(size_t);
-        size_t data_size;
-        fread(&data_size, sizeof(size_t), 1, file);
-        byte_size -= sizeof(size_t);
-        if (referance_count > 0) {
-            size_t* referances = arena_alloc(&vm->program.program_arena, sizeof(size_t) * referance_count);
-            fread(referances, sizeof(size_t), referance_count, file);
-            byte_size -= sizeof(size_t) * referance_count;
-
-            uint8_t* data = arena_alloc(&vm->program.program_arena, data_size);
-            fread(data, sizeof(uint8_t), data_size, file);
-            byte_size -= sizeof(uint8_t) * data_size;
-
-            vm->program.const_table.referances = referances;
-            vm->program.const_table.data = data;
+        tvm_const_table* table = &program->const_table;
+        if (!tvm_read(&reader, &table->referance_count, sizeof(uint32_t))
+        || !tvm_read(&reader, &table->data_size, sizeof(uint32_t)))
+            goto truncated;
+        if (table->referance_count > 0) {
+            if (table->referance_count > (reader.size - reader.cursor) / sizeof(uint32_t))
+                goto truncated;
+            table->referances = tvm_read_alloc(&reader, &program->program_arena, sizeof(uint32_t) * table->referance_count, false);
+            table->data = tvm_read_alloc(&reader, &program->program_arena, table->data_size, false);
+            if (table->referances == NULL || (table->data == NULL && table->data_size > 0))
+                goto truncated;
         }
-        vm->program.const_table.referance_count = referance_count;
-        vm->program.const_table.data_size = data_size;
     }
-    vm->program.size = byte_size/opcode_size;
-    fread(vm->program.code, opcode_size, vm->program.size, file);
+
+    // the debug section sits between the code and its trailer, the code no longer runs to the end then
+    tvm_reader_t debug_reader = {0};
+    uint32_t magic, debug_size;
+    if (reader.size - reader.cursor >= 2 * sizeof(uint32_t)) {
+        memcpy(&magic, &reader.data[reader.size - sizeof(uint32_t)], sizeof(uint32_t));
+        memcpy(&debug_size, &reader.data[reader.size - 2 * sizeof(uint32_t)], sizeof(uint32_t));
+        if (magic == TVM_DEBUG_MAGIC && debug_size <= reader.size - reader.cursor - 2 * sizeof(uint32_t)) {
+            reader.size -= 2 * sizeof(uint32_t) + debug_size;
+            debug_reader = (tvm_reader_t) {
+                .data = &reader.data[reader.size],
+                .size = debug_size,
+                .cursor = 0,
+            };
+        }
+    }
+
+    size_t code_size = reader.size - reader.cursor;
+    if (code_size % sizeof(opcode_t) != 0) {
+        fprintf(stderr, CLR_RED"Invalid program: "CLR_END"code section is not a multiple of %zu bytes\n", sizeof(opcode_t));
+        return false;
+    }
+    program->size = code_size / sizeof(opcode_t);
+    program->code = tvm_read_alloc(&reader, &program->program_arena, code_size, false);
+    if (debug_reader.data != NULL) {
+        program->debug.section = tvm_read_alloc(&debug_reader, &program->program_arena, debug_reader.size, false);
+        program->debug.section_size = program->debug.section ? debug_reader.size : 0;
+    }
+    return true;
+
+truncated:
+    fprintf(stderr, CLR_RED"Invalid program: "CLR_END"truncated at byte %zu\n", reader.cursor);
+    tvm_program_clear(program);
+    return false;
+}
+
+bool tvm_load_program_from_file(tvm_t* vm, const char* file_path) {
+    FILE* file = fopen(file_path, "rb");
+    if (!file) {
+        perror("Failed to open file");
+        return false;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    long byte_size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    if (byte_size < 0) {
+        fclose(file);
+        return false;
+    }
+
+    uint8_t* buffer = malloc(byte_size ? byte_size : 1);
+    size_t read = fread(buffer, 1, byte_size, file);
     fclose(file);
+
+    bool ok = read == (size_t)byte_size && tvm_load_program_from_buffer(vm, buffer, read);
+    free(buffer);
+    return ok;
 }
 
 
+bool tvm_program_write(const tvm_program_t* program, FILE* out) {
+    const tvm_program_metadata_t* metadata = &program->metadata;
+    fwrite(&metadata->module_count, sizeof(uint32_t), 1, out);
+    for (uint32_t k = 0; k < metadata->module_count; k++) {
+        const tvm_program_metadata_module_t* module = &metadata->modules[k];
+        uint8_t module_name_len = (uint8_t)strlen(module->module_name);
+        fwrite(&module_name_len, sizeof(uint8_t), 1, out);
+        fwrite(module->module_name, 1, module_name_len, out);
+        fwrite(&module->cfun_count, sizeof(uint32_t), 1, out);
+        for (uint32_t i = 0; i < module->cfun_count; i++) {
+            const tvm_program_cfun_t* cfun = &module->cfuns[i];
+            uint8_t symbol_name_len = (uint8_t)strlen(cfun->symbol_name);
+            fwrite(&symbol_name_len, sizeof(uint8_t), 1, out);
+            fwrite(cfun->symbol_name, 1, symbol_name_len, out);
+            fwrite(&cfun->acount, sizeof(uint16_t), 1, out);
+            fwrite(&cfun->rtype, sizeof(uint8_t), 1, out);
+            fwrite(&cfun->flags, sizeof(uint8_t), 1, out);
+            fwrite(cfun->atypes, 1, cfun->acount, out);
+        }
+    }
+    const tvm_const_table* table = &program->const_table;
+    fwrite(&table->referance_count, sizeof(uint32_t), 1, out);
+    fwrite(&table->data_size, sizeof(uint32_t), 1, out);
+    if (table->referance_count > 0) {
+        fwrite(table->referances, sizeof(uint32_t), table->referance_count, out);
+        fwrite(table->data, 1, table->data_size, out);
+    }
+    fwrite(program->code, sizeof(opcode_t), program->size, out);
+    if (program->debug.section != NULL) {
+        uint32_t magic = TVM_DEBUG_MAGIC;
+        fwrite(program->debug.section, 1, program->debug.section_size, out);
+        fwrite(&program->debug.section_size, sizeof(uint32_t), 1, out);
+        fwrite(&magic, sizeof(uint32_t), 1, out);
+    }
+    return !ferror(out);
+}
+
 void tvm_save_program_to_file(tvm_t* vm, const char* file_path) {
-    UNUSED_VAR(vm);
-    UNUSED_VAR(file_path);
+    FILE* file = fopen(file_path, "wb");
+    if (!file) {
+        perror("Failed to open file");
+        return;
+    }
+    if (!tvm_program_write(&vm->program, file))
+        fprintf(stderr, CLR_RED"Failed to write the program: "CLR_END"%s\n", file_path);
+    fclose(file);
 }
 
 
@@ -401,6 +958,16 @@ const char* exception_to_cstr(exception_t except) {
         return "EXCEPT_INVALID_ARRAY_INDEX";
     case EXCEPT_INVALID_BYTE_SIZE:
         return "EXCEPT_INVALID_BYTE_SIZE";
+    case EXCEPT_INVALID_FIBER:
+        return "EXCEPT_INVALID_FIBER";
+    case EXCEPT_FIBER_DEADLOCK:
+        return "EXCEPT_FIBER_DEADLOCK";
+    case EXCEPT_INVALID_PARALLEL_ACCESS:
+        return "EXCEPT_INVALID_PARALLEL_ACCESS";
+    case EXCEPT_INVALID_HEAP_ACCESS:
+        return "EXCEPT_INVALID_HEAP_ACCESS";
+    case EXCEPT_OUT_OF_MEMORY:
+        return "EXCEPT_OUT_OF_MEMORY";
         
     default:
         fprintf(stderr, "Unhandled exception string on function: exception_to_cstr: except_code: %d\n", except);
@@ -409,6 +976,32 @@ const char* exception_to_cstr(exception_t except) {
     return NULL;
 }
 
+// assembler mnemonics, indexed by optype_t
+static const char* const tvm_opcode_names[] = {
+    "nop", "push", "pop", "add", "sub", "mult", "div", "mod", "dup", "cln",
+    "swap", "addf", "subf", "multf", "divf", "inc", "incf", "dec", "decf", "jmp",
+    "jz", "jnz", "call", "ret", "ci2f", "ci2u", "cf2i", "cf2u", "cu2i", "cu2f",
+    "gt", "gtf", "lt", "ltf", "eq", "eqf", "ge", "gef", "le", "lef",
+    "and", "or", "not", "band", "bor", "bnot", "lshft", "rshft", "loadc", "loadcb",
+    "loadcw", "aloadc", "load", "store", "gload", "gstore", "halloc", "deref", "derefb", "hset",
+    "hsetof", "puts", "putc", "native", "spawn", "yield", "join", "pmap", "preduce", "vadd",
+    "vsub", "vmul", "vdiv", "vdot", "vsum", "vmin", "vmax", "vfill", "vcopy", "mcopy",
+    "mfill", "mcmp", "mfind", "hget", "hgetof", "addl", "subl", "multl", "divl", "modl",
+    "divul", "modul", "addd", "subd", "multd", "divd", "cmpl", "cmpul", "cmpd", "ci2l",
+    "cu2l", "cl2i", "cl2d", "cd2l", "cf2d", "cd2f", "jeq", "jne", "jlt", "jle",
+    "jgt", "jge", "jltu", "jleu", "jgtu", "jgeu", "jeqf", "jnef", "jltf", "jlef",
+    "jgtf", "jgef", "ckpt", "halt",
+};
+_Static_assert(sizeof(tvm_opcode_names) / sizeof(tvm_opcode_names[0]) == OP_HALT + 1, "tvm_opcode_names is out of sync with optype_t");
+
+const char* tvm_opcode_to_cstr(uint8_t op) {
+    return op <= OP_HALT ? tvm_opcode_names[op] : "?";
+}
+
+bool tvm_opcode_is_branch(uint8_t op) {
+    return op == OP_JZ || op == OP_JNZ || (op >= OP_JEQ && op <= OP_JGEF);
+}
+
 tvm_t tvm_init() {
     return (tvm_t) {
         .stack = {0},
@@ -423,7 +1016,7 @@ tvm_t tvm_init() {
                 .module_count = 0,
             },
             .const_table = {0},
-            .code = {0},
+            .code = NULL,
             .size = 0,
             .program_arena = arena_init(1024),
         },
@@ -431,13 +1024,958 @@ tvm_t tvm_init() {
         .gframe = tvm_gframe_init(),
         .ip = 0,
         .halted = 0,
+        .except = EXCEPT_OK,
+        .except_ip = 0,
+        .icount = 0,
+        .gc = tgc_init(),
+        .tci = NULL,
+        .sched = {
+            .fibers = NULL,
+            .current = 0,
+        },
+        .pool = NULL,
+        .pending = NULL,
+        .blocked = false,
+        .par_pool = NULL,
+        .par_workers = NULL,
+        .parallel = false,
+#ifdef TVM_STATS
+        .stats = NULL,
+#endif
+        .trace = NULL,
     };
 }
 
+#ifdef TVM_STATS
+bool tvm_stats_enable(tvm_t* vm) {
+    if (vm->stats != NULL)
+        return true;
+    tvm_stats_t* stats = calloc(1, sizeof(tvm_stats_t));
+    if (stats == NULL)
+        return false;
+    stats->size = vm->program.size;
+    stats->hits = calloc(stats->size + 1, sizeof(uint64_t));
+    stats->taken = calloc(stats->size + 1, sizeof(uint64_t));
+    if (stats->hits == NULL || stats->taken == NULL) {
+        free(stats->hits);
+        free(stats->taken);
+        free(stats);
+        return false;
+    }
+    vm->stats = stats;
+    return true;
+}
+
+static void tvm_stats_free(tvm_t* vm) {
+    if (vm->stats == NULL)
+        return;
+    free(vm->stats->hits);
+    free(vm->stats->taken);
+    free(vm->stats);
+    vm->stats = NULL;
+}
+
+// next_ip is the ip after the instruction at ip ran
+static inline void tvm_stats_record(tvm_stats_t* stats, uint8_t op, word_t ip, word_t next_ip) {
+    stats->ops[op]++;
+    if (stats->has_prev)
+        stats->pairs[stats->prev][op]++;
+    stats->prev = op;
+    stats->has_prev = true;
+    if (ip < stats->size) {
+        stats->hits[ip]++;
+        if (next_ip != ip + 1 && tvm_opcode_is_branch(op))
+            stats->taken[ip]++;
+    }
+}
+#else
+bool tvm_stats_enable(tvm_t* vm) {
+    UNUSED_VAR(vm);
+    fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"stats are off, rebuild with -DTVM_STATS=ON\n");
+    return false;
+}
+#endif
+
+static void tvm_frames_free(tvm_frame_t* frame) {
+    while (frame) {
+        tvm_frame_t* prev = frame->prev;
+        tvm_frame_free(frame);
+        frame = prev;
+    }
+}
+
+// the pool may still write into calls in flight, so wait for them before they are freed
+static void tvm_natives_drain(tvm_t* vm) {
+    if (vm->pending) {
+        tpool_wait(vm->pool, &vm->pending->job);
+        free(vm->pending);
+        vm->pending = NULL;
+    }
+    for (size_t i = 0; i < arrlenu(vm->sched.fibers); i++) {
+        tvm_fiber_t* fiber = &vm->sched.fibers[i];
+        if (fiber->pending) {
+            tpool_wait(vm->pool, &fiber->pending->job);
+            free(fiber->pending);
+            fiber->pending = NULL;
+        }
+    }
+    vm->blocked = false;
+}
+
+// drops every fiber but the main one, whose frames go back to the vm
+static void tvm_fibers_free(tvm_t* vm) {
+    tvm_fiber_sched_t* sched = &vm->sched;
+    tvm_natives_drain(vm);
+    if (sched->fibers == NULL)
+        return;
+    if (sched->current != 0) {
+        sched->fibers[sched->current].frame = vm->frame;
+        vm->frame = sched->fibers[0].frame;
+    }
+    for (size_t i = 0; i < arrlenu(sched->fibers); i++) {
+        tvm_fiber_t* fiber = &sched->fibers[i];
+        if (i != 0)
+            tvm_frames_free(fiber->frame);
+        free(fiber->stack);
+        free(fiber->return_stack);
+    }
+    arrfree(sched->fibers);
+    sched->current = 0;
+}
+
 void tvm_destroy(tvm_t* vm) {
     if (vm->program.program_arena)
         arena_destroy(vm->program.program_arena);
+    tvm_fibers_free(vm);
+    tvm_frames_free(vm->frame);
     tvm_gframe_free(vm->gframe);
+    tgc_destroy(&vm->gc);
+    for (size_t i = 0; i < arrlenu(vm->par_workers); i++) {
+        tvm_destroy(vm->par_workers[i]);
+        free(vm->par_workers[i]);
+    }
+    arrfree(vm->par_workers);
+#ifdef TVM_STATS
+    tvm_stats_free(vm);
+#endif
+}
+
+void tvm_reset(tvm_t* vm) {
+    vm->sp = 0;
+    vm->rsp = 0;
+    vm->ip = 0;
+    vm->halted = false;
+    vm->except = EXCEPT_OK;
+    vm->except_ip = 0;
+    vm->icount = 0;
+
+    tvm_fibers_free(vm);
+    // keep the root frame around, only the ones pushed by calls go away
+    while (vm->frame->prev != NULL) {
+        vm->frame = tvm_frame_prev(vm->frame);
+    }
+    memset(vm->frame->local_vars, 0, sizeof(vm->frame->local_vars));
+    memset(vm->gframe->global_vars, 0, sizeof(vm->gframe->global_vars));
+
+    tgc_reset(&vm->gc);
+}
+
+static void tvm_fiber_save(tvm_t* vm, tvm_fiber_t* fiber) {
+    if (fiber->stack_capacity < vm->sp) {
+        fiber->stack_capacity = vm->sp;
+        fiber->stack = realloc(fiber->stack, sizeof(object_t) * vm->sp);
+    }
+    if (fiber->return_stack_capacity < vm->rsp) {
+        fiber->return_stack_capacity = vm->rsp;
+        fiber->return_stack = realloc(fiber->return_stack, sizeof(word_t) * vm->rsp);
+    }
+    if (vm->sp > 0)
+        memcpy(fiber->stack, vm->stack, sizeof(object_t) * vm->sp);
+    if (vm->rsp > 0)
+        memcpy(fiber->return_stack, vm->return_stack, sizeof(word_t) * vm->rsp);
+    fiber->sp = vm->sp;
+    fiber->rsp = vm->rsp;
+    fiber->ip = vm->ip;
+    fiber->frame = vm->frame;
+}
+
+static void tvm_fiber_restore(tvm_t* vm, tvm_fiber_t* fiber) {
+    if (fiber->sp > 0)
+        memcpy(vm->stack, fiber->stack, sizeof(object_t) * fiber->sp);
+    if (fiber->rsp > 0)
+        memcpy(vm->return_stack, fiber->return_stack, sizeof(word_t) * fiber->rsp);
+    vm->sp = fiber->sp;
+    vm->rsp = fiber->rsp;
+    vm->ip = fiber->ip;
+    vm->frame = fiber->frame;
+}
+
+static inline bool tvm_ctype_is_wide(uint8_t ctype) {
+    return ctype == CTYPE_INT64 || ctype == CTYPE_UINT64 || ctype == CTYPE_FLOAT64;
+}
+
+static inline uint64_t tvm_wide_get(tvm_t* vm, word_t slot) {
+    return (uint64_t)vm->stack[slot].ui32 | ((uint64_t)vm->stack[slot + 1].ui32 << 32);
+}
+
+static inline void tvm_wide_set(tvm_t* vm, word_t slot, uint64_t value) {
+    vm->stack[slot] = tvm_object_u32((uint32_t)value);
+    vm->stack[slot + 1] = tvm_object_u32((uint32_t)(value >> 32));
+}
+
+// number of stack slots the args of a native take, wide args take two
+static word_t tvm_native_arg_slots(const tvm_program_cfun_t* cfun) {
+    word_t slots = cfun->acount;
+    for (size_t i = 0; i < cfun->acount; i++)
+        slots += tvm_ctype_is_wide(cfun->atypes[i]);
+    return slots;
+}
+
+static void tvm_native_args(tvm_t* vm, const tvm_program_cfun_t* cfun, uint64_t* args, void** vargs) {
+    word_t slot = vm->sp - tvm_native_arg_slots(cfun);
+    for (size_t i = 0; i < cfun->acount; i++) {
+        if (tvm_ctype_is_wide(cfun->atypes[i])) {
+            args[i] = tvm_wide_get(vm, slot);
+            slot += 2;
+        } else {
+            // natives get the bare payload, pointers must not carry the tag
+            args[i] = TVM_OBJECT_PTR(vm->stack[slot++]);
+        }
+        vargs[i] = &args[i];
+    }
+}
+
+static void tvm_native_push_ret(tvm_t* vm, uint8_t rtype, uint64_t ret) {
+    if (rtype == CTYPE_VOID)
+        return;
+    if (tvm_ctype_is_wide(rtype)) {
+        tvm_wide_set(vm, vm->sp, ret);
+        vm->sp += 2;
+    } else if (rtype == CTYPE_PTR) {
+        vm->stack[vm->sp++] = tvm_object_create(STACK_OBJ_TYPE_NUMBER, ret);
+    } else {
+        vm->stack[vm->sp++] = tvm_object_u32((uint32_t)ret);
+    }
+}
+
+// pushes the result of a finished async call, the args were popped when it was made
+static void tvm_native_finish(tvm_t* vm, tvm_native_call_t* call) {
+    tci_native_finish(vm, call);
+    tvm_native_push_ret(vm, call->rtype, call->ret);
+    free(call);
+}
+
+// the fiber is on the vm stacks now
+static void tvm_fiber_wake(tvm_t* vm, tvm_fiber_t* fiber) {
+    fiber->state = TVM_FIBER_READY;
+    if (fiber->pending) {
+        tvm_native_finish(vm, fiber->pending);
+        fiber->pending = NULL;
+    }
+}
+
+static bool tvm_fiber_runnable(tvm_t* vm, word_t id) {
+    tvm_fiber_t* fiber = &vm->sched.fibers[id];
+    if (fiber->state == TVM_FIBER_JOINING)
+        return vm->sched.fibers[fiber->join_id].state == TVM_FIBER_DONE;
+    if (fiber->state == TVM_FIBER_NATIVE)
+        return tpool_job_done(vm->pool, &fiber->pending->job);
+    return fiber->state == TVM_FIBER_READY;
+}
+
+// round robin from the one after the current fiber, the current one is checked last
+static bool tvm_fiber_next(tvm_t* vm, word_t* id) {
+    word_t count = arrlenu(vm->sched.fibers);
+    for (word_t i = 1; i <= count; i++) {
+        *id = (vm->sched.current + i) % count;
+        if (tvm_fiber_runnable(vm, *id))
+            return true;
+    }
+    return false;
+}
+
+// vm->ip must already point where the running fiber resumes
+static exception_t tvm_fiber_switch(tvm_t* vm) {
+    tvm_fiber_sched_t* sched = &vm->sched;
+    tvm_fiber_t* current = &sched->fibers[sched->current];
+    word_t id;
+    if (tvm_fiber_next(vm, &id)) {
+        if (id != sched->current) {
+            if (current->state != TVM_FIBER_DONE)
+                tvm_fiber_save(vm, current);
+            tvm_fiber_restore(vm, &sched->fibers[id]);
+            sched->current = id;
+        }
+        tvm_fiber_wake(vm, &sched->fibers[id]);
+        return EXCEPT_OK;
+    }
+    // nothing can run, but a native call in flight will wake its fiber up later
+    for (size_t i = 0; i < arrlenu(sched->fibers); i++) {
+        if (sched->fibers[i].state == TVM_FIBER_NATIVE) {
+            if (current->state != TVM_FIBER_DONE)
+                tvm_fiber_save(vm, current);
+            vm->blocked = true;
+            return EXCEPT_OK;
+        }
+    }
+    return EXCEPT_FIBER_DEADLOCK;
+}
+
+// parks whoever made the call, other fibers keep running until the result is in
+static exception_t tvm_native_park(tvm_t* vm, tvm_native_call_t* call) {
+    if (vm->sched.fibers == NULL) {
+        vm->pending = call;
+        vm->blocked = true;
+        return EXCEPT_OK;
+    }
+    tvm_fiber_t* fiber = &vm->sched.fibers[vm->sched.current];
+    fiber->state = TVM_FIBER_NATIVE;
+    fiber->pending = call;
+    return tvm_fiber_switch(vm);
+}
+
+// a blocked vm saved its running fiber already, so the pick is restored without a save
+static bool tvm_native_resume(tvm_t* vm) {
+    if (vm->sched.fibers == NULL) {
+        if (!tpool_job_done(vm->pool, &vm->pending->job))
+            return false;
+        tvm_native_finish(vm, vm->pending);
+        vm->pending = NULL;
+    } else {
+        word_t id;
+        if (!tvm_fiber_next(vm, &id))
+            return false;
+        tvm_fiber_restore(vm, &vm->sched.fibers[id]);
+        vm->sched.current = id;
+        tvm_fiber_wake(vm, &vm->sched.fibers[id]);
+    }
+    vm->blocked = false;
+    return true;
+}
+
+void tvm_wait_native(tvm_t* vm) {
+    if (!vm->blocked || vm->pool == NULL)
+        return;
+    // anything finishing after this read bumps the counter, anything before it is seen by the checks
+    uint64_t seen = tpool_completed(vm->pool);
+    if (vm->pending && tpool_job_done(vm->pool, &vm->pending->job))
+        return;
+    for (size_t i = 0; i < arrlenu(vm->sched.fibers); i++) {
+        tvm_fiber_t* fiber = &vm->sched.fibers[i];
+        if (fiber->state == TVM_FIBER_NATIVE && tpool_job_done(vm->pool, &fiber->pending->job))
+            return;
+    }
+    tpool_wait_completed(vm->pool, seen);
+}
+
+static void tvm_fiber_spawn(tvm_t* vm, word_t ip, object_t arg) {
+    tvm_fiber_sched_t* sched = &vm->sched;
+    if (sched->fibers == NULL) {
+        // the main program becomes fiber 0, its state is saved on the first switch
+        tvm_fiber_t main_fiber = {0};
+        main_fiber.state = TVM_FIBER_READY;
+        arrput(sched->fibers, main_fiber);
+        sched->current = 0;
+    }
+    tvm_fiber_t fiber = {0};
+    fiber.state = TVM_FIBER_READY;
+    fiber.ip = ip;
+    fiber.stack = malloc(sizeof(object_t));
+    fiber.stack[0] = arg;
+    fiber.sp = 1;
+    fiber.stack_capacity = 1;
+    fiber.frame = tvm_frame_init();
+    arrput(sched->fibers, fiber);
+}
+
+/*
+    Parallel regions: the vm that hits pmap/preduce hands chunks of the array to worker vms
+    (one per pool thread plus itself) and does not run anything else until every chunk is done.
+    Workers share the program, get a snapshot of the globals and may read the heap,
+    but halloc, hset, hsetof, spawn and native raise EXCEPT_INVALID_PARALLEL_ACCESS there.
+    Each element is written back only by the worker that owns its chunk, and no collection
+    can run while the heap is shared because the owning vm is stopped in the region.
+*/
+typedef struct {
+    word_t proc;
+    gc_block* block;
+    uint32_t elem_size;
+    word_t slots;       // stack slots of one element, 2 for 8 byte elements
+    uint32_t count;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    bool reduce;
+    object_t* partials; // slots per chunk, preduce only
+
+    tthread_mutex_t mutex;
+    uint32_t next_chunk;
+    exception_t except;
+} tvm_par_region_t;
+
+typedef struct {
+    tpool_job_t job;
+    tvm_par_region_t* region;
+    tvm_t* worker;
+} tvm_par_task_t;
+
+static tvm_t* tvm_par_worker(tvm_t* vm, size_t index) {
+    while (arrlenu(vm->par_workers) <= index) {
+        tvm_t* worker = malloc(sizeof(tvm_t));
+        *worker = tvm_init();
+        // workers run the owner's program, they must not free it
+        arena_destroy(worker->program.program_arena);
+        worker->parallel = true;
+        arrput(vm->par_workers, worker);
+    }
+    tvm_t* worker = vm->par_workers[index];
+    tvm_reset(worker);
+    worker->program = vm->program;
+    worker->program.program_arena = NULL;
+    // natives are not allowed in a region, the tci state and the natives themselves are not thread safe
+    worker->tci = NULL;
+    memcpy(worker->gframe->global_vars, vm->gframe->global_vars, sizeof(vm->gframe->global_vars));
+    return worker;
+}
+
+// calls proc with the arguments already on the worker stack, returning to program.size halts it
+static exception_t tvm_par_call(tvm_t* worker, word_t proc, word_t slots, object_t* result) {
+    worker->return_stack[0] = (word_t)worker->program.size;
+    worker->rsp = 1;
+    worker->frame = tvm_frame_next(worker->frame);
+    worker->ip = proc;
+    worker->halted = false;
+    tvm_step_n(worker, UINT64_MAX);
+
+    exception_t except = worker->except;
+    if (except == EXCEPT_OK && worker->sp < slots)
+        except = EXCEPT_STACK_UNDERFLOW;
+    else if (except == EXCEPT_OK)
+        memcpy(result, &worker->stack[worker->sp - slots], sizeof(object_t) * slots);
+    // a hlt inside the proc leaves its frames behind
+    while (worker->frame->prev != NULL) {
+        worker->frame = tvm_frame_prev(worker->frame);
+    }
+    worker->sp = 0;
+    worker->rsp = 0;
+    worker->except = EXCEPT_OK;
+    return except;
+}
+
+// 8 byte elements are wide values and take two slots, low word first
+static void tvm_par_push(tvm_t* worker, tvm_par_region_t* region, uint32_t index) {
+    const uint8_t* src = (const uint8_t*)region->block->value + (size_t)index * region->elem_size;
+    switch (region->elem_size) {
+    case sizeof(uint8_t):
+        worker->stack[worker->sp++] = tvm_object_u32(*src);
+        break;
+    case sizeof(uint16_t): {
+        uint16_t value;
+        memcpy(&value, src, sizeof(value));
+        worker->stack[worker->sp++] = tvm_object_u32(value);
+        break;
+    }
+    case sizeof(uint32_t): {
+        uint32_t value;
+        memcpy(&value, src, sizeof(value));
+        worker->stack[worker->sp++] = tvm_object_u32(value);
+        break;
+    }
+    default: {
+        uint64_t value;
+        memcpy(&value, src, sizeof(value));
+        tvm_wide_set(worker, worker->sp, value);
+        worker->sp += 2;
+        break;
+    }
+    }
+}
+
+static void tvm_par_store(tvm_par_region_t* region, uint32_t index, const object_t* value) {
+    uint8_t* dst = (uint8_t*)region->block->value + (size_t)index * region->elem_size;
+    switch (region->elem_size) {
+    case sizeof(uint8_t):
+        *dst = value[0].ui8;
+        break;
+    case sizeof(uint16_t): {
+        uint16_t narrow = (uint16_t)value[0].ui32;
+        memcpy(dst, &narrow, sizeof(narrow));
+        break;
+    }
+    case sizeof(uint32_t):
+        memcpy(dst, &value[0].ui32, sizeof(uint32_t));
+        break;
+    default: {
+        uint64_t wide = (uint64_t)value[0].ui32 | ((uint64_t)value[1].ui32 << 32);
+        memcpy(dst, &wide, sizeof(wide));
+        break;
+    }
+    }
+}
+
+static exception_t tvm_par_chunk(tvm_par_region_t* region, tvm_t* worker, uint32_t chunk) {
+    uint32_t begin = chunk * region->chunk_size;
+    uint32_t end = begin + region->chunk_size < region->count ? begin + region->chunk_size : region->count;
+    word_t slots = region->slots;
+    if (region->reduce) {
+        object_t* acc = &region->partials[chunk * slots];
+        tvm_par_push(worker, region, begin);
+        memcpy(acc, worker->stack, sizeof(object_t) * slots);
+        worker->sp = 0;
+        for (uint32_t i = begin + 1; i < end; i++) {
+            memcpy(&worker->stack[worker->sp], acc, sizeof(object_t) * slots);
+            worker->sp += slots;
+            tvm_par_push(worker, region, i);
+            exception_t except = tvm_par_call(worker, region->proc, slots, acc);
+            if (except != EXCEPT_OK)
+                return except;
+        }
+        return EXCEPT_OK;
+    }
+    for (uint32_t i = begin; i < end; i++) {
+        object_t value[2];
+        worker->stack[worker->sp++] = tvm_object_u32(i);
+        tvm_par_push(worker, region, i);
+        exception_t except = tvm_par_call(worker, region->proc, slots, value);
+        if (except != EXCEPT_OK)
+            return except;
+        tvm_par_store(region, i, value);
+    }
+    return EXCEPT_OK;
+}
+
+// chunks are handed out one at a time, so a slow chunk does not hold up the other threads
+static void tvm_par_task_run(void* arg) {
+    tvm_par_task_t* task = (tvm_par_task_t*)arg;
+    tvm_par_region_t* region = task->region;
+    for (;;) {
+        tthread_mutex_lock(&region->mutex);
+        if (region->except != EXCEPT_OK || region->next_chunk >= region->chunk_count) {
+            tthread_mutex_unlock(&region->mutex);
+            break;
+        }
+        uint32_t chunk = region->next_chunk++;
+        tthread_mutex_unlock(&region->mutex);
+
+        exception_t except = tvm_par_chunk(region, task->worker, chunk);
+        if (except != EXCEPT_OK) {
+            tthread_mutex_lock(&region->mutex);
+            if (region->except == EXCEPT_OK)
+                region->except = except;
+            tthread_mutex_unlock(&region->mutex);
+            break;
+        }
+    }
+}
+
+static exception_t tvm_par_region(tvm_t* vm, word_t proc, bool reduce) {
+    // a wide preduce init takes two slots, the array is found by its tag
+    word_t slots = 1;
+    if (reduce && TVM_OBJECT_TYPE(vm->stack[vm->sp - 3]) != STACK_OBJ_TYPE_DATA_ADDRESS)
+        slots = 2;
+    if (vm->sp < (reduce ? 2 + slots : 2))
+        return EXCEPT_STACK_UNDERFLOW;
+    word_t base = vm->sp - (reduce ? 2 + slots : 2);
+    object_t array = vm->stack[base];
+    if (TVM_OBJECT_TYPE(array) != STACK_OBJ_TYPE_DATA_ADDRESS)
+        return EXCEPT_INVALID_PARALLEL_ACCESS;
+    tvm_par_region_t region = {
+        .proc = proc,
+        .block = (gc_block*)TVM_OBJECT_PTR(array),
+        .elem_size = vm->stack[base + 1].ui32,
+        .reduce = reduce,
+        .partials = NULL,
+        .next_chunk = 0,
+        .except = EXCEPT_OK,
+    };
+    switch (region.elem_size) {
+    case sizeof(uint8_t): case sizeof(uint16_t): case sizeof(uint32_t): region.slots = 1; break;
+    case sizeof(uint64_t): region.slots = 2; break;
+    default: return EXCEPT_INVALID_PRIMITIVE_SIZE;
+    }
+    if (reduce && region.slots != slots)
+        return EXCEPT_INVALID_PRIMITIVE_SIZE;
+    region.count = region.block->size / region.elem_size;
+
+    int thread_count = 1 + (vm->par_pool ? vm->par_pool->thread_count : 0);
+    region.chunk_size = region.count / (thread_count * TVM_PAR_CHUNKS_PER_THREAD);
+    if (region.chunk_size == 0)
+        region.chunk_size = 1;
+    region.chunk_count = (region.count + region.chunk_size - 1) / region.chunk_size;
+    if (reduce) {
+        region.partials = malloc(sizeof(object_t) * region.slots * (region.chunk_count ? region.chunk_count : 1));
+        if (region.partials == NULL)
+            return EXCEPT_OUT_OF_MEMORY;
+    }
+    tthread_mutex_init(&region.mutex);
+
+    // the calling thread takes a share of the chunks too
+    tvm_par_task_t* tasks = malloc(sizeof(tvm_par_task_t) * thread_count);
+    for (int i = 0; i < thread_count; i++) {
+        tasks[i] = (tvm_par_task_t) {
+            .job = { .fn = tvm_par_task_run, .arg = &tasks[i] },
+            .region = &region,
+            .worker = tvm_par_worker(vm, i),
+        };
+        if (i > 0)
+            tpool_submit(vm->par_pool, &tasks[i].job);
+    }
+    tvm_par_task_run(&tasks[0]);
+    for (int i = 1; i < thread_count; i++) {
+        tpool_wait(vm->par_pool, &tasks[i].job);
+    }
+
+    // partial results are folded in chunk order, so the result does not depend on the schedule
+    object_t acc[2] = { tvm_object_i32(0), tvm_object_i32(0) };
+    if (reduce)
+        memcpy(acc, &vm->stack[base + 2], sizeof(object_t) * slots);
+    for (uint32_t i = 0; reduce && region.except == EXCEPT_OK && i < region.chunk_count; i++) {
+        tvm_t* worker = tasks[0].worker;
+        memcpy(&worker->stack[worker->sp], acc, sizeof(object_t) * slots);
+        memcpy(&worker->stack[worker->sp + slots], &region.partials[i * slots], sizeof(object_t) * slots);
+        worker->sp += 2 * slots;
+        region.except = tvm_par_call(worker, proc, slots, acc);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        vm->icount += tasks[i].worker->icount;
+    }
+    tthread_mutex_destroy(&region.mutex);
+    free(region.partials);
+    free(tasks);
+    if (region.except != EXCEPT_OK)
+        return region.except;
+
+    vm->sp = base;
+    if (reduce) {
+        memcpy(&vm->stack[vm->sp], acc, sizeof(object_t) * slots);
+        vm->sp += slots;
+    }
+    return EXCEPT_OK;
+}
+
+static gc_block* tvm_heap_block(object_t obj) {
+    if (TVM_OBJECT_TYPE(obj) != STACK_OBJ_TYPE_DATA_ADDRESS || TVM_OBJECT_PTR(obj) == 0)
+        return NULL;
+    return (gc_block*)TVM_OBJECT_PTR(obj);
+}
+
+/*
+    8 byte hset/hsetof keep heap and constant addresses as whole tagged words and anything else
+    as its payload, so the GC and snapshots can find the pointers inside a block and hget ptr
+    gives them back. They may sit at any byte offset of a block.
+*/
+static inline uint64_t tvm_heap_word(object_t obj) {
+    uint8_t type = TVM_OBJECT_TYPE(obj);
+    if (type == STACK_OBJ_TYPE_DATA_ADDRESS || type == STACK_OBJ_TYPE_CONST_ADDRESS)
+        return obj.raw;
+    return TVM_OBJECT_PTR(obj);
+}
+
+static inline object_t tvm_heap_object(uint64_t word) {
+    uint8_t type = (uint8_t)(word >> TVM_OBJECT_TAG_SHIFT);
+    if (type == STACK_OBJ_TYPE_DATA_ADDRESS || type == STACK_OBJ_TYPE_CONST_ADDRESS)
+        return (object_t){ .raw = word };
+    return tvm_object_create(STACK_OBJ_TYPE_NUMBER, word);
+}
+
+static bool tvm_vec_type(object_t operand, tvec_type_t* type) {
+    switch (operand.ui32) {
+    case CTYPE_INT32:   *type = TVEC_I32; return true;
+    case CTYPE_UINT32:  *type = TVEC_U32; return true;
+    case CTYPE_FLOAT32: *type = TVEC_F32; return true;
+    default: return false;
+    }
+}
+
+// every vector opcode checks its blocks once, the kernels then run unchecked
+static exception_t tvm_exec_vec(tvm_t* vm, opcode_t inst) {
+    static const uint8_t argc[] = { 3, 3, 3, 3, 2, 1, 1, 1, 2, 2 };
+    uint8_t count = argc[inst.type - OP_VADD];
+    tvec_type_t type;
+    if (vm->sp < count)
+        return EXCEPT_STACK_UNDERFLOW;
+    if (!tvm_vec_type(inst.operand, &type))
+        return EXCEPT_INVALID_PRIMITIVE_SIZE;
+    bool writes = inst.type <= OP_VDIV || inst.type == OP_VFILL || inst.type == OP_VCOPY;
+    if (writes && vm->parallel)
+        return EXCEPT_INVALID_PARALLEL_ACCESS;
+
+    object_t* args = &vm->stack[vm->sp - count];
+    gc_block* first = tvm_heap_block(args[0]);
+    if (first == NULL)
+        return EXCEPT_INVALID_HEAP_ACCESS;
+    size_t n = first->size / sizeof(uint32_t);
+    // the other array operands must hold at least as many elements as the first
+    for (uint8_t i = 1; i < count; i++) {
+        if (inst.type == OP_VFILL)
+            break;
+        gc_block* block = tvm_heap_block(args[i]);
+        if (block == NULL)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        if (block->size < n * sizeof(uint32_t))
+            return EXCEPT_INVALID_ARRAY_INDEX;
+    }
+
+    object_t result = tvm_object_u32(0);
+    switch (inst.type) {
+    case OP_VADD:
+    case OP_VSUB:
+    case OP_VMUL:
+    case OP_VDIV:
+        if (!tvec_binary((tvec_op_t)(inst.type - OP_VADD), type, first->value, tvm_heap_block(args[1])->value, tvm_heap_block(args[2])->value, n))
+            return EXCEPT_DIVISION_BY_ZERO;
+        break;
+    case OP_VDOT: result = tvm_object_u32(tvec_dot(type, first->value, tvm_heap_block(args[1])->value, n)); break;
+    case OP_VSUM: result = tvm_object_u32(tvec_sum(type, first->value, n)); break;
+    case OP_VMIN: result = tvm_object_u32(tvec_min(type, first->value, n)); break;
+    case OP_VMAX: result = tvm_object_u32(tvec_max(type, first->value, n)); break;
+    case OP_VFILL: tvec_fill(first->value, args[1].ui32, n); break;
+    case OP_VCOPY: tvec_copy(first->value, tvm_heap_block(args[1])->value, n); break;
+    default: return EXCEPT_INVALID_INSTRUCTION;
+    }
+    vm->sp -= count;
+    if (inst.type >= OP_VDOT && inst.type <= OP_VMAX)
+        vm->stack[vm->sp++] = result;
+    vm->ip++;
+    return EXCEPT_OK;
+}
+
+// resolves [off, off + len) of a heap block or of the constant table, constants are read only
+static exception_t tvm_mem_range(tvm_t* vm, object_t obj, uint32_t off, uint32_t len, bool write, uint8_t** out) {
+    uint8_t* base;
+    uint64_t size;
+    switch (TVM_OBJECT_TYPE(obj)) {
+    case STACK_OBJ_TYPE_DATA_ADDRESS: {
+        gc_block* block = tvm_heap_block(obj);
+        if (block == NULL)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        base = block->value;
+        size = block->size;
+        break;
+    }
+    case STACK_OBJ_TYPE_CONST_ADDRESS: {
+        uint8_t* ptr = (uint8_t*)TVM_OBJECT_PTR(obj);
+        uint8_t* data = vm->program.const_table.data;
+        if (write)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        if (data == NULL || ptr < data || ptr > data + vm->program.const_table.data_size)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        base = ptr;
+        size = (uint64_t)(data + vm->program.const_table.data_size - ptr);
+        break;
+    }
+    default:
+        return EXCEPT_INVALID_HEAP_ACCESS;
+    }
+    if ((uint64_t)off + len > size)
+        return EXCEPT_INVALID_ARRAY_INDEX;
+    *out = base + off;
+    return EXCEPT_OK;
+}
+
+static exception_t tvm_exec_mem(tvm_t* vm, opcode_t inst) {
+    uint8_t count = (inst.type == OP_MCOPY || inst.type == OP_MCMP) ? 5 : 4;
+    if (vm->sp < count)
+        return EXCEPT_STACK_UNDERFLOW;
+    bool writes = inst.type == OP_MCOPY || inst.type == OP_MFILL;
+    if (writes && vm->parallel)
+        return EXCEPT_INVALID_PARALLEL_ACCESS;
+
+    object_t* args = &vm->stack[vm->sp - count];
+    uint32_t len = args[count - 1].ui32;
+    uint8_t* a;
+    uint8_t* b;
+    object_t result = tvm_object_i32(0);
+    exception_t except = tvm_mem_range(vm, args[0], args[1].ui32, len, writes, &a);
+    if (except != EXCEPT_OK)
+        return except;
+    switch (inst.type) {
+    case OP_MCOPY:
+    case OP_MCMP:
+        except = tvm_mem_range(vm, args[2], args[3].ui32, len, false, &b);
+        if (except != EXCEPT_OK)
+            return except;
+        if (inst.type == OP_MCOPY) {
+            memmove(a, b, len);
+        } else {
+            int cmp = memcmp(a, b, len);
+            result = tvm_object_i32((cmp > 0) - (cmp < 0));
+        }
+        break;
+    case OP_MFILL:
+        memset(a, args[2].ui8, len);
+        break;
+    case OP_MFIND: {
+        uint8_t* found = memchr(a, args[2].ui8, len);
+        result = tvm_object_i32(found ? (int32_t)(args[1].ui32 + (found - a)) : -1);
+        break;
+    }
+    default:
+        return EXCEPT_INVALID_INSTRUCTION;
+    }
+    vm->sp -= count;
+    if (!writes)
+        vm->stack[vm->sp++] = result;
+    vm->ip++;
+    return EXCEPT_OK;
+}
+
+static exception_t tvm_exec_hget(tvm_t* vm, opcode_t inst) {
+    if (vm->sp < 2)
+        return EXCEPT_STACK_UNDERFLOW;
+    uint32_t size;
+    switch (inst.operand.ui32) {
+    case CTYPE_UINT8:  case CTYPE_INT8:  size = sizeof(uint8_t);  break;
+    case CTYPE_UINT16: case CTYPE_INT16: size = sizeof(uint16_t); break;
+    case CTYPE_UINT32: case CTYPE_INT32: case CTYPE_FLOAT32: size = sizeof(uint32_t); break;
+    case CTYPE_UINT64: case CTYPE_INT64: case CTYPE_FLOAT64: case CTYPE_PTR: size = sizeof(uint64_t); break;
+    default: return EXCEPT_INVALID_PRIMITIVE_SIZE;
+    }
+    object_t addr = vm->stack[vm->sp - 2];
+    gc_block* block = tvm_heap_block(addr);
+    if (block == NULL)
+        return EXCEPT_INVALID_HEAP_ACCESS;
+    uint64_t offset = vm->stack[vm->sp - 1].ui32;
+    if (inst.type == OP_HGET)
+        offset *= size;
+    if (offset + size > block->size)
+        return EXCEPT_INVALID_ARRAY_INDEX;
+
+    // fields of packed structs are not aligned, so go through memcpy
+    const uint8_t* src = (const uint8_t*)block->value + offset;
+    if (tvm_ctype_is_wide(inst.operand.ui32)) {
+        // wide values take the two slots of addr and index, low word first
+        uint64_t v;
+        memcpy(&v, src, sizeof(v));
+        tvm_wide_set(vm, vm->sp - 2, v);
+        vm->ip++;
+        return EXCEPT_OK;
+    }
+    object_t value;
+    switch (inst.operand.ui32) {
+    case CTYPE_UINT8:  value = tvm_object_u32(*src); break;
+    case CTYPE_INT8:   value = tvm_object_i32((int8_t)*src); break;
+    case CTYPE_UINT16: { uint16_t v; memcpy(&v, src, sizeof(v)); value = tvm_object_u32(v); break; }
+    case CTYPE_INT16:  { int16_t v; memcpy(&v, src, sizeof(v)); value = tvm_object_i32(v); break; }
+    case CTYPE_UINT32: { uint32_t v; memcpy(&v, src, sizeof(v)); value = tvm_object_u32(v); break; }
+    case CTYPE_INT32:  { int32_t v; memcpy(&v, src, sizeof(v)); value = tvm_object_i32(v); break; }
+    case CTYPE_PTR:    { uint64_t v; memcpy(&v, src, sizeof(v)); value = tvm_heap_object(v); break; }
+    default:           { float v; memcpy(&v, src, sizeof(v)); value = tvm_object_f32(v); break; } // CTYPE_FLOAT32
+    }
+    vm->stack[vm->sp - 2] = value;
+    vm->sp--;
+    vm->ip++;
+    return EXCEPT_OK;
+}
+
+static inline double tvm_wide_f64(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint64_t tvm_f64_wide(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static exception_t tvm_exec_wide(tvm_t* vm, opcode_t inst) {
+    switch (inst.type) {
+    case OP_CI2L:
+    case OP_CU2L:
+    case OP_CF2D: {
+        if (vm->sp < 1)
+            return EXCEPT_STACK_UNDERFLOW;
+        else if (vm->sp >= TVM_STACK_CAPACITY)
+            return EXCEPT_STACK_OVERFLOW;
+        object_t value = vm->stack[vm->sp - 1];
+        uint64_t wide;
+        switch (inst.type) {
+        case OP_CI2L: wide = (uint64_t)(int64_t)value.i32; break;
+        case OP_CU2L: wide = value.ui32; break;
+        default:      wide = tvm_f64_wide(value.f32); break;
+        }
+        tvm_wide_set(vm, vm->sp - 1, wide);
+        vm->sp++;
+        break;
+    }
+    case OP_CL2I:
+    case OP_CD2F: {
+        if (vm->sp < 2)
+            return EXCEPT_STACK_UNDERFLOW;
+        uint64_t wide = tvm_wide_get(vm, vm->sp - 2);
+        vm->stack[vm->sp - 2] = inst.type == OP_CL2I ? tvm_object_u32((uint32_t)wide) : tvm_object_f32((float)tvm_wide_f64(wide));
+        vm->sp--;
+        break;
+    }
+    case OP_CL2D:
+    case OP_CD2L: {
+        if (vm->sp < 2)
+            return EXCEPT_STACK_UNDERFLOW;
+        uint64_t wide = tvm_wide_get(vm, vm->sp - 2);
+        if (inst.type == OP_CL2D)
+            wide = tvm_f64_wide((double)(int64_t)wide);
+        else
+            wide = (uint64_t)(int64_t)tvm_wide_f64(wide);
+        tvm_wide_set(vm, vm->sp - 2, wide);
+        break;
+    }
+    default: {
+        if (vm->sp < 4)
+            return EXCEPT_STACK_UNDERFLOW;
+        uint64_t a = tvm_wide_get(vm, vm->sp - 4);
+        uint64_t b = tvm_wide_get(vm, vm->sp - 2);
+        double da = tvm_wide_f64(a), db = tvm_wide_f64(b);
+        uint64_t r;
+        switch (inst.type) {
+        case OP_ADDL:  r = a + b; break;
+        case OP_SUBL:  r = a - b; break;
+        case OP_MULTL: r = a * b; break;
+        case OP_DIVL:
+        case OP_MODL:
+            if (b == 0)
+                return EXCEPT_DIVISION_BY_ZERO;
+            // INT64_MIN / -1 overflows in C, it wraps here
+            if ((int64_t)b == -1)
+                r = inst.type == OP_DIVL ? 0 - a : 0;
+            else
+                r = inst.type == OP_DIVL ? (uint64_t)((int64_t)a / (int64_t)b) : (uint64_t)((int64_t)a % (int64_t)b);
+            break;
+        case OP_DIVUL:
+        case OP_MODUL:
+            if (b == 0)
+                return EXCEPT_DIVISION_BY_ZERO;
+            r = inst.type == OP_DIVUL ? a / b : a % b;
+            break;
+        case OP_ADDD:  r = tvm_f64_wide(da + db); break;
+        case OP_SUBD:  r = tvm_f64_wide(da - db); break;
+        case OP_MULTD: r = tvm_f64_wide(da * db); break;
+        case OP_DIVD:  r = tvm_f64_wide(da / db); break;
+        case OP_CMPL:
+        case OP_CMPUL:
+        case OP_CMPD: {
+            int32_t cmp;
+            if (inst.type == OP_CMPL)
+                cmp = ((int64_t)a > (int64_t)b) - ((int64_t)a < (int64_t)b);
+            else if (inst.type == OP_CMPUL)
+                cmp = (a > b) - (a < b);
+            else
+                cmp = da < db ? -1 : da == db ? 0 : 1;
+            vm->stack[vm->sp - 4] = tvm_object_i32(cmp);
+            vm->sp -= 3;
+            vm->ip++;
+            return EXCEPT_OK;
+        }
+        default:
+            return EXCEPT_INVALID_INSTRUCTION;
+        }
+        tvm_wide_set(vm, vm->sp - 4, r);
+        vm->sp -= 2;
+        break;
+    }
+    }
+    vm->ip++;
+    return EXCEPT_OK;
 }
 
 exception_t tvm_exec_opcode(tvm_t* vm) {
@@ -465,7 +2003,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 += vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 + vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -474,7 +2012,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 -= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 - vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -483,7 +2021,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 *= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 * vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -494,7 +2032,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_OVERFLOW;
         if (vm->stack[vm->sp - 1].i32 == 0)
             return EXCEPT_DIVISION_BY_ZERO;
-        vm->stack[vm->sp - 2].i32 /= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 / vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -505,7 +2043,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_OVERFLOW;
         if (vm->stack[vm->sp - 1].i32 == 0)
             return EXCEPT_DIVISION_BY_ZERO;
-        vm->stack[vm->sp - 2].i32 %= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 % vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -514,7 +2052,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp].i32 = vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp] = vm->stack[vm->sp - 1];
         vm->sp++;
         vm->ip++;
         break;
@@ -544,7 +2082,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].f32 += vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_f32(vm->stack[vm->sp - 2].f32 + vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -553,7 +2091,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].f32 -= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_f32(vm->stack[vm->sp - 2].f32 - vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -562,7 +2100,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].f32 *= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_f32(vm->stack[vm->sp - 2].f32 * vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -571,32 +2109,32 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].f32 /= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_f32(vm->stack[vm->sp - 2].f32 / vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
     case OP_INC:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 += 1;
+        vm->stack[vm->sp - 1] = tvm_object_i32(vm->stack[vm->sp - 1].i32 + 1);
         vm->ip++;
         break;
     case OP_INCF:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].f32 += 1;
+        vm->stack[vm->sp - 1] = tvm_object_f32(vm->stack[vm->sp - 1].f32 + 1);
         vm->ip++;
         break;
     case OP_DEC:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 -= 1;
+        vm->stack[vm->sp - 1] = tvm_object_i32(vm->stack[vm->sp - 1].i32 - 1);
         vm->ip++;
         break;
     case OP_DECF:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].f32 -= 1;
+        vm->stack[vm->sp - 1] = tvm_object_f32(vm->stack[vm->sp - 1].f32 - 1);
         vm->ip++;
         break;
     case OP_JMP:
@@ -625,6 +2163,51 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         else 
             vm->ip++;
         break;
+    case OP_JEQ:
+    case OP_JNE:
+    case OP_JLT:
+    case OP_JLE:
+    case OP_JGT:
+    case OP_JGE:
+    case OP_JLTU:
+    case OP_JLEU:
+    case OP_JGTU:
+    case OP_JGEU:
+    case OP_JEQF:
+    case OP_JNEF:
+    case OP_JLTF:
+    case OP_JLEF:
+    case OP_JGTF:
+    case OP_JGEF: {
+        if (vm->sp < 2)
+            return EXCEPT_STACK_UNDERFLOW;
+        else if (inst.operand.ui32 >= vm->program.size)
+            return EXCEPT_INVALID_INSTRUCTION_ACCESS;
+        object_t a = vm->stack[vm->sp - 2];
+        object_t b = vm->stack[vm->sp - 1];
+        bool taken;
+        switch (inst.type) {
+        case OP_JEQ:  taken = a.i32 == b.i32; break;
+        case OP_JNE:  taken = a.i32 != b.i32; break;
+        case OP_JLT:  taken = a.i32 < b.i32; break;
+        case OP_JLE:  taken = a.i32 <= b.i32; break;
+        case OP_JGT:  taken = a.i32 > b.i32; break;
+        case OP_JGE:  taken = a.i32 >= b.i32; break;
+        case OP_JLTU: taken = a.ui32 < b.ui32; break;
+        case OP_JLEU: taken = a.ui32 <= b.ui32; break;
+        case OP_JGTU: taken = a.ui32 > b.ui32; break;
+        case OP_JGEU: taken = a.ui32 >= b.ui32; break;
+        case OP_JEQF: taken = a.f32 == b.f32; break;
+        case OP_JNEF: taken = a.f32 != b.f32; break;
+        case OP_JLTF: taken = a.f32 < b.f32; break;
+        case OP_JLEF: taken = a.f32 <= b.f32; break;
+        case OP_JGTF: taken = a.f32 > b.f32; break;
+        default:      taken = a.f32 >= b.f32; break;
+        }
+        vm->sp -= 2;
+        vm->ip = taken ? inst.operand.ui32 : vm->ip + 1;
+        break;
+    }
     case OP_CALL: {
         if (vm->rsp >= RETURN_STACK_CAPACITY)
             return EXCEPT_RETURN_STACK_OVERFLOW;
@@ -636,6 +2219,22 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         break; 
     }
     case OP_RET: {
+        if (vm->rsp < 1 && vm->sched.current != 0) {
+            // returning from the fiber entry proc ends the fiber
+            tvm_fiber_t* fiber = &vm->sched.fibers[vm->sched.current];
+            fiber->state = TVM_FIBER_DONE;
+            fiber->result = vm->sp > 0 ? vm->stack[vm->sp - 1] : tvm_object_i32(0);
+            tvm_frames_free(vm->frame);
+            vm->frame = NULL;
+            fiber->frame = NULL;
+            free(fiber->stack);
+            free(fiber->return_stack);
+            fiber->stack = NULL;
+            fiber->return_stack = NULL;
+            fiber->stack_capacity = 0;
+            fiber->return_stack_capacity = 0;
+            return tvm_fiber_switch(vm);
+        }
         if (vm->rsp < 1)
             return EXCEPT_RETURN_STACK_UNDERFLOW;
         vm->ip = vm->return_stack[--vm->rsp];
@@ -645,37 +2244,37 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
     case OP_CI2F:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].f32 = vm->stack[vm->sp - 1].i32;  
+        vm->stack[vm->sp - 1] = tvm_object_f32(vm->stack[vm->sp - 1].i32);  
         vm->ip++;
         break;
     case OP_CI2U:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].ui32 = vm->stack[vm->sp - 1].i32;  
+        vm->stack[vm->sp - 1] = tvm_object_u32(vm->stack[vm->sp - 1].i32);  
         vm->ip++;
         break;        
     case OP_CF2I:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 = vm->stack[vm->sp - 1].f32;  
+        vm->stack[vm->sp - 1] = tvm_object_i32(vm->stack[vm->sp - 1].f32);  
         vm->ip++;
         break;
     case OP_CF2U:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].ui32 = vm->stack[vm->sp - 1].f32;  
+        vm->stack[vm->sp - 1] = tvm_object_u32(vm->stack[vm->sp - 1].f32);  
         vm->ip++;
         break;
     case OP_CU2I:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 = vm->stack[vm->sp - 1].ui32;  
+        vm->stack[vm->sp - 1] = tvm_object_i32(vm->stack[vm->sp - 1].ui32);  
         vm->ip++;
         break;
     case OP_CU2F:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].f32 = vm->stack[vm->sp - 1].ui32;  
+        vm->stack[vm->sp - 1] = tvm_object_f32(vm->stack[vm->sp - 1].ui32);  
         vm->ip++;
         break;
     case OP_GT:
@@ -683,7 +2282,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 > vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 > vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++; 
         break;
@@ -692,7 +2291,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].f32 > vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].f32 > vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -701,7 +2300,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 < vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 < vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -710,7 +2309,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].f32 <= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].f32 < vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -719,7 +2318,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 == vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 == vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -728,7 +2327,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].f32 == vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].f32 == vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -737,7 +2336,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 >= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 >= vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -746,7 +2345,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].f32 >= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].f32 >= vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -755,7 +2354,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 <= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 <= vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -764,7 +2363,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].f32 <= vm->stack[vm->sp - 1].f32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].f32 <= vm->stack[vm->sp - 1].f32);
         vm->sp--;
         vm->ip++;
         break;
@@ -773,7 +2372,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 && vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 && vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
@@ -782,64 +2381,88 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_STACK_UNDERFLOW;
         else if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        vm->stack[vm->sp - 2].i32 = vm->stack[vm->sp - 2].i32 || vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 || vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
     case OP_NOT:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 = !vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 1] = tvm_object_i32(!vm->stack[vm->sp - 1].i32);
         vm->ip++;
         break;
     case OP_BAND:
         if (vm->sp < 2)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 2].i32 &= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 & vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
     case OP_BOR:
         if (vm->sp < 2)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 2].i32 |= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 | vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
     case OP_BNOT:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].i32 = ~vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 1] = tvm_object_i32(~vm->stack[vm->sp - 1].i32);
         vm->ip++;
         break;
     case OP_LSHFT:
         if (vm->sp < 2)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 2].i32 <<= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 << vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
     case OP_RSHFT:
         if (vm->sp < 2)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 2].i32 >>= vm->stack[vm->sp - 1].i32;
+        vm->stack[vm->sp - 2] = tvm_object_i32(vm->stack[vm->sp - 2].i32 >> vm->stack[vm->sp - 1].i32);
         vm->sp--;
         vm->ip++;
         break;
+    // constant loads carry the byte offset in the constant table, tasm keeps them naturally aligned
     case OP_LOADC:
         if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        if (inst.operand.ui32 >= vm->program.const_table.referance_count)
+        if ((uint64_t)inst.operand.ui32 + sizeof(uint32_t) > vm->program.const_table.data_size)
+            return EXCEPT_INVALID_CONSTANT_ACCESS;
+        vm->stack[vm->sp++] = tvm_object_u32(*(uint32_t*)&vm->program.const_table.data[inst.operand.ui32]);
+        vm->ip++;
+        break;
+    case OP_LOADCB: {
+        if (vm->sp >= TVM_STACK_CAPACITY)
+            return EXCEPT_STACK_OVERFLOW;
+        if (inst.operand.ui32 >= vm->program.const_table.data_size)
             return EXCEPT_INVALID_CONSTANT_ACCESS;
-        vm->stack[vm->sp++].ui32 = *(uint32_t*)&vm->program.const_table.data[vm->program.const_table.referances[inst.operand.ui32]];
+        // the operand tag tells apart chars and numbers
+        uint8_t byte = vm->program.const_table.data[inst.operand.ui32];
+        uint32_t value = (inst.operand.raw & TVM_LOADCB_SIGNED) ? (uint32_t)(int32_t)(int8_t)byte : byte;
+        vm->stack[vm->sp++] = tvm_object_create(TVM_OBJECT_TYPE(inst.operand), value);
         vm->ip++;
         break;
+    }
+    case OP_LOADCW: {
+        if (vm->sp + 2 > TVM_STACK_CAPACITY)
+            return EXCEPT_STACK_OVERFLOW;
+        if ((uint64_t)inst.operand.ui32 + sizeof(uint64_t) > vm->program.const_table.data_size)
+            return EXCEPT_INVALID_CONSTANT_ACCESS;
+        uint64_t value = *(uint64_t*)&vm->program.const_table.data[inst.operand.ui32];
+        vm->stack[vm->sp++] = tvm_object_u32((uint32_t)value);
+        vm->stack[vm->sp++] = tvm_object_u32((uint32_t)(value >> 32));
+        vm->ip++;
+        break;
+    }
     case OP_ALOADC:
         if (vm->sp >= TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        if (inst.operand.ui32 >= vm->program.const_table.referance_count)
+        if (inst.operand.ui32 >= vm->program.const_table.data_size)
             return EXCEPT_INVALID_CONSTANT_ADDRESS_ACCESS;
-        vm->stack[vm->sp++].ui64 = (intptr_t)&vm->program.const_table.data[vm->program.const_table.referances[inst.operand.ui32]];
+        vm->stack[vm->sp++] = tvm_object_ptr(STACK_OBJ_TYPE_CONST_ADDRESS, (uintptr_t)&vm->program.const_table.data[inst.operand.ui32]);
         vm->ip++;
         break;
     case OP_LOAD:
@@ -874,18 +2497,23 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         vm->gframe->global_vars[inst.operand.ui32] = vm->stack[--vm->sp];
         vm->ip++;
         break;
-    case OP_HALLOC:
+    case OP_HALLOC: {
+        if (vm->parallel)
+            return EXCEPT_INVALID_PARALLEL_ACCESS;
         if (vm->sp < 2)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 2].ui64 = tgc_create_block(vm->stack[vm->sp - 2].ui32, vm->stack[vm->sp - 1].ui32);
-        vm->stack[vm->sp - 2].type = STACK_OBJ_TYPE_DATA_ADDRESS;
+        uintptr_t block = tgc_create_block(&vm->gc, vm->stack[vm->sp - 2].ui32, vm->stack[vm->sp - 1].ui32);
+        if (block == 0)
+            return EXCEPT_OUT_OF_MEMORY;
+        vm->stack[vm->sp - 2] = tvm_object_ptr(STACK_OBJ_TYPE_DATA_ADDRESS, block);
         vm->sp--;
         vm->ip++;
         break;
+    }
     case OP_DEREF:
         if (vm->sp <= 0)
             return EXCEPT_STACK_UNDERFLOW;
-        vm->stack[vm->sp - 1].ui64 = (uintptr_t)(*((uintptr_t*)(vm->stack[vm->sp - 1].ui64)));
+        vm->stack[vm->sp - 1] = tvm_object_ptr(TVM_OBJECT_TYPE(vm->stack[vm->sp - 1]), *((uintptr_t*)TVM_OBJECT_PTR(vm->stack[vm->sp - 1])));
         vm->ip++;
         break;
     case OP_DEREFB:
@@ -899,10 +2527,10 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
             return EXCEPT_INVALID_BYTE_SIZE;
         switch (inst.operand.i32)
         {
-        case DEREFB_CHAR_SIZE: vm->stack[vm->sp - 1].ui64 = (char)(*((char*)(vm->stack[vm->sp - 1].ui64))); break;
-        case DEREFB_INT_SIZE: vm->stack[vm->sp - 1].ui64 = (int32_t)(*((int32_t*)(vm->stack[vm->sp - 1].ui64))); break;
+        case DEREFB_CHAR_SIZE: vm->stack[vm->sp - 1] = tvm_object_i32(*((char*)TVM_OBJECT_PTR(vm->stack[vm->sp - 1]))); break;
+        case DEREFB_INT_SIZE: vm->stack[vm->sp - 1] = tvm_object_i32(*((int32_t*)TVM_OBJECT_PTR(vm->stack[vm->sp - 1]))); break;
 #ifdef __x86_64__
-        case DEREFB_PTR_SIZE: vm->stack[vm->sp - 1].ui64 = (uintptr_t)(*((uintptr_t*)(vm->stack[vm->sp - 1].ui64))); break;
+        case DEREFB_PTR_SIZE: vm->stack[vm->sp - 1] = tvm_object_ptr(TVM_OBJECT_TYPE(vm->stack[vm->sp - 1]), *((uintptr_t*)TVM_OBJECT_PTR(vm->stack[vm->sp - 1]))); break;
 #endif
         default:
             return EXCEPT_INVALID_BYTE_SIZE;
@@ -910,19 +2538,18 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         vm->ip++;
         break;
     case OP_HSET: {
+        if (vm->parallel)
+            return EXCEPT_INVALID_PARALLEL_ACCESS;
         if (vm->sp < 4)
             return EXCEPT_STACK_UNDERFLOW;
         uint32_t byte_size = vm->stack[vm->sp - 1].i32;  // byte_size
         uint32_t index = vm->stack[vm->sp - 2].i32;      // index
-        uint32_t offset = (uint32_t)(index * byte_size);
-        gc_block* addr = (gc_block*)(vm->stack[vm->sp - 3].ui64); // beginning address of the value (it should be)
-        
-        uint64_t size = addr->size;
-        // printf("size: %d\n", size);
-        // printf("offset: %d\n", offset);
-        // printf("byte_size: %d\n", byte_size);
-        // printf("index: %d\n", index);
-        if (offset >= size) {
+        uint64_t offset = (uint64_t)index * byte_size;
+        gc_block* addr = tvm_heap_block(vm->stack[vm->sp - 3]);
+        if (addr == NULL)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        // the whole store has to fit, not only its first byte
+        if (offset + byte_size > addr->size) {
             return EXCEPT_INVALID_ARRAY_INDEX;
         }
 
@@ -931,7 +2558,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
 #ifdef __x86_64__
         case sizeof(uint32_t): *(uint32_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui32; break;
         case sizeof(uint8_t): *(uint8_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui8; break;
-        case sizeof(uint64_t): *(uint64_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui64; break;
+        case sizeof(uint64_t): *(uint64_t*)(addr->value + offset) = tvm_heap_word(vm->stack[vm->sp - 4]); break;
 #elif defined(__i386__)
         case sizeof(uint32_t): *(uint32_t*)((uint32_t*)addr->value + offset) = vm->stack[vm->sp - 4].ui32; break;
         case sizeof(uint8_t): *(uint8_t*)((uint8_t*)addr->value + offset) = vm->stack[vm->sp - 4].ui8; break;
@@ -943,15 +2570,17 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         break;
     }
     case OP_HSETOF: {
+        if (vm->parallel)
+            return EXCEPT_INVALID_PARALLEL_ACCESS;
         if (vm->sp < 4)
             return EXCEPT_STACK_UNDERFLOW;
         uint32_t type_size = vm->stack[vm->sp - 1].i32;  // type_size
         uint32_t offset = vm->stack[vm->sp - 2].i32;     // offset
-        gc_block* addr = (gc_block*)(vm->stack[vm->sp - 3].ui64); // beginning address of the value (it should be)
-        
-        uint64_t size = addr->size;
-        if (offset >= size) {
-            return EXCEPT_INVALID_ARRAY_INDEX; // FIXME: here with a correct runtime error
+        gc_block* addr = tvm_heap_block(vm->stack[vm->sp - 3]);
+        if (addr == NULL)
+            return EXCEPT_INVALID_HEAP_ACCESS;
+        if ((uint64_t)offset + type_size > addr->size) {
+            return EXCEPT_INVALID_ARRAY_INDEX;
         }
 
         switch (type_size)
@@ -959,7 +2588,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
 #ifdef __x86_64__
         case sizeof(uint32_t): *(uint32_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui32; break;
         case sizeof(uint8_t): *(uint8_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui8; break;
-        case sizeof(uint64_t): *(uint64_t*)(addr->value + offset) = vm->stack[vm->sp - 4].ui64; break;
+        case sizeof(uint64_t): *(uint64_t*)(addr->value + offset) = tvm_heap_word(vm->stack[vm->sp - 4]); break;
 #elif defined(__i386__)
         case sizeof(uint32_t): *(uint32_t*)((uint32_t*)addr->value + offset) = vm->stack[vm->sp - 4].ui32; break;
         case sizeof(uint8_t): *(uint8_t*)((uint8_t*)addr->value + offset) = vm->stack[vm->sp - 4].ui8; break;
@@ -973,7 +2602,7 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
     case OP_PUTS:
         if (vm->sp < 1)
             return EXCEPT_STACK_UNDERFLOW;
-        fputs((const char*)vm->stack[--vm->sp].ui64, stdout);
+        fputs((const char*)TVM_OBJECT_PTR(vm->stack[--vm->sp]), stdout);
         vm->ip++;
         break;
     case OP_PUTC:
@@ -983,32 +2612,137 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
         vm->ip++;
         break;
     case OP_NATIVE: {
+        if (vm->parallel)
+            return EXCEPT_INVALID_PARALLEL_ACCESS;
         //FIXME: support multi modules
-        tvm_program_cfun_t native_func = vm->program.metadata.modules[0].cfuns[inst.operand.ui32];
         uint32_t native_func_count = vm->program.metadata.modules[0].cfun_count;
         // printf("%d\n", native_func_count);
-        if (vm->sp < native_func.acount)
+        if (inst.operand.ui32 >= native_func_count || vm->tci == NULL)
+            return EXCEPT_INVALID_NATIVE_FUNCTION_ACCESS;
+        tvm_program_cfun_t native_func = vm->program.metadata.modules[0].cfuns[inst.operand.ui32];
+        word_t arg_slots = tvm_native_arg_slots(&native_func);
+        word_t ret_slots = native_func.rtype == CTYPE_VOID ? 0 : 1 + tvm_ctype_is_wide(native_func.rtype);
+        if (vm->sp < arg_slots)
             return EXCEPT_STACK_UNDERFLOW;
-        else if (vm->sp >= TVM_STACK_CAPACITY)
+        else if (vm->sp - arg_slots + ret_slots > TVM_STACK_CAPACITY)
             return EXCEPT_STACK_OVERFLOW;
-        else if (inst.operand.ui32 >= native_func_count)
-            return EXCEPT_INVALID_NATIVE_FUNCTION_ACCESS;
-        unsigned long ret = 0;
-        void* vargs[64];
-        for (size_t i = 0; i < native_func.acount; i++) {
-            vargs[i] = &vm->stack[vm->sp - (native_func.acount - i)].ui32;
+        uint64_t start_ns = tci_native_clock(vm);
+        if ((native_func.flags & TVM_CFUN_ASYNC) && vm->pool != NULL) {
+            tvm_native_call_t* call = malloc(sizeof(tvm_native_call_t));
+            if (call == NULL)
+                return EXCEPT_OUT_OF_MEMORY;
+            tvm_native_args(vm, &native_func, call->args, call->vargs);
+            call->argc = native_func.acount;
+            if (!tci_native_bind(vm, inst.operand.ui32, call, start_ns)) {
+                free(call);
+                return EXCEPT_INVALID_NATIVE_FUNCTION_ACCESS;
+            }
+            vm->sp -= arg_slots;
+            vm->ip++;
+            tpool_submit(vm->pool, &call->job);
+            return tvm_native_park(vm, call);
         }
-        vm->sp -= native_func.acount;
-        if (native_func.rtype == CTYPE_VOID)
-            tci_native_call(vm, inst.operand.ui32, NULL, vargs);
-        else {
-            tci_native_call(vm, inst.operand.ui32, &ret, vargs);
-            vm->stack[vm->sp].ui32 = ret;
-            vm->sp++;
+        uint64_t ret = 0;
+        uint64_t args[64];
+        void* vargs[64];
+        tvm_native_args(vm, &native_func, args, vargs);
+        if (!tci_native_call(vm, inst.operand.ui32, native_func.rtype == CTYPE_VOID ? NULL : &ret, vargs, start_ns))
+            return EXCEPT_INVALID_NATIVE_FUNCTION_ACCESS;
+        vm->sp -= arg_slots;
+        tvm_native_push_ret(vm, native_func.rtype, ret);
+        vm->ip++;
+        break;
+    }
+    case OP_SPAWN:
+        if (vm->parallel)
+            return EXCEPT_INVALID_PARALLEL_ACCESS;
+        if (vm->sp < 1)
+            return EXCEPT_STACK_UNDERFLOW;
+        else if (inst.operand.ui32 >= vm->program.size)
+            return EXCEPT_INVALID_INSTRUCTION_ACCESS;
+        tvm_fiber_spawn(vm, inst.operand.ui32, vm->stack[vm->sp - 1]);
+        vm->stack[vm->sp - 1] = tvm_object_u32(arrlenu(vm->sched.fibers) - 1);
+        vm->ip++;
+        break;
+    case OP_YIELD:
+        vm->ip++;
+        if (vm->sched.fibers != NULL)
+            return tvm_fiber_switch(vm);
+        break;
+    case OP_JOIN: {
+        if (vm->sp < 1)
+            return EXCEPT_STACK_UNDERFLOW;
+        uint32_t id = vm->stack[vm->sp - 1].ui32;
+        if (id >= arrlenu(vm->sched.fibers) || id == vm->sched.current)
+            return EXCEPT_INVALID_FIBER;
+        tvm_fiber_t* target = &vm->sched.fibers[id];
+        if (target->state != TVM_FIBER_DONE) {
+            // park here, the join runs again once the target is done
+            vm->sched.fibers[vm->sched.current].state = TVM_FIBER_JOINING;
+            vm->sched.fibers[vm->sched.current].join_id = id;
+            return tvm_fiber_switch(vm);
         }
+        vm->stack[vm->sp - 1] = target->result;
+        vm->ip++;
+        break;
+    }
+    case OP_PMAP:
+    case OP_PREDUCE: {
+        bool reduce = inst.type == OP_PREDUCE;
+        if (vm->sp < (reduce ? 3u : 2u))
+            return EXCEPT_STACK_UNDERFLOW;
+        else if (inst.operand.ui32 >= vm->program.size)
+            return EXCEPT_INVALID_INSTRUCTION_ACCESS;
+        exception_t except = tvm_par_region(vm, inst.operand.ui32, reduce);
+        if (except != EXCEPT_OK)
+            return except;
         vm->ip++;
         break;
     }
+    case OP_VADD:
+    case OP_VSUB:
+    case OP_VMUL:
+    case OP_VDIV:
+    case OP_VDOT:
+    case OP_VSUM:
+    case OP_VMIN:
+    case OP_VMAX:
+    case OP_VFILL:
+    case OP_VCOPY:
+        return tvm_exec_vec(vm, inst);
+    case OP_MCOPY:
+    case OP_MFILL:
+    case OP_MCMP:
+    case OP_MFIND:
+        return tvm_exec_mem(vm, inst);
+    case OP_HGET:
+    case OP_HGETOF:
+        return tvm_exec_hget(vm, inst);
+    case OP_ADDL:
+    case OP_SUBL:
+    case OP_MULTL:
+    case OP_DIVL:
+    case OP_MODL:
+    case OP_DIVUL:
+    case OP_MODUL:
+    case OP_ADDD:
+    case OP_SUBD:
+    case OP_MULTD:
+    case OP_DIVD:
+    case OP_CMPL:
+    case OP_CMPUL:
+    case OP_CMPD:
+    case OP_CI2L:
+    case OP_CU2L:
+    case OP_CL2I:
+    case OP_CL2D:
+    case OP_CD2L:
+    case OP_CF2D:
+    case OP_CD2F:
+        return tvm_exec_wide(vm, inst);
+    case OP_CKPT:
+        vm->ip++;
+        break;
     case OP_HALT:
         vm->halted = true;
         vm->ip++;
@@ -1023,6 +2757,8 @@ exception_t tvm_exec_opcode(tvm_t* vm) {
 
 tvm_frame_t* tvm_frame_init() {
     tvm_frame_t* frame = (tvm_frame_t*)malloc(sizeof(tvm_frame_t));
+    frame->next = NULL;
+    frame->prev = NULL;
     memset(frame->local_vars, 0, sizeof(object_t)*TVM_MAX_LOCAL_VAR);
     // frame->local_vars->type = STACK_OBJ_NO_OPERAND
     return frame;
@@ -1057,40 +2793,150 @@ void tvm_gframe_free(tvm_gframe_t* gframe) {
         free(gframe);
 }
 
-void tgc_collect(tvm_frame_t* root) {
-    // Mark phase: Traverse all variables
-    for (size_t i = 0; i < TVM_MAX_LOCAL_VAR; i++) {
-        if (root->local_vars[i].type == STACK_OBJ_TYPE_DATA_ADDRESS)
-            tgc_mark((void*)(root->local_vars[i].ui64));
+// slots may hold anything, only words tagged as heap addresses of live blocks are followed
+static void tvm_gc_mark(tvm_t* vm, const object_t* slots, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (TVM_OBJECT_TYPE(slots[i]) == STACK_OBJ_TYPE_DATA_ADDRESS)
+            tgc_mark(&vm->gc, tgc_find_block(&vm->gc, TVM_OBJECT_PTR(slots[i])));
+    }
+}
+
+static void tvm_gc_mark_frames(tvm_t* vm, tvm_frame_t* frame) {
+    for (; frame != NULL; frame = frame->prev)
+        tvm_gc_mark(vm, frame->local_vars, TVM_MAX_LOCAL_VAR);
+}
+
+// the args were popped when the call was made but the native may still be reading them
+static void tvm_gc_mark_call(tvm_t* vm, const tvm_native_call_t* call) {
+    if (call == NULL)
+        return;
+    for (uint32_t i = 0; i < call->argc; i++)
+        tgc_mark(&vm->gc, tgc_find_block(&vm->gc, (uintptr_t)call->args[i]));
+}
+
+// the tagged words tvm_heap_word stored, at any byte offset
+static void tvm_gc_scan_block(tvm_t* vm, const gc_block* block) {
+    const uint8_t* value = block->value;
+    for (uint64_t i = 0; i + sizeof(object_t) <= block->size; i++) {
+        // the tag is in the two high bytes, little endian like the rest of the vm
+        if (value[i + 7] != 0 || value[i + 6] != STACK_OBJ_TYPE_DATA_ADDRESS)
+            continue;
+        object_t obj;
+        memcpy(&obj.raw, value + i, sizeof(obj.raw));
+        tvm_gc_mark(vm, &obj, 1);
+    }
+}
+
+void tvm_gc_collect(tvm_t* vm) {
+    tgc_t* gc = &vm->gc;
+    uint64_t start = ttime_now_ns();
+    tgc_index(gc);
+
+    // the running fiber lives on the vm stacks, its saved copy is stale
+    tvm_gc_mark(vm, vm->stack, vm->sp);
+    tvm_gc_mark_frames(vm, vm->frame);
+    tvm_gc_mark(vm, vm->gframe->global_vars, TVM_MAX_GLOBAL_VAR);
+    tvm_gc_mark_call(vm, vm->pending);
+    for (size_t i = 0; i < arrlenu(vm->sched.fibers); i++) {
+        tvm_fiber_t* fiber = &vm->sched.fibers[i];
+        tvm_gc_mark_call(vm, fiber->pending);
+        if (fiber->state == TVM_FIBER_DONE) {
+            tvm_gc_mark(vm, &fiber->result, 1);
+        } else if (i != vm->sched.current) {
+            tvm_gc_mark(vm, fiber->stack, fiber->sp);
+            tvm_gc_mark_frames(vm, fiber->frame);
+        }
     }
-    // Sweep phase: Free unmarked blocks
-    tgc_sweep();
+    while (arrlenu(gc->gray) > 0)
+        tvm_gc_scan_block(vm, arrpop(gc->gray));
+
+    uint64_t marked = ttime_now_ns();
+    tgc_sweep(gc);
+    tgc_stats_cycle(gc, marked - start, ttime_now_ns() - marked);
 }
 
-void tvm_run(tvm_t* vm) {
-    static unsigned int tgc_counter = 0;
-    while (!vm->halted && vm->ip <= vm->program.size) {
+tvm_status_t tvm_step_n(tvm_t* vm, uint64_t budget) {
+    if (vm->except != EXCEPT_OK)
+        return TVM_STATUS_EXCEPTION;
+    if (vm->blocked && !tvm_native_resume(vm))
+        return TVM_STATUS_BLOCKED;
+    for (uint64_t i = 0; i < budget; i++) {
+        // running off the end of the code is a halt
+        if (vm->halted || vm->ip >= vm->program.size) {
+            vm->halted = true;
+            return TVM_STATUS_HALTED;
+        }
+        word_t ip = vm->ip;
+        uint8_t op = vm->program.code[ip].type;
+        if (vm->trace != NULL && op == OP_NATIVE)
+            ttrace_native_begin(vm->trace);
         exception_t except = tvm_exec_opcode(vm);
         if (except != EXCEPT_OK) {
-            fprintf(stderr, CLR_RED"ERROR: Exception occured "CLR_END "%s\n", exception_to_cstr(except));
-            exit(1);
+            vm->except = except;
+            vm->except_ip = vm->ip;
+            if (vm->trace != NULL)
+                ttrace_step(vm->trace, vm, ip, op, except);
+            return TVM_STATUS_EXCEPTION;
         }
-        // TODO: find a better algorithm to call garbage collector!
-        if (tgc_counter % 20 == 0)
-            // tgc_collect(vm->frame);
-        tgc_counter++;
+        vm->icount++;
+        if (vm->trace != NULL)
+            ttrace_step(vm->trace, vm, ip, op, except);
+#ifdef TVM_STATS
+        if (vm->stats != NULL)
+            tvm_stats_record(vm->stats, op, ip, vm->ip);
+#endif
+        vm->gc.counter++;
+        // only between instructions, nothing holds a bare block pointer there
+        if (vm->gc.live_bytes >= vm->gc.threshold)
+            tvm_gc_collect(vm);
+        if (vm->blocked)
+            return TVM_STATUS_BLOCKED;
+        if (op == OP_CKPT)
+            return TVM_STATUS_CHECKPOINT;
     }
-    tgc_destroy();
-    tvm_frame_free(vm->frame);
-    fprintf(stdout, "Program halted " CLR_GREEN"succesfully...\n"CLR_END);
+    return vm->halted ? TVM_STATUS_HALTED : TVM_STATUS_RUNNING;
+}
+
+exception_t tvm_run(tvm_t* vm) {
+    for (;;) {
+        tvm_status_t status = tvm_step_n(vm, UINT64_MAX);
+        if (status == TVM_STATUS_BLOCKED)
+            tvm_wait_native(vm);
+        else if (status != TVM_STATUS_RUNNING && status != TVM_STATUS_CHECKPOINT)
+            break;
+    }
+    return vm->except;
 }
 
 void tvm_stack_dump(tvm_t *vm) {
     fprintf(stdout, "stack:\n");
     for (size_t i = 0; i < vm->sp; i++) {
-        fprintf(stdout, "0x%08x: %d (as int), %f (as float), %p (as ptr)\n", i, vm->stack[i].i32, vm->stack[i].f32, vm->stack[i].ui64);
+        fprintf(stdout, "0x%08zx: %d (as int), %f (as float), %p (as ptr), type %d\n", i, vm->stack[i].i32, vm->stack[i].f32, (void*)TVM_OBJECT_PTR(vm->stack[i]), TVM_OBJECT_TYPE(vm->stack[i]));
     }
 }
 
+static void tvm_stack_trace_line(const tvm_program_t* program, word_t addr, FILE* out) {
+    const tvm_debug_symbol_t* symbol = tvm_debug_symbol(program, addr);
+    uint32_t row = tvm_debug_line(program, addr);
+    fprintf(out, "    at 0x%08x", addr);
+    if (symbol != NULL)
+        fprintf(out, " %s", symbol->name);
+    if (row != 0)
+        fprintf(out, " (%s:%u)", program->debug.file_name, row);
+    fprintf(out, "\n");
+}
+
+void tvm_stack_trace(tvm_t* vm, FILE* out) {
+    tvm_debug_map(&vm->program);
+    tvm_stack_trace_line(&vm->program, vm->except != EXCEPT_OK ? vm->except_ip : vm->ip, out);
+    // every entry is the instruction after a call
+    for (size_t i = vm->rsp; i > 0; i--)
+        tvm_stack_trace_line(&vm->program, vm->return_stack[i - 1] - 1, out);
+}
+
+// the trace recorder is part of the library, tvm_step_n calls into it
+#define TTRACE_IMPLEMENTATION
+#include <tvm/ttrace.h>
+
 #endif//TVM_IMPLEMENTATION
 #endif//TVM_H_
\ No newline at end of file
@@ -0,0 +1,2 @@
+#define TVM_IMPLEMENTATION
+#include <tvm/tvm.h>
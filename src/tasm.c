@@ -11,8 +11,7 @@ char* read_file_content(const char* file_name) {
 
     if (src_file == NULL) {
         printf(CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
-        fclose(src_file);
-        exit(1);
+        return NULL;
     }
 
     fseek(src_file, 0L, SEEK_END);
@@ -22,7 +21,7 @@ char* read_file_content(const char* file_name) {
     if (file_size == 0) {
         printf(CLR_RED"File is empty: "CLR_END"%s\n", file_name);
         fclose(src_file);
-        exit(1);
+        return NULL;
     }
 
     char* content = arena_alloc(&src_arena, file_size);
@@ -46,6 +45,7 @@ int main(int argc, char **argv) {
         .output_name = NULL,
         .clib_count = 0,
         .ast_show = false,
+        .strip = false,
     };
 
     if (!cli_tasm_parse_command_line(&args, &argc, &argv))
@@ -57,6 +57,11 @@ int main(int argc, char **argv) {
     src_arena = arena_init(4096*16);
 
     char* content = read_file_content(args.file_name);
+    if (content == NULL) {
+        arena_destroy(ast_arena);
+        arena_destroy(src_arena);
+        return EXIT_FAILURE;
+    }
 
     tasm_lexer_t lexer = tasm_lexer_init(
         content,
@@ -81,7 +86,7 @@ int main(int argc, char **argv) {
         tasm_ast_destroy(ast);
         arena_destroy(ast_arena);
         arena_destroy(src_arena);
-        exit(EXIT_FAILURE);
+        return EXIT_FAILURE;
     }
 
     if (args.ast_show) {
@@ -91,14 +96,18 @@ int main(int argc, char **argv) {
 
     tasm_translator_t translator = tasm_translator_init();
     
+    tasm_fuse_branches(ast);
     tasm_resolve_procs(&translator, ast);
     tasm_resolve_labels(&translator, ast, NULL);
     // tasm_resolve_label_calls(&translator, ast);
     
     // symbol_dump(&translator);
 
-    tasm_translate_unit(&translator, ast);
-    if (!tasm_translator_is_err(&translator)) {
+    // duplicate symbols are reported by the resolvers, translating on top of them only adds noise
+    if (!tasm_translator_is_err(&translator))
+        tasm_translate_unit(&translator, ast);
+    bool ok = !tasm_translator_is_err(&translator);
+    if (ok) {
         tasm_translator_generate_bin(&translator, args);
         if (args.compile) {
             tasmc_init("out.asm");
@@ -118,5 +127,5 @@ int main(int argc, char **argv) {
     arena_destroy(src_arena);
 
 
-    return 0;
+    return ok ? 0 : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <tvm/tvm.h>
+#include <tvm/tci.h>
+#include <common/cmd_colors.h>
+
+#include <common/tthread.h>
+#include <common/ttime.h>
+#define CLI_IMPLEMENTATION
+#include <common/cli.h>
+
+/*
+    tbatch runs every program against every input set on a pool of worker threads.
+    Jobs are dealt round robin into per-worker deques, a worker pops from the bottom of its own
+    deque and when that is empty it steals from the top of the others. There is no shared queue,
+    a lock is only taken on the deque being touched.
+    Every worker keeps one loaded vm per program and only resets it between jobs.
+*/
+
+#define TBATCH_MAX_INPUT_VALUES 64
+#define TBATCH_REPORT_FAILED 10
+
+typedef struct {
+    const char* name;
+    uint8_t* image;
+    size_t size;
+    bool has_natives;
+} tbatch_program_t;
+
+typedef struct {
+    int32_t values[TBATCH_MAX_INPUT_VALUES]; // pushed in order before the program starts
+    size_t count;
+} tbatch_input_t;
+
+typedef struct {
+    uint32_t program;
+    uint32_t input;
+    uint64_t latency_ns;
+    uint64_t icount;
+    exception_t except;
+    word_t except_ip;
+} tbatch_job_t;
+
+typedef struct {
+    tthread_mutex_t lock;
+    uint32_t* jobs;
+    size_t top, bottom; // jobs[top, bottom) are still queued
+} tbatch_deque_t;
+
+typedef struct tbatch tbatch_t;
+
+typedef struct {
+    tbatch_t* batch;
+    size_t id;
+    tthread_t thread;
+    size_t executed;
+    size_t stolen;
+} tbatch_worker_t;
+
+struct tbatch {
+    tbatch_program_t* programs;
+    size_t program_count;
+    tbatch_input_t* inputs;
+    size_t input_count;
+    tbatch_job_t* jobs;
+    size_t job_count;
+    tbatch_deque_t* deques;
+    tbatch_worker_t* workers;
+    size_t worker_count;
+};
+
+static uint8_t* tbatch_read_file(const char* file_name, size_t* size) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    uint8_t* content = malloc(file_size > 0 ? file_size : 1);
+    *size = fread(content, 1, file_size > 0 ? file_size : 0, file);
+    fclose(file);
+    return content;
+}
+
+static bool tbatch_load_inputs(tbatch_t* batch, const char* file_name) {
+    if (file_name == NULL) {
+        batch->inputs = calloc(1, sizeof(tbatch_input_t));
+        batch->input_count = 1;
+        return true;
+    }
+    FILE* file = fopen(file_name, "r");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return false;
+    }
+    size_t capacity = 16;
+    batch->inputs = malloc(sizeof(tbatch_input_t) * capacity);
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        tbatch_input_t input = {0};
+        char* cursor = line;
+        char* end = NULL;
+        for (long value = strtol(cursor, &end, 0); end != cursor; value = strtol(cursor, &end, 0)) {
+            if (input.count == TBATCH_MAX_INPUT_VALUES) {
+                fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"more than %d values on an input line\n", TBATCH_MAX_INPUT_VALUES);
+                break;
+            }
+            input.values[input.count++] = (int32_t)value;
+            cursor = end;
+        }
+        if (input.count == 0)
+            continue;
+        if (batch->input_count == capacity) {
+            capacity *= 2;
+            batch->inputs = realloc(batch->inputs, sizeof(tbatch_input_t) * capacity);
+        }
+        batch->inputs[batch->input_count++] = input;
+    }
+    fclose(file);
+    if (batch->input_count == 0) {
+        fprintf(stderr, CLR_RED"No input sets in: "CLR_END"%s\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+static bool tbatch_pop(tbatch_deque_t* deque, uint32_t* job) {
+    bool found = false;
+    tthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *job = deque->jobs[--deque->bottom];
+        found = true;
+    }
+    tthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool tbatch_steal(tbatch_deque_t* deque, uint32_t* job) {
+    bool found = false;
+    tthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *job = deque->jobs[deque->top++];
+        found = true;
+    }
+    tthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool tbatch_next_job(tbatch_worker_t* worker, uint32_t* job) {
+    tbatch_t* batch = worker->batch;
+    if (tbatch_pop(&batch->deques[worker->id], job))
+        return true;
+    // no job is ever added after the start, so all deques empty means we are done
+    for (size_t i = 1; i < batch->worker_count; i++) {
+        size_t victim = (worker->id + i) % batch->worker_count;
+        if (tbatch_steal(&batch->deques[victim], job)) {
+            worker->stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static tvm_t* tbatch_vm_create(tbatch_program_t* program) {
+    tvm_t* vm = malloc(sizeof(tvm_t));
+    *vm = tvm_init();
+    tvm_load_program_from_buffer(vm, program->image, program->size);
+    if (program->has_natives) {
+        //FIXME: support for multiple modules
+        tci_t* tci = malloc(sizeof(tci_t));
+        *tci = tci_init();
+        // without the module every native call raises an exception, the other jobs still run
+        if (tci_load_module(tci, vm->program.metadata.modules[0].module_name))
+            tci_metaprogram_to_ffi(tci, vm);
+        vm->tci = tci;
+    }
+    return vm;
+}
+
+static void tbatch_vm_destroy(tvm_t* vm) {
+    if (vm->tci) {
+        tci_unload_all(vm->tci);
+        tci_destroy(vm->tci);
+        free(vm->tci);
+    }
+    tvm_destroy(vm);
+    free(vm);
+}
+
+static void tbatch_worker_run(void* arg) {
+    tbatch_worker_t* worker = arg;
+    tbatch_t* batch = worker->batch;
+    tvm_t** vms = calloc(batch->program_count, sizeof(tvm_t*));
+
+    uint32_t index;
+    while (tbatch_next_job(worker, &index)) {
+        tbatch_job_t* job = &batch->jobs[index];
+        tbatch_input_t* input = &batch->inputs[job->input];
+        if (vms[job->program] == NULL)
+            vms[job->program] = tbatch_vm_create(&batch->programs[job->program]);
+        tvm_t* vm = vms[job->program];
+
+        uint64_t start = ttime_now_ns();
+        tvm_reset(vm);
+        for (size_t i = 0; i < input->count; i++) {
+            vm->stack[vm->sp++] = tvm_object_i32(input->values[i]);
+        }
+        job->except = tvm_run(vm);
+        job->latency_ns = ttime_now_ns() - start;
+        job->icount = vm->icount;
+        job->except_ip = vm->except_ip;
+        worker->executed++;
+    }
+
+    for (size_t i = 0; i < batch->program_count; i++) {
+        if (vms[i])
+            tbatch_vm_destroy(vms[i]);
+    }
+    free(vms);
+}
+
+static int tbatch_cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double tbatch_percentile_us(uint64_t* sorted, size_t count, double p) {
+    size_t index = (size_t)((count - 1) * p / 100.0);
+    return sorted[index] / 1e3;
+}
+
+static void tbatch_report(tbatch_t* batch, uint64_t wall_ns, bool quiet) {
+    uint64_t* latencies = malloc(sizeof(uint64_t) * batch->job_count);
+    uint64_t icount = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < batch->job_count; i++) {
+        tbatch_job_t* job = &batch->jobs[i];
+        latencies[i] = job->latency_ns;
+        icount += job->icount;
+        if (job->except == EXCEPT_OK)
+            continue;
+        if (!quiet && failed < TBATCH_REPORT_FAILED) {
+            fprintf(stderr, CLR_RED"job %zu failed: "CLR_END"%s input %u: %s at ip %u\n",
+                i, batch->programs[job->program].name, job->input, exception_to_cstr(job->except), job->except_ip);
+        }
+        failed++;
+    }
+    qsort(latencies, batch->job_count, sizeof(uint64_t), tbatch_cmp_u64);
+
+    double seconds = wall_ns / 1e9;
+    fprintf(stdout, "tbatch: %zu jobs (%zu programs x %zu inputs) on %zu workers in %.3f ms\n",
+        batch->job_count, batch->program_count, batch->input_count, batch->worker_count, wall_ns / 1e6);
+    fprintf(stdout, "  ok          %zu, "CLR_RED"failed"CLR_END" %zu\n", batch->job_count - failed, failed);
+    fprintf(stdout, "  throughput  %.1f jobs/s, %.2f M instr/s\n", batch->job_count / seconds, icount / seconds / 1e6);
+    fprintf(stdout, "  latency     p50 %.2f us, p90 %.2f us, p99 %.2f us, max %.2f us\n",
+        tbatch_percentile_us(latencies, batch->job_count, 50),
+        tbatch_percentile_us(latencies, batch->job_count, 90),
+        tbatch_percentile_us(latencies, batch->job_count, 99),
+        latencies[batch->job_count - 1] / 1e3);
+    for (size_t i = 0; i < batch->worker_count; i++) {
+        fprintf(stdout, "  worker %-4zu %zu jobs, %zu stolen\n", i, batch->workers[i].executed, batch->workers[i].stolen);
+    }
+    free(latencies);
+}
+
+int main(int argc, char **argv) {
+    cli_tbatch_args_t args = {0};
+    if (!cli_tbatch_parse_command_line(&args, &argc, &argv))
+        return EXIT_FAILURE;
+
+    tbatch_t batch = {0};
+    batch.program_count = args.file_count;
+    batch.programs = calloc(batch.program_count, sizeof(tbatch_program_t));
+
+    // load every image once up front, so a broken file fails the batch instead of its jobs
+    tvm_t* probe = malloc(sizeof(tvm_t));
+    *probe = tvm_init();
+    for (size_t i = 0; i < batch.program_count; i++) {
+        tbatch_program_t* program = &batch.programs[i];
+        program->name = args.file_names[i];
+        program->image = tbatch_read_file(program->name, &program->size);
+        if (program->image == NULL || !tvm_load_program_from_buffer(probe, program->image, program->size))
+            return EXIT_FAILURE;
+        program->has_natives = probe->program.metadata.module_count > 0;
+    }
+    tvm_destroy(probe);
+    free(probe);
+
+    if (!tbatch_load_inputs(&batch, args.input_name))
+        return EXIT_FAILURE;
+
+    batch.job_count = batch.program_count * batch.input_count * args.repeat;
+    batch.jobs = calloc(batch.job_count, sizeof(tbatch_job_t));
+    for (size_t i = 0; i < batch.job_count; i++) {
+        batch.jobs[i].program = i % batch.program_count;
+        batch.jobs[i].input = (i / batch.program_count) % batch.input_count;
+    }
+
+    batch.worker_count = args.workers > 0 ? (size_t)args.workers : (size_t)tthread_cpu_count();
+    if (batch.worker_count > batch.job_count)
+        batch.worker_count = batch.job_count;
+    batch.workers = calloc(batch.worker_count, sizeof(tbatch_worker_t));
+    batch.deques = calloc(batch.worker_count, sizeof(tbatch_deque_t));
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        tbatch_deque_t* deque = &batch.deques[i];
+        tthread_mutex_init(&deque->lock);
+        deque->jobs = malloc(sizeof(uint32_t) * (batch.job_count / batch.worker_count + 1));
+    }
+    for (size_t i = 0; i < batch.job_count; i++) {
+        tbatch_deque_t* deque = &batch.deques[i % batch.worker_count];
+        deque->jobs[deque->bottom++] = (uint32_t)i;
+    }
+
+    uint64_t start = ttime_now_ns();
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        batch.workers[i].batch = &batch;
+        batch.workers[i].id = i;
+        if (!tthread_create(&batch.workers[i].thread, tbatch_worker_run, &batch.workers[i])) {
+            fprintf(stderr, CLR_RED"Could not start worker "CLR_END"%zu\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        tthread_join(batch.workers[i].thread);
+    }
+    uint64_t wall_ns = ttime_now_ns() - start;
+
+    tbatch_report(&batch, wall_ns, args.quiet);
+
+    bool all_ok = true;
+    for (size_t i = 0; i < batch.job_count; i++) {
+        all_ok &= batch.jobs[i].except == EXCEPT_OK;
+    }
+
+    for (size_t i = 0; i < batch.worker_count; i++) {
+        tthread_mutex_destroy(&batch.deques[i].lock);
+        free(batch.deques[i].jobs);
+    }
+    for (size_t i = 0; i < batch.program_count; i++) {
+        free(batch.programs[i].image);
+    }
+    free(batch.deques);
+    free(batch.workers);
+    free(batch.jobs);
+    free(batch.inputs);
+    free(batch.programs);
+
+    return all_ok ? 0 : 1;
+}
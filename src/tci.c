@@ -1,16 +1,20 @@
 #include <stdio.h>
+#include <signal.h>
 #include <common/cmd_colors.h>
+#include <common/ttime.h>
+#include <common/tthread.h>
 #include <tvm/tci.h>
 #include <string.h>
 #include <stdlib.h>
 
-tci_t tci_instance;
+static volatile sig_atomic_t tci_dump_requested = 0;
 
 tci_t tci_init() {
     return (tci_t) {
         .modules = {0},
         .module_count = 0,
         .ffi_arena = arena_init(4096),
+        .stats = false,
     };
 }
 
@@ -18,28 +22,33 @@ void tci_destroy(tci_t* instance) {
     arena_destroy(instance->ffi_arena);
 }
 
-void tci_load_module(tci_t *instance, const char *module_name)
+bool tci_load_module(tci_t *instance, const char *module_name)
 {
     tci_module_handle_t lib;
+    if (instance->module_count >= TCI_MODULE_CAPACITY) {
+        fprintf(stderr, CLR_RED"Runtime library loading error at "CLR_END"%s: more than %d modules\n", module_name, TCI_MODULE_CAPACITY);
+        return false;
+    }
 #ifdef _WIN32
     lib = LoadLibrary(module_name);
     err_str_t last_err = GetLastError();
     if (!lib) {
         fprintf(stderr, CLR_RED"Runtime library loading error at "CLR_END"%s: %d\n", module_name, last_err);
-        exit(1);
+        return false;
     }
 #else
     lib = dlopen(module_name, RTLD_LAZY);
     err_str_t last_err = dlerror();
     if (!lib) {
         fprintf(stderr, CLR_RED"Runtime library loading error at "CLR_END"%s: %s\n", module_name, last_err);
-        exit(1);
+        return false;
     }
 #endif
     instance->modules[instance->module_count].handle = lib;
     instance->modules[instance->module_count].name = module_name;
     instance->module_count++;
     fprintf(stdout, CLR_WHITE"Runtime library loaded "CLR_GREEN"successfully. "CLR_END"%s\n", module_name);
+    return true;
 }
 
 cfunptr_t tci_get_cfunction(tci_t* instance, /* TODO: give module name as param */ const char* func_name) {
@@ -50,7 +59,6 @@ cfunptr_t tci_get_cfunction(tci_t* instance, /* TODO: give module name as param
 #endif
     if (!func_ptr) {
         fprintf(stderr, CLR_RED"tci error: "CLR_WHITE"could not find the "CLR_PINK"%s "CLR_END"function!\n", func_name);
-        tci_unload_all(instance);
         return NULL;
     }
     return func_ptr;
@@ -84,8 +92,8 @@ void tci_prepare_last_module(tci_t* instance, uint32_t native_func_count) {
     instance->modules[instance->module_count - 1].native_func_count = native_func_count;
 }
 
-void tci_prepare_function(arena_t* arena, tci_native_func_t* function, uint8_t rtype, uint8_t* atypes, uint16_t acount) {
-    ffi_type** args = arena_alloc(&arena, sizeof(ffi_type*) * acount);
+void tci_prepare_function(arena_t** arena, tci_native_func_t* function, uint8_t rtype, uint8_t* atypes, uint16_t acount) {
+    ffi_type** args = arena_alloc(arena, sizeof(ffi_type*) * acount);
     ffi_type* ret = tci_ctype_to_ffi_type(rtype);
     for (size_t i = 0; i < acount; i++) {
         uint8_t atype = atypes[i];
@@ -104,35 +112,194 @@ void tci_metaprogram_to_ffi(tci_t* instance, tvm_t* vm) {
         uint16_t acount = vm->program.metadata.modules[0].cfuns[i].acount;
         uint8_t rtype = vm->program.metadata.modules[0].cfuns[i].rtype;
         uint8_t* atypes = vm->program.metadata.modules[0].cfuns[i].atypes;
+        tci_native_func_t* native_func = &instance->modules[instance->module_count - 1].native_funcs[i];
+
+        tci_prepare_function(&instance->ffi_arena, native_func, rtype, atypes, acount);
+        // a missing symbol is reported here, calling it raises an exception later
+        native_func->fn = tci_get_cfunction(instance, vm->program.metadata.modules[0].cfuns[i].symbol_name);
+    }
+}
+
+// exact below 4 ns, then four buckets per power of two
+static uint32_t tci_latency_bucket(uint64_t ns) {
+    if (ns < 4)
+        return (uint32_t)ns;
+    uint32_t log2 = 0;
+    for (uint64_t v = ns; v > 1; v >>= 1)
+        log2++;
+    return (log2 - 1) * 4 + (uint32_t)((ns >> (log2 - 2)) & 3);
+}
+
+// the largest latency that falls into bucket
+static uint64_t tci_latency_bucket_max(uint32_t bucket) {
+    if (bucket < 4)
+        return bucket;
+    uint32_t log2 = bucket / 4 + 1;
+    return ((uint64_t)(4 + bucket % 4 + 1) << (log2 - 2)) - 1;
+}
+
+static void tci_stats_record(tci_native_stats_t* stats, uint64_t ns, uint64_t overhead_ns) {
+    tthread_add_relaxed(&stats->calls, 1);
+    tthread_add_relaxed(&stats->total_ns, ns);
+    tthread_add_relaxed(&stats->overhead_ns, overhead_ns);
+    tthread_max_relaxed(&stats->max_ns, ns);
+    tthread_add_relaxed(&stats->latency[tci_latency_bucket(ns)], 1);
+}
+
+// a consistent enough copy for printing while other threads keep counting
+static void tci_stats_load(const tci_native_stats_t* stats, tci_native_stats_t* copy) {
+    copy->calls = tthread_load_relaxed(&stats->calls);
+    copy->total_ns = tthread_load_relaxed(&stats->total_ns);
+    copy->max_ns = tthread_load_relaxed(&stats->max_ns);
+    copy->overhead_ns = tthread_load_relaxed(&stats->overhead_ns);
+    for (uint32_t i = 0; i < TCI_LATENCY_BUCKETS; i++)
+        copy->latency[i] = tthread_load_relaxed(&stats->latency[i]);
+}
+
+uint64_t tci_native_clock(tvm_t* vm) {
+    return vm->tci != NULL && vm->tci->stats ? ttime_now_ns() : 0;
+}
+
+bool tci_native_call(tvm_t* vm, uint32_t id, void *rvalue, void **avalues, uint64_t start_ns) {
+    //FIXME: support multi modules
+    tci_t* instance = vm->tci;
+    if (instance->module_count == 0)
+        return false;
+    tci_native_func_t* native_func = &instance->modules[instance->module_count - 1].native_funcs[id];
+    if (!native_func->is_ok || native_func->fn == NULL)
+        return false;
+    if (!instance->stats) {
+        ffi_call(&native_func->cif, FFI_FN(native_func->fn), rvalue, avalues);
+        return true;
+    }
+    uint64_t call_start = ttime_now_ns();
+    ffi_call(&native_func->cif, FFI_FN(native_func->fn), rvalue, avalues);
+    tci_stats_record(&native_func->stats, ttime_now_ns() - call_start, start_ns ? call_start - start_ns : 0);
+    if (tci_dump_requested) {
+        tci_dump_requested = 0;
+        tci_stats_write(instance, vm, stderr);
+    }
+    return true;
+}
 
-        tci_prepare_function(instance->ffi_arena, &instance->modules[instance->module_count - 1].native_funcs[i], rtype, atypes, acount);
+void tci_native_finish(tvm_t* vm, tvm_native_call_t* call) {
+    if (call->stats == NULL)
+        return;
+    tci_stats_record(call->stats, call->ns, call->overhead_ns);
+    if (tci_dump_requested) {
+        tci_dump_requested = 0;
+        tci_stats_write(vm->tci, vm, stderr);
     }
-    
 }
 
-void tci_native_call(tvm_t* vm, uint32_t id, void *rvalue, void **avalues) {
-    printf("id: %d\n", id);
+void tci_stats_enable(tci_t* instance) {
+    instance->stats = true;
+}
+
+void tci_stats_request_dump() {
+    tci_dump_requested = 1;
+}
+
+typedef struct {
+    tci_native_stats_t stats;
+    uint32_t id;
+} tci_stats_entry_t;
+
+static int tci_stats_compare(const void* a, const void* b) {
+    const tci_stats_entry_t* x = a;
+    const tci_stats_entry_t* y = b;
+    if (x->stats.total_ns != y->stats.total_ns)
+        return x->stats.total_ns < y->stats.total_ns ? 1 : -1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static uint64_t tci_stats_p99(const tci_native_stats_t* stats) {
+    uint64_t rank = stats->calls - stats->calls / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < TCI_LATENCY_BUCKETS; i++) {
+        seen += stats->latency[i];
+        if (seen >= rank) {
+            uint64_t max = tci_latency_bucket_max(i);
+            return max < stats->max_ns ? max : stats->max_ns;
+        }
+    }
+    return stats->max_ns;
+}
+
+void tci_stats_write(tci_t* instance, tvm_t* vm, FILE* out) {
+    if (instance->module_count == 0)
+        return;
     //FIXME: support multi modules
-    const char* proc_name = vm->program.metadata.modules[0].cfuns[id].symbol_name;
-    printf(CLR_BLUE"%s\n"CLR_END, proc_name);
-    if (tci_instance.modules[tci_instance.module_count - 1].native_funcs[id].is_ok == true) {
-        cfunptr_t func_ptr = tci_get_cfunction(&tci_instance, proc_name);
-        ffi_call(&tci_instance.modules[tci_instance.module_count - 1].native_funcs[id].cif, FFI_FN(func_ptr), rvalue, avalues);
+    tci_module_t* module = &instance->modules[instance->module_count - 1];
+    tci_stats_entry_t* sorted = malloc(sizeof(tci_stats_entry_t) * (module->native_func_count + 1));
+    size_t count = 0;
+    for (uint32_t i = 0; i < module->native_func_count; i++) {
+        tci_stats_load(&module->native_funcs[i].stats, &sorted[count].stats);
+        sorted[count].id = i;
+        if (sorted[count].stats.calls > 0)
+            count++;
+    }
+    qsort(sorted, count, sizeof(tci_stats_entry_t), tci_stats_compare);
+
+    fprintf(out, "%-24s %12s %12s %10s %10s %10s %12s\n", "native", "calls", "total ms", "mean ns", "p99 ns", "max ns", "overhead ns");
+    for (size_t i = 0; i < count; i++) {
+        const tci_native_stats_t* stats = &sorted[i].stats;
+        fprintf(out, "%-24s %12llu %12.3f %10llu %10llu %10llu %12llu\n", vm->program.metadata.modules[0].cfuns[sorted[i].id].symbol_name,
+            (unsigned long long)stats->calls, stats->total_ns / 1e6,
+            (unsigned long long)(stats->total_ns / stats->calls), (unsigned long long)tci_stats_p99(stats),
+            (unsigned long long)stats->max_ns, (unsigned long long)(stats->overhead_ns / stats->calls));
     }
+    free(sorted);
+}
+
+static void tci_native_run(void* arg) {
+    tvm_native_call_t* call = (tvm_native_call_t*)arg;
+    if (call->stats == NULL) {
+        ffi_call((ffi_cif*)call->cif, FFI_FN(call->fn), &call->ret, call->vargs);
+        return;
+    }
+    uint64_t start = ttime_now_ns();
+    ffi_call((ffi_cif*)call->cif, FFI_FN(call->fn), &call->ret, call->vargs);
+    call->ns = ttime_now_ns() - start;
+}
+
+// fills the call on the vm thread so the pool worker only runs ffi_call
+bool tci_native_bind(tvm_t* vm, uint32_t id, tvm_native_call_t* call, uint64_t start_ns) {
+    //FIXME: support multi modules
+    tci_t* instance = vm->tci;
+    if (instance->module_count == 0)
+        return false;
+    tci_native_func_t* native_func = &instance->modules[instance->module_count - 1].native_funcs[id];
+    if (!native_func->is_ok || native_func->fn == NULL)
+        return false;
+    call->cif = &native_func->cif;
+    call->fn = (void (*)(void))native_func->fn;
+    call->ret = 0;
+    call->rtype = vm->program.metadata.modules[0].cfuns[id].rtype;
+    call->stats = instance->stats ? &native_func->stats : NULL;
+    call->ns = 0;
+    call->overhead_ns = instance->stats && start_ns ? ttime_now_ns() - start_ns : 0;
+    call->job.fn = tci_native_run;
+    call->job.arg = call;
+    return true;
 }
 
-void tci_unload_all(tci_t* instance) {
+// keeps going after a failure, the handles are gone either way
+bool tci_unload_all(tci_t* instance) {
+    bool ok = true;
     for (size_t i = 0; i < instance->module_count; ++i) {
 #ifdef _WIN32
         if (FreeLibrary(instance->modules[i].handle) == 0) {
             fprintf(stderr, CLR_RED"ERROR: could not unload module"CLR_END "%zu: %u\n", i, GetLastError());
-            exit(1);
+            ok = false;
         }
 #else
         if (dlclose(instance->modules[i].handle) != 0) {
             fprintf(stderr, CLR_RED"ERROR: could not unload module"CLR_END "%zu: %s\n", i, dlerror());
-            exit(1);
+            ok = false;
         }
 #endif
     }
+    instance->module_count = 0;
+    return ok;
 }
\ No newline at end of file
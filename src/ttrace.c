@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <tvm/tvm.h>
+#include <tvm/ttrace.h>
+#include <common/cmd_colors.h>
+
+#define CLI_IMPLEMENTATION
+#include <common/cli.h>
+
+/*
+    ttrace decodes a trace written by tvm -t, one event per line or a summary with -s.
+    Given the program the trace was taken from, addresses are printed with their proc and line.
+*/
+
+#define TTRACE_NATIVE_SLOTS 256
+
+typedef struct {
+    uint64_t kinds[TTRACE_EVENT_COUNT];
+    uint64_t lost;
+    uint64_t icount;
+    uint64_t last_ns;
+    uint64_t alloc_bytes;
+    uint64_t native_calls[TTRACE_NATIVE_SLOTS];
+    uint64_t native_ns[TTRACE_NATIVE_SLOTS];
+} ttrace_summary_t;
+
+static uint8_t* ttrace_read_file(const char* file_name, size_t* size) {
+    FILE* file = fopen(file_name, "rb");
+    if (!file) {
+        fprintf(stderr, CLR_RED"File can't be opened: "CLR_END"%s\n", file_name);
+        return NULL;
+    }
+    fseek(file, 0L, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    uint8_t* data = malloc(file_size > 0 ? file_size : 1);
+    *size = fread(data, 1, file_size, file);
+    fclose(file);
+    return data;
+}
+
+static void ttrace_print_addr(const tvm_program_t* program, word_t addr) {
+    fprintf(stdout, "0x%08x", addr);
+    if (program == NULL)
+        return;
+    const tvm_debug_symbol_t* symbol = tvm_debug_symbol(program, addr);
+    if (symbol != NULL)
+        fprintf(stdout, " %s+%u", symbol->name, addr - symbol->addr);
+    uint32_t line = tvm_debug_line(program, addr);
+    if (line != 0)
+        fprintf(stdout, " line %u", line);
+}
+
+static void ttrace_print_event(const tvm_program_t* program, const ttrace_event_t* event) {
+    fprintf(stdout, "%-9s ", ttrace_event_to_cstr(event->kind));
+    switch (event->kind) {
+    case TTRACE_EVENT_BRANCH_TAKEN:
+    case TTRACE_EVENT_JUMP:
+    case TTRACE_EVENT_CALL:
+    case TTRACE_EVENT_RET:
+        ttrace_print_addr(program, event->ip);
+        fprintf(stdout, " -> ");
+        ttrace_print_addr(program, event->target);
+        break;
+    case TTRACE_EVENT_NATIVE:
+        ttrace_print_addr(program, event->ip);
+        fprintf(stdout, " id %llu %llu ns", (unsigned long long)event->value, (unsigned long long)event->ns);
+        break;
+    case TTRACE_EVENT_ALLOC:
+        ttrace_print_addr(program, event->ip);
+        fprintf(stdout, " %llu bytes", (unsigned long long)event->value);
+        break;
+    case TTRACE_EVENT_EXCEPTION:
+        ttrace_print_addr(program, event->ip);
+        fprintf(stdout, " %s", exception_to_cstr((exception_t)event->value));
+        break;
+    case TTRACE_EVENT_TIME:
+        fprintf(stdout, "%.3f ms %llu instructions", event->ns / 1e6, (unsigned long long)event->value);
+        break;
+    case TTRACE_EVENT_LOST:
+        fprintf(stdout, "%llu events", (unsigned long long)event->value);
+        break;
+    case TTRACE_EVENT_END:
+        fprintf(stdout, "%llu instructions", (unsigned long long)event->value);
+        break;
+    default:
+        ttrace_print_addr(program, event->ip);
+        break;
+    }
+    fprintf(stdout, "\n");
+}
+
+static void ttrace_summarize(ttrace_summary_t* summary, const ttrace_event_t* event) {
+    summary->kinds[event->kind]++;
+    switch (event->kind) {
+    case TTRACE_EVENT_NATIVE:
+        if (event->value < TTRACE_NATIVE_SLOTS) {
+            summary->native_calls[event->value]++;
+            summary->native_ns[event->value] += event->ns;
+        }
+        break;
+    case TTRACE_EVENT_ALLOC:
+        summary->alloc_bytes += event->value;
+        break;
+    case TTRACE_EVENT_TIME:
+        summary->last_ns = event->ns;
+        summary->icount = event->value;
+        break;
+    case TTRACE_EVENT_LOST:
+        summary->lost += event->value;
+        break;
+    case TTRACE_EVENT_END:
+        summary->icount = event->value;
+        break;
+    }
+}
+
+static void ttrace_print_summary(const ttrace_summary_t* summary) {
+    fprintf(stdout, "instructions: %llu\n", (unsigned long long)summary->icount);
+    if (summary->last_ns > 0)
+        fprintf(stdout, "last time stamp: %.3f ms\n", summary->last_ns / 1e6);
+    fprintf(stdout, "\nevents:\n");
+    for (int i = 0; i < TTRACE_EVENT_COUNT; i++) {
+        if (summary->kinds[i] != 0)
+            fprintf(stdout, "  %-9s %14llu\n", ttrace_event_to_cstr(i), (unsigned long long)summary->kinds[i]);
+    }
+    if (summary->kinds[TTRACE_EVENT_ALLOC] != 0)
+        fprintf(stdout, "\nallocated: %llu bytes\n", (unsigned long long)summary->alloc_bytes);
+    if (summary->kinds[TTRACE_EVENT_NATIVE] != 0) {
+        fprintf(stdout, "\nnatives:        calls       total ns        mean ns\n");
+        for (int i = 0; i < TTRACE_NATIVE_SLOTS; i++) {
+            if (summary->native_calls[i] == 0)
+                continue;
+            fprintf(stdout, "  %-4d %14llu %14llu %14llu\n", i, (unsigned long long)summary->native_calls[i],
+                (unsigned long long)summary->native_ns[i], (unsigned long long)(summary->native_ns[i] / summary->native_calls[i]));
+        }
+    }
+    if (summary->lost > 0)
+        fprintf(stdout, CLR_YELLOW"\n%llu events were lost"CLR_END"\n", (unsigned long long)summary->lost);
+}
+
+int main(int argc, char **argv) {
+    cli_ttrace_args_t args = {0};
+    if (!cli_ttrace_parse_command_line(&args, &argc, &argv))
+        return EXIT_FAILURE;
+
+    size_t size = 0;
+    uint8_t* data = ttrace_read_file(args.file_name, &size);
+    if (data == NULL)
+        return EXIT_FAILURE;
+    ttrace_reader_t reader;
+    if (!ttrace_reader_init(&reader, data, size)) {
+        fprintf(stderr, CLR_RED"Not a trace: "CLR_END"%s\n", args.file_name);
+        free(data);
+        return EXIT_FAILURE;
+    }
+
+    tvm_t vm = tvm_init();
+    const tvm_program_t* program = NULL;
+    if (args.program_name != NULL) {
+        if (!tvm_load_program_from_file(&vm, args.program_name)) {
+            tvm_destroy(&vm);
+            free(data);
+            return EXIT_FAILURE;
+        }
+        if (tvm_debug_map(&vm.program))
+            program = &vm.program;
+        else
+            fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"%s has no debug info\n", args.program_name);
+    }
+
+    ttrace_summary_t summary = {0};
+    ttrace_event_t event;
+    bool ended = false;
+    while (ttrace_next(&reader, &event)) {
+        if (args.summary)
+            ttrace_summarize(&summary, &event);
+        else
+            ttrace_print_event(program, &event);
+        ended = event.kind == TTRACE_EVENT_END;
+    }
+    if (args.summary)
+        ttrace_print_summary(&summary);
+    if (!ended)
+        fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"the trace is truncated at byte %zu\n", reader.cursor);
+
+    tvm_destroy(&vm);
+    free(data);
+    return 0;
+}
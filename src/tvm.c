@@ -3,14 +3,47 @@
 // #include <locale.h>
 #endif
 
-#define TVM_IMPLEMENTATION
 #include <tvm/tvm.h>
 #include <tvm/tci.h>
 
+#define TPROF_IMPLEMENTATION
+#include <tvm/tprof.h>
+
+#define TSTATS_IMPLEMENTATION
+#include <tvm/tstats.h>
+
+#include <tvm/ttrace.h>
+
+#define TSNAP_IMPLEMENTATION
+#include <tvm/tsnap.h>
+
 #define CLI_IMPLEMENTATION
 #include <common/cli.h>
 
-extern tci_t tci_instance;
+#include <signal.h>
+
+// async natives mostly wait on io, so the pool is not sized by the cpu count
+#define TVM_NATIVE_POOL_SIZE 4
+
+#ifdef SIGUSR1
+static void tvm_native_stats_signal(int sig) {
+    (void)sig;
+    tci_stats_request_dump();
+}
+#endif
+
+// like tvm_run but stops on the first ckpt, a program without one runs to the end
+static exception_t tvm_run_to_checkpoint(tvm_t* vm, bool* reached) {
+    for (;;) {
+        tvm_status_t status = tvm_step_n(vm, UINT64_MAX);
+        if (status == TVM_STATUS_BLOCKED)
+            tvm_wait_native(vm);
+        else if (status != TVM_STATUS_RUNNING)
+            break;
+    }
+    *reached = !vm->halted && vm->except == EXCEPT_OK;
+    return vm->except;
+}
 
 int main(int argc, char **argv) {
     
@@ -30,25 +63,126 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
 
 
-    tci_instance = tci_init();
+    tci_t tci = tci_init();
     tvm_t vm = tvm_init();
+    vm.tci = &tci;
 
-    tvm_load_program_from_file(&vm, args.file_name);
+    bool loaded = args.restore ? tsnap_load(&vm, args.file_name) : tvm_load_program_from_file(&vm, args.file_name);
+    if (!loaded) {
+        tvm_destroy(&vm);
+        tci_destroy(&tci);
+        return EXIT_FAILURE;
+    }
 
     if (vm.program.metadata.module_count > 0) {
         //FIXME: support for multiple modules
         const char* module_name = vm.program.metadata.modules[0].module_name;
         printf("xx:%s\n", module_name);
-        tci_load_module(&tci_instance, module_name);
-        tci_metaprogram_to_ffi(&tci_instance, &vm);
+        if (!tci_load_module(&tci, module_name)) {
+            tvm_destroy(&vm);
+            tci_destroy(&tci);
+            return EXIT_FAILURE;
+        }
+        tci_metaprogram_to_ffi(&tci, &vm);
+    }
+
+    tpool_t pool;
+    for (uint32_t i = 0; i < vm.program.metadata.modules[0].cfun_count; i++) {
+        if (vm.program.metadata.modules[0].cfuns[i].flags & TVM_CFUN_ASYNC) {
+            if (tpool_init(&pool, TVM_NATIVE_POOL_SIZE))
+                vm.pool = &pool;
+            break;
+        }
+    }
+
+    // the vm thread works on parallel regions too, so the pool gets one thread less than the cpu count
+    tpool_t par_pool;
+    for (size_t i = 0; i < vm.program.size; i++) {
+        if (vm.program.code[i].type == OP_PMAP || vm.program.code[i].type == OP_PREDUCE) {
+            if (tthread_cpu_count() > 1 && tpool_init(&par_pool, tthread_cpu_count() - 1))
+                vm.par_pool = &par_pool;
+            break;
+        }
+    }
+
+    if (args.stats || args.stats_json_name != NULL)
+        tvm_stats_enable(&vm);
+    if (args.gc_stats_interval > 0)
+        tgc_stats_dump_every(&vm.gc, stderr, (uint64_t)args.gc_stats_interval);
+    if (args.native_stats) {
+        tci_stats_enable(&tci);
+#ifdef SIGUSR1
+        signal(SIGUSR1, tvm_native_stats_signal);
+#endif
+    }
+
+    tprof_t prof = {0};
+    bool profiling = args.profile_name != NULL && tprof_start(&prof, &vm, args.profile_hz, TPROF_DEFAULT_CAPACITY);
+
+    ttrace_t trace = {0};
+    bool tracing = args.trace_name != NULL && ttrace_start(&trace, &vm, args.trace_name, TTRACE_DEFAULT_CAPACITY);
+
+    bool reached = false;
+    exception_t except = args.snapshot_name != NULL ? tvm_run_to_checkpoint(&vm, &reached) : tvm_run(&vm);
+    bool saved = reached && tsnap_save(&vm, args.snapshot_name);
+
+    if (tracing) {
+        ttrace_stop(&trace);
+        if (trace.dropped > 0)
+            fprintf(stderr, "ttrace: %llu events dropped\n", (unsigned long long)trace.dropped);
     }
 
-    tvm_run(&vm);
+    if (profiling) {
+        tprof_stop(&prof);
+        FILE* out = fopen(args.profile_name, "w");
+        if (out == NULL) {
+            perror("Failed to open the profile");
+        } else {
+            tprof_write_folded(&prof, out);
+            fclose(out);
+            fprintf(stderr, "tprof: %llu samples written to %s", (unsigned long long)prof.count, args.profile_name);
+            if (prof.dropped > 0)
+                fprintf(stderr, ", %llu dropped", (unsigned long long)prof.dropped);
+            fprintf(stderr, "\n");
+        }
+        tprof_destroy(&prof);
+    }
+    if (args.native_stats)
+        tci_stats_write(&tci, &vm, stderr);
+    if (args.gc_stats || args.gc_stats_interval > 0)
+        tgc_stats_write(&vm.gc, stderr);
+    if (args.stats)
+        tstats_write_text(&vm, stderr);
+    if (args.stats_json_name != NULL) {
+        FILE* out = fopen(args.stats_json_name, "w");
+        if (out == NULL) {
+            perror("Failed to open the stats file");
+        } else {
+            tstats_write_json(&vm, out);
+            fclose(out);
+        }
+    }
+    if (except != EXCEPT_OK) {
+        fprintf(stderr, CLR_RED"ERROR: Exception occured "CLR_END "%s\n", exception_to_cstr(except));
+        tvm_stack_trace(&vm, stderr);
+    }
+    else if (saved)
+        fprintf(stdout, "Snapshot written to %s at ip %u\n", args.snapshot_name, vm.ip);
+    else if (reached)
+        fprintf(stderr, CLR_RED"Snapshot was not written: "CLR_END"%s\n", args.snapshot_name);
+    else if (args.snapshot_name != NULL)
+        fprintf(stderr, CLR_YELLOW"Warning: "CLR_END"no ckpt was reached, %s was not written\n", args.snapshot_name);
+    else
+        fprintf(stdout, "Program halted " CLR_GREEN"succesfully...\n"CLR_END);
 
-    tci_unload_all(&tci_instance);
     tvm_destroy(&vm);
+    if (vm.pool)
+        tpool_destroy(vm.pool);
+    if (vm.par_pool)
+        tpool_destroy(vm.par_pool);
+    tci_unload_all(&tci);
 
-    tci_destroy(&tci_instance);
+    tci_destroy(&tci);
 
-    return 0;
+    return except == EXCEPT_OK && saved == reached ? 0 : 1;
 }